@@ -0,0 +1,31 @@
+#include "AsyncDisk.h"
+
+AsyncDisk::AsyncDisk(EventLoop& _loop) {
+    loop = &_loop;
+}
+
+AsyncDisk::CallAwaiter AsyncDisk::open(const std::string& fileName) {
+    fsDisk* disk = loop->getDisk();
+    return CallAwaiter(loop, [disk, fileName]() { return disk->OpenFile(fileName); });
+}
+
+AsyncDisk::RequestAwaiter AsyncDisk::read(int fd, char* buf, int len, off_t offset) {
+    IoRequest request = {IO_READ, fd, buf, len, offset, -1};
+    return RequestAwaiter(loop, request);
+}
+
+AsyncDisk::RequestAwaiter AsyncDisk::write(int fd, const char* buf, int len) {
+    // Requests never write through their buffer when writing
+    IoRequest request = {IO_WRITE, fd, const_cast<char*>(buf), len, IO_APPEND, -1};
+    return RequestAwaiter(loop, request);
+}
+
+AsyncDisk::CallAwaiter AsyncDisk::copy(const std::string& srcFileName, const std::string& destFileName) {
+    fsDisk* disk = loop->getDisk();
+    return CallAwaiter(loop, [disk, srcFileName, destFileName]() { return disk->CopyFile(srcFileName, destFileName); });
+}
+
+AsyncDisk::CallAwaiter AsyncDisk::del(const std::string& fileName) {
+    fsDisk* disk = loop->getDisk();
+    return CallAwaiter(loop, [disk, fileName]() { return disk->DelFile(fileName); });
+}
@@ -0,0 +1,121 @@
+#ifndef DISK_SIMULATOR_ASYNCDISK_H
+#define DISK_SIMULATOR_ASYNCDISK_H
+
+#include <functional>
+#include <string>
+#include "EventLoop.h"
+
+/**
+ * AsyncDisk class is the coroutine front-end of a disk: each operation is co_awaited by a coroutine
+ * running on an EventLoop, e.g. `int n = co_await disk.read(fd, buf, len);`.
+ * Reads and writes are the disk's asynchronous requests, so the loop runs other coroutines while they
+ * are in flight. Opening, copying and deleting change the directory, which runs alone anyway; they
+ * yield to the other ready coroutines first and then run on the loop's thread.
+ */
+class AsyncDisk {
+
+public:
+
+    /**
+     * Awaitable of a read or a write, resumed by the loop once the disk completed it.
+     */
+    class RequestAwaiter {
+        EventLoop* loop;
+        IoRequest request;
+        int result;
+
+    public:
+        RequestAwaiter(EventLoop* _loop, const IoRequest& _request) : loop(_loop), request(_request), result(-1) {}
+
+        bool await_ready() const noexcept { return false; }
+
+        /**
+         * Submit the request. A request that can't be submitted resumes the coroutine right away.
+         */
+        bool await_suspend(std::coroutine_handle<> handle) { return loop->submit(request, handle, &result) == 1; }
+
+        /**
+         * @return The amount of bytes read or written, or -1 on error.
+         */
+        int await_resume() const noexcept { return result; }
+    };
+
+    /**
+     * Awaitable of a directory operation: the coroutine yields its turn, then the operation runs.
+     */
+    class CallAwaiter {
+        EventLoop* loop;
+        std::function<int()> call;
+
+    public:
+        CallAwaiter(EventLoop* _loop, std::function<int()> _call) : loop(_loop), call(std::move(_call)) {}
+
+        bool await_ready() const noexcept { return false; }
+
+        void await_suspend(std::coroutine_handle<> handle) { loop->schedule(handle); }
+
+        /**
+         * @return What the disk operation returned.
+         */
+        int await_resume() { return call(); }
+    };
+
+    /**
+     * Constructor to create the front-end of a loop's disk.
+     *
+     * @param _loop: The loop the awaiting coroutines run on.
+     */
+    explicit AsyncDisk(EventLoop& _loop);
+
+    /**
+     * Open a file, like fsDisk::OpenFile.
+     *
+     * @param fileName: The name of the file to open.
+     * @return Awaitable giving the file descriptor, or -1 on error.
+     */
+    CallAwaiter open(const std::string& fileName);
+
+    /**
+     * Read data from a file, like fsDisk::ReadFromFile. No null terminator is added.
+     *
+     * @param fd: The index of the file descriptor to read from.
+     * @param buf: The buffer to store the data, valid until the read completes.
+     * @param len: The maximum length of data to read.
+     * @param offset: The offset in the file to read from (default: 0).
+     * @return Awaitable giving the amount of bytes read, or -1 on error.
+     */
+    RequestAwaiter read(int fd, char* buf, int len, off_t offset = 0);
+
+    /**
+     * Write data to the end of a file, like fsDisk::WriteToFile.
+     *
+     * @param fd: The index of the file descriptor to write to.
+     * @param buf: The data to write, valid until the write completes.
+     * @param len: The length of data to write.
+     * @return Awaitable giving the amount of bytes written, or -1 on error.
+     */
+    RequestAwaiter write(int fd, const char* buf, int len);
+
+    /**
+     * Copy a file, like fsDisk::CopyFile.
+     *
+     * @param srcFileName: The name of the source file.
+     * @param destFileName: The name of the destination file.
+     * @return Awaitable giving 1 on success, or -1 on error.
+     */
+    CallAwaiter copy(const std::string& srcFileName, const std::string& destFileName);
+
+    /**
+     * Delete a file, like fsDisk::DelFile.
+     *
+     * @param fileName: The name of the file to delete.
+     * @return Awaitable giving 1 on success, or -1 on error.
+     */
+    CallAwaiter del(const std::string& fileName);
+
+private:
+
+    EventLoop* loop; // The loop of the awaiting coroutines, and through it the disk
+};
+
+#endif //DISK_SIMULATOR_ASYNCDISK_H
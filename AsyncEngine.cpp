@@ -0,0 +1,21 @@
+#include "AsyncEngine.h"
+#include "ThreadPoolAsyncEngine.h"
+#ifdef __linux__
+#include "UringAsyncEngine.h"
+#endif
+
+AsyncEngine* AsyncEngine::create(BlockDevice* device, int depth) {
+#ifdef __linux__
+    // io_uring needs a descriptor to access, and a kernel that lets us set up a ring
+    if (device->getHandle() != -1)
+    {
+        UringAsyncEngine* engine = new UringAsyncEngine(device->getHandle(), depth);
+        if (engine->isReady())
+            return engine;
+
+        delete engine;
+    }
+#endif
+
+    return new ThreadPoolAsyncEngine(device, depth);
+}
@@ -0,0 +1,70 @@
+#ifndef DISK_SIMULATOR_ASYNCENGINE_H
+#define DISK_SIMULATOR_ASYNCENGINE_H
+
+#include <cstddef>
+#include <vector>
+#include <sys/types.h>
+#include "BlockDevice.h"
+
+#define ASYNC_QUEUE_DEPTH 32 // Device accesses an engine keeps in flight at once
+
+/**
+ * A single device access run by an AsyncEngine.
+ */
+struct AsyncOp {
+    bool write;                 // Write the buffer to the device, otherwise read into it
+    char* buf;                  // The buffer, kept valid by the submitter until the access is reaped
+    size_t len;                 // The amount of bytes
+    off_t offset;               // The absolute offset on the device
+    unsigned long long tag;     // Chosen by the submitter, handed back with the completion
+    int result;                 // Set on completion: 1 if all bytes were transferred, -1 on error
+};
+
+/**
+ * AsyncEngine class runs device accesses in the background, many at a time.
+ * Accesses are submitted without waiting for them, and their completions are reaped later in any order.
+ * Every call holds the engine's lock, so an engine can be shared between threads.
+ */
+class AsyncEngine {
+
+public:
+
+    virtual ~AsyncEngine() = default;
+
+    /**
+     * Start a device access. It's queued if the engine already has its full depth in flight.
+     *
+     * @param op: The access to run.
+     * @return 1 if the access was accepted, -1 if there's an error.
+     */
+    virtual int submit(const AsyncOp& op) = 0;
+
+    /**
+     * Collect finished accesses, waiting for them if needed.
+     *
+     * @param completed: Vector to append the finished accesses to, with their result set.
+     * @param minimum: The least amount of accesses to collect, capped by the amount not collected yet.
+     *                 0 collects whatever has finished without waiting.
+     * @return The amount of accesses appended.
+     */
+    virtual int reap(std::vector<AsyncOp>& completed, int minimum) = 0;
+
+    /**
+     * Get the amount of submitted accesses that were not collected yet.
+     *
+     * @return The amount of outstanding accesses.
+     */
+    virtual int getOutstanding() const = 0;
+
+    /**
+     * Create the best engine for a device: io_uring on Linux when the device has a file descriptor
+     * and the kernel allows it, otherwise a pool of threads calling the device.
+     *
+     * @param device: The device the accesses go to, it must outlive the engine.
+     * @param depth: The amount of accesses kept in flight at once.
+     * @return Pointer to the new engine.
+     */
+    static AsyncEngine* create(BlockDevice* device, int depth);
+};
+
+#endif //DISK_SIMULATOR_ASYNCENGINE_H
@@ -0,0 +1,391 @@
+#include <algorithm>
+#include <cstring>
+#include "BlockCache.h"
+
+BlockCache::BlockCache(BlockDevice* _device, int _capacity) {
+    device = _device;
+    capacity = _capacity;
+    blockSize = 0;
+    baseOffset = 0;
+    bypassMisses = 0;
+
+    // Every shard holds at least one block
+    shardsCount = std::min(CACHE_SHARDS, capacity);
+    if (shardsCount > 0)
+        shards.reset(new Shard[shardsCount]);
+
+    for (int i = 0; i < shardsCount; i++)
+    {
+        shards[i].capacity = capacity / shardsCount + (i < capacity % shardsCount ? 1 : 0);
+        shards[i].hits = 0;
+        shards[i].misses = 0;
+    }
+}
+
+void BlockCache::reset(int _blockSize, off_t _baseOffset) {
+    blockSize = _blockSize;
+    baseOffset = _baseOffset;
+
+    for (int i = 0; i < shardsCount; i++)
+    {
+        std::lock_guard<std::mutex> guard(shards[i].lock);
+        shards[i].entries.clear();
+        shards[i].lru.clear();
+        shards[i].slots.clear();
+        shards[i].freeSlots.clear();
+    }
+}
+
+int BlockCache::read(int block, int offset, char* buf, int len) {
+    off_t location = blockLocation(block) + offset;
+
+    if (capacity == 0)
+        return device->read(buf, len, location);
+
+    Shard& shard = shardOf(block);
+    std::unique_lock<std::mutex> guard(shard.lock);
+    CacheEntry* entry = getEntry(shard, guard, block, true);
+    if (entry == nullptr)
+        return -1;
+
+    memcpy(buf, shard.slots[entry->slot].get() + offset, len);
+    return 1;
+}
+
+int BlockCache::write(int block, int offset, const char* buf, int len) {
+    off_t location = blockLocation(block) + offset;
+
+    if (capacity == 0)
+        return device->write(buf, len, location);
+
+    Shard& shard = shardOf(block);
+    std::unique_lock<std::mutex> guard(shard.lock);
+
+    // A block that is overwritten as a whole doesn't have to be read first
+    CacheEntry* entry = getEntry(shard, guard, block, offset != 0 || len != blockSize);
+    if (entry == nullptr)
+        return -1;
+
+    memcpy(shard.slots[entry->slot].get() + offset, buf, len);
+    entry->dirty = true;
+    return 1;
+}
+
+int BlockCache::readRange(off_t location, char* buf, size_t len) {
+    if (capacity == 0)
+        return device->read(buf, len, baseOffset + location);
+
+    while (len > 0)
+    {
+        int block = static_cast<int>(location / blockSize);
+        int offset = static_cast<int>(location % blockSize);
+        int blocks = static_cast<int>((offset + len + blockSize - 1) / blockSize);
+
+        // A long uncached run is read in one go, past the cache and without any of its locks
+        int run = countUncached(block, blocks);
+        if (run >= CACHE_BYPASS_BLOCKS)
+        {
+            size_t amount = std::min<size_t>(len, static_cast<size_t>(run) * blockSize - offset);
+            if (device->read(buf, amount, baseOffset + location) == -1)
+                return -1;
+
+            bypassMisses += run;
+            buf += amount;
+            len -= amount;
+            location += amount;
+            continue;
+        }
+
+        int amount = static_cast<int>(std::min<size_t>(len, blockSize - offset));
+        Shard& shard = shardOf(block);
+        std::unique_lock<std::mutex> guard(shard.lock);
+        CacheEntry* entry = getEntry(shard, guard, block, true);
+        if (entry == nullptr)
+            return -1;
+
+        memcpy(buf, shard.slots[entry->slot].get() + offset, amount);
+        buf += amount;
+        len -= amount;
+        location += amount;
+    }
+
+    return 1;
+}
+
+int BlockCache::writeRange(off_t location, const char* buf, size_t len) {
+    if (capacity == 0)
+        return device->write(buf, len, baseOffset + location);
+
+    while (len > 0)
+    {
+        int block = static_cast<int>(location / blockSize);
+        int offset = static_cast<int>(location % blockSize);
+        int blocks = static_cast<int>((offset + len + blockSize - 1) / blockSize);
+
+        // The device holds the only copy of an uncached block, so a long run is written straight to it
+        int run = countUncached(block, blocks);
+        if (run >= CACHE_BYPASS_BLOCKS)
+        {
+            size_t amount = std::min<size_t>(len, static_cast<size_t>(run) * blockSize - offset);
+            if (device->write(buf, amount, baseOffset + location) == -1)
+                return -1;
+
+            buf += amount;
+            len -= amount;
+            location += amount;
+            continue;
+        }
+
+        int amount = static_cast<int>(std::min<size_t>(len, blockSize - offset));
+        Shard& shard = shardOf(block);
+        std::unique_lock<std::mutex> guard(shard.lock);
+        CacheEntry* entry = getEntry(shard, guard, block, offset != 0 || amount != blockSize);
+        if (entry == nullptr)
+            return -1;
+
+        memcpy(shard.slots[entry->slot].get() + offset, buf, amount);
+        entry->dirty = true;
+        buf += amount;
+        len -= amount;
+        location += amount;
+    }
+
+    return 1;
+}
+
+int BlockCache::evictRange(off_t location, size_t len) {
+    if (capacity == 0 || len == 0)
+        return 1;
+
+    int first = static_cast<int>(location / blockSize);
+    int last = static_cast<int>((location + len - 1) / blockSize);
+
+    for (int block = first; block <= last; block++)
+    {
+        Shard& shard = shardOf(block);
+        std::unique_lock<std::mutex> guard(shard.lock);
+
+        auto it = findIdle(shard, guard, block);
+        if (it == shard.entries.end())
+            continue;
+
+        if (it->second.dirty)
+        {
+            if (writeBack(shard, guard, block, it->second) == -1)
+                return -1;
+
+            // Waiters may have run while the lock was released, but none can drop a busy block
+            it = shard.entries.find(block);
+        }
+
+        dropEntry(shard, it);
+    }
+
+    return 1;
+}
+
+int BlockCache::flush() {
+    std::vector<int> dirtyBlocks;
+
+    for (int i = 0; i < shardsCount; i++)
+    {
+        std::lock_guard<std::mutex> guard(shards[i].lock);
+        for (auto& pair : shards[i].entries)
+            if (pair.second.dirty)
+                dirtyBlocks.push_back(pair.first);
+    }
+
+    // Write back in disk order
+    std::sort(dirtyBlocks.begin(), dirtyBlocks.end());
+
+    for (int block : dirtyBlocks)
+    {
+        Shard& shard = shardOf(block);
+        std::unique_lock<std::mutex> guard(shard.lock);
+
+        // The block may have been written back or evicted since it was listed
+        auto it = findIdle(shard, guard, block);
+        if (it != shard.entries.end() && it->second.dirty && writeBack(shard, guard, block, it->second) == -1)
+            return -1;
+    }
+
+    return 1;
+}
+
+long long BlockCache::getHits() const {
+    long long hits = 0;
+    for (int i = 0; i < shardsCount; i++)
+    {
+        std::lock_guard<std::mutex> guard(shards[i].lock);
+        hits += shards[i].hits;
+    }
+
+    return hits;
+}
+
+long long BlockCache::getMisses() const {
+    long long misses = bypassMisses;
+    for (int i = 0; i < shardsCount; i++)
+    {
+        std::lock_guard<std::mutex> guard(shards[i].lock);
+        misses += shards[i].misses;
+    }
+
+    return misses;
+}
+
+BlockCache::Shard& BlockCache::shardOf(int block) const {
+    return shards[block % shardsCount];
+}
+
+BlockCache::CacheEntry* BlockCache::getEntry(Shard& shard, std::unique_lock<std::mutex>& guard, int block, bool load) {
+    while (true)
+    {
+        auto it = findIdle(shard, guard, block);
+        if (it != shard.entries.end())
+        {
+            shard.hits++;
+
+            // Move the block to the front of the LRU list
+            shard.lru.splice(shard.lru.begin(), shard.lru, it->second.lruPosition);
+            return &it->second;
+        }
+
+        int slot = takeSlot(shard, guard);
+        if (slot == -1)
+            return nullptr;
+
+        // Another thread may have cached the block while the lock was released for an eviction
+        if (shard.entries.find(block) != shard.entries.end())
+        {
+            shard.freeSlots.push_back(slot);
+            continue;
+        }
+
+        shard.lru.push_front(block);
+        CacheEntry& entry = shard.entries[block];
+        entry.slot = slot;
+        entry.dirty = false;
+        entry.busy = load;
+        entry.lruPosition = shard.lru.begin();
+
+        if (!load)
+            return &entry;
+
+        // The block is loaded without the lock, threads asking for it wait until it's ready
+        shard.misses++;
+        char* data = shard.slots[slot].get();
+        guard.unlock();
+        int result = device->read(data, blockSize, blockLocation(block));
+        guard.lock();
+
+        entry.busy = false;
+        shard.idle.notify_all();
+
+        if (result == -1)
+        {
+            dropEntry(shard, shard.entries.find(block));
+            return nullptr;
+        }
+
+        return &entry;
+    }
+}
+
+std::unordered_map<int, BlockCache::CacheEntry>::iterator BlockCache::findIdle(Shard& shard, std::unique_lock<std::mutex>& guard, int block) {
+    auto it = shard.entries.find(block);
+    while (it != shard.entries.end() && it->second.busy)
+    {
+        shard.idle.wait(guard);
+        it = shard.entries.find(block);
+    }
+
+    return it;
+}
+
+int BlockCache::takeSlot(Shard& shard, std::unique_lock<std::mutex>& guard) {
+    while (true)
+    {
+        if (!shard.freeSlots.empty())
+        {
+            int slot = shard.freeSlots.back();
+            shard.freeSlots.pop_back();
+            return slot;
+        }
+
+        if (static_cast<int>(shard.slots.size()) < shard.capacity)
+        {
+            // Below capacity, a new slot is allocated instead of evicting a block
+            shard.slots.emplace_back(new char[blockSize]);
+            return static_cast<int>(shard.slots.size()) - 1;
+        }
+
+        // Evict the least recently used block no other thread is loading or writing back
+        auto victim = std::find_if(shard.lru.rbegin(), shard.lru.rend(),
+                                   [&shard](int block) { return !shard.entries[block].busy; });
+        if (victim == shard.lru.rend())
+        {
+            shard.idle.wait(guard);
+            continue;
+        }
+
+        int block = *victim;
+        auto it = shard.entries.find(block);
+        if (it->second.dirty)
+        {
+            // The lock is released while writing, so the shard is looked at again afterwards
+            if (writeBack(shard, guard, block, it->second) == -1)
+                return -1;
+
+            continue;
+        }
+
+        int slot = it->second.slot;
+        shard.lru.erase(it->second.lruPosition);
+        shard.entries.erase(it);
+        return slot;
+    }
+}
+
+int BlockCache::writeBack(Shard& shard, std::unique_lock<std::mutex>& guard, int block, CacheEntry& entry) {
+    // Nobody changes or drops a busy block, so its data is written without the lock
+    entry.busy = true;
+    const char* data = shard.slots[entry.slot].get();
+    guard.unlock();
+    int result = device->write(data, blockSize, blockLocation(block));
+    guard.lock();
+
+    entry.busy = false;
+    shard.idle.notify_all();
+
+    if (result == -1)
+        return -1;
+
+    entry.dirty = false;
+    return 1;
+}
+
+void BlockCache::dropEntry(Shard& shard, std::unordered_map<int, CacheEntry>::iterator it) {
+    shard.freeSlots.push_back(it->second.slot);
+    shard.lru.erase(it->second.lruPosition);
+    shard.entries.erase(it);
+}
+
+int BlockCache::countUncached(int block, int blocks) const {
+    int run = 0;
+    while (run < blocks)
+    {
+        Shard& shard = shardOf(block + run);
+        std::lock_guard<std::mutex> guard(shard.lock);
+        if (shard.entries.find(block + run) != shard.entries.end())
+            break;
+
+        run++;
+    }
+
+    return run;
+}
+
+off_t BlockCache::blockLocation(int block) const {
+    return baseOffset + static_cast<off_t>(block) * blockSize;
+}
@@ -0,0 +1,241 @@
+#ifndef DISK_SIMULATOR_BLOCKCACHE_H
+#define DISK_SIMULATOR_BLOCKCACHE_H
+
+#include <atomic>
+#include <condition_variable>
+#include <list>
+#include <memory>
+#include <mutex>
+#include <unordered_map>
+#include <vector>
+#include "BlockDevice.h"
+
+#define DEFAULT_CACHE_BLOCKS 256
+#define CACHE_BYPASS_BLOCKS 8 // Runs of at least this many uncached blocks go straight to the device
+#define CACHE_SHARDS 16 // Shards the cache is split into, each with its own lock and LRU list
+
+/**
+ * BlockCache class is a fixed-capacity write-back cache of disk blocks in front of a BlockDevice.
+ * Blocks are evicted in least recently used order, dirty blocks are written back on eviction or flush.
+ * A slot is allocated the first time it's needed, so a cache that never fills up never holds its capacity.
+ *
+ * The cache is split into shards by block number, each with its own lock, LRU list and share of the
+ * capacity, so accesses to different blocks rarely meet. A shard's lock is only held to look blocks up
+ * and copy their bytes: a block being loaded or written back is marked busy and the device is accessed
+ * without the lock, and only threads that need that same block wait for it. Runs read or written past
+ * the cache hold no lock at all, so the caller must not access a block from two threads at once unless
+ * both only read it (the disk's per-file locks see to that).
+ */
+class BlockCache {
+
+    /**
+     * A cached block: the slot holding its data, whether it differs from the device, whether a thread
+     * is loading it or writing it back, and its position in the LRU list.
+     */
+    struct CacheEntry {
+        int slot;
+        bool dirty;
+        bool busy;
+        std::list<int>::iterator lruPosition;
+    };
+
+    /**
+     * One shard of the cache, holding the blocks whose number modulo the shard count is its index.
+     */
+    struct alignas(64) Shard {
+        std::mutex lock;                                // Guards everything below
+        std::condition_variable idle;                   // Signalled when an entry stops being busy
+        int capacity;                                   // Maximum number of blocks in the shard
+
+        std::vector<std::unique_ptr<char[]>> slots;     // Data of the allocated slots, blockSize bytes each
+        std::vector<int> freeSlots;                     // Allocated slots not holding a block
+        std::list<int> lru;                             // Cached block indexes, most recently used first
+        std::unordered_map<int, CacheEntry> entries;    // Block index to its cache entry
+
+        long long hits;                                 // Accesses served from the shard
+        long long misses;                               // Accesses that had to read the device into the shard
+    };
+
+    BlockDevice* device;                            // Device the blocks are read from and written back to
+    int capacity;                                   // Maximum number of cached blocks, 0 disables the cache
+    int blockSize;                                  // Size of each block in bytes
+    off_t baseOffset;                               // Device offset of block 0
+
+    std::unique_ptr<Shard[]> shards;                // The shards, at most CACHE_SHARDS and at most the capacity
+    int shardsCount;                                // Number of shards
+    std::atomic<long long> bypassMisses;            // Blocks read straight from the device, past the cache
+
+public:
+
+    /**
+     * Constructor to initialize an empty cache.
+     *
+     * @param _device: Pointer to the device behind the cache.
+     * @param _capacity: The maximum number of cached blocks (0 disables caching).
+     */
+    BlockCache(BlockDevice* _device, int _capacity);
+
+    /**
+     * Drop every cached block without writing it back, and change the block geometry.
+     * No other access may run meanwhile.
+     *
+     * @param _blockSize: The new size of each block in bytes.
+     * @param _baseOffset: The device offset of block 0 (default: 0).
+     */
+    void reset(int _blockSize, off_t _baseOffset = 0);
+
+    /**
+     * Read bytes from a single block.
+     *
+     * @param block: The index of the block.
+     * @param offset: The offset inside the block to read from.
+     * @param buf: Pointer to the buffer to store the read data.
+     * @param len: The amount of bytes to read, offset + len must not pass the block end.
+     * @return 1 if successful, -1 if there's an error.
+     */
+    int read(int block, int offset, char* buf, int len);
+
+    /**
+     * Write bytes to a single block. The block only reaches the device on eviction or flush.
+     *
+     * @param block: The index of the block.
+     * @param offset: The offset inside the block to write to.
+     * @param buf: Pointer to the buffer containing data to write.
+     * @param len: The amount of bytes to write, offset + len must not pass the block end.
+     * @return 1 if successful, -1 if there's an error.
+     */
+    int write(int block, int offset, const char* buf, int len);
+
+    /**
+     * Read bytes that may span several blocks. Cached blocks are copied from the cache, runs of
+     * CACHE_BYPASS_BLOCKS or more uncached blocks are read with one device read and not cached.
+     *
+     * @param location: The offset from the start of block 0 to read from.
+     * @param buf: Pointer to the buffer to store the read data.
+     * @param len: The amount of bytes to read.
+     * @return 1 if successful, -1 if there's an error.
+     */
+    int readRange(off_t location, char* buf, size_t len);
+
+    /**
+     * Write bytes that may span several blocks. Cached blocks are updated in the cache, runs of
+     * CACHE_BYPASS_BLOCKS or more uncached blocks are written with one device write and not cached.
+     *
+     * @param location: The offset from the start of block 0 to write to.
+     * @param buf: Pointer to the buffer containing data to write.
+     * @param len: The amount of bytes to write.
+     * @return 1 if successful, -1 if there's an error.
+     */
+    int writeRange(off_t location, const char* buf, size_t len);
+
+    /**
+     * Write back and drop the cached blocks of a range, so the device holds their only copy
+     * and can be accessed directly.
+     *
+     * @param location: The offset from the start of block 0 where the range starts.
+     * @param len: The length of the range in bytes.
+     * @return 1 if successful, -1 if there's an error.
+     */
+    int evictRange(off_t location, size_t len);
+
+    /**
+     * Write every dirty block back to the device, in block order.
+     *
+     * @return 1 if successful, -1 if there's an error.
+     */
+    int flush();
+
+    /**
+     * Get the number of accesses served from the cache.
+     *
+     * @return The number of cache hits.
+     */
+    long long getHits() const;
+
+    /**
+     * Get the number of accesses that had to read the device.
+     *
+     * @return The number of cache misses.
+     */
+    long long getMisses() const;
+
+private:
+
+    /**
+     * Get the shard a block belongs to.
+     *
+     * @param block: The index of the block.
+     * @return The shard.
+     */
+    Shard& shardOf(int block) const;
+
+    /**
+     * Get the cache entry of a block, loading the block into a free or evicted slot if needed.
+     * The shard's lock is released while the device is accessed, and held again on return.
+     *
+     * @param shard: The shard of the block.
+     * @param guard: The held lock of the shard.
+     * @param block: The index of the block.
+     * @param load: Whether the block content must be read from the device on a miss.
+     * @return Pointer to the entry, not busy, or nullptr if there's an error.
+     */
+    CacheEntry* getEntry(Shard& shard, std::unique_lock<std::mutex>& guard, int block, bool load);
+
+    /**
+     * Find the entry of a block once no other thread is loading it or writing it back.
+     *
+     * @param shard: The shard of the block.
+     * @param guard: The held lock of the shard.
+     * @param block: The index of the block.
+     * @return The entry, or the end of the shard's entries if the block isn't cached.
+     */
+    std::unordered_map<int, CacheEntry>::iterator findIdle(Shard& shard, std::unique_lock<std::mutex>& guard, int block);
+
+    /**
+     * Get a slot for a new block: a free one, a new one below the shard's capacity, or the slot of the
+     * least recently used block that isn't busy. The shard's lock may be released meanwhile.
+     *
+     * @param shard: The shard.
+     * @param guard: The held lock of the shard.
+     * @return The slot, or -1 if there's an error.
+     */
+    int takeSlot(Shard& shard, std::unique_lock<std::mutex>& guard);
+
+    /**
+     * Write a dirty block back to the device, marking it busy and releasing the shard's lock meanwhile.
+     *
+     * @param shard: The shard of the block.
+     * @param guard: The held lock of the shard.
+     * @param block: The index of the block.
+     * @param entry: The entry of the block, dirty and not busy.
+     * @return 1 if successful, -1 if there's an error (the block stays dirty).
+     */
+    int writeBack(Shard& shard, std::unique_lock<std::mutex>& guard, int block, CacheEntry& entry);
+
+    /**
+     * Drop a cached block that isn't busy, freeing its slot.
+     *
+     * @param shard: The shard of the block.
+     * @param it: The entry of the block.
+     */
+    void dropEntry(Shard& shard, std::unordered_map<int, CacheEntry>::iterator it);
+
+    /**
+     * Count the uncached blocks a range starts with.
+     *
+     * @param block: The index of the first block of the range.
+     * @param blocks: The number of blocks in the range.
+     * @return The number of blocks before the first cached one.
+     */
+    int countUncached(int block, int blocks) const;
+
+    /**
+     * Get the device offset of a block.
+     *
+     * @param block: The index of the block.
+     * @return The absolute offset of the block on the device.
+     */
+    off_t blockLocation(int block) const;
+};
+
+#endif //DISK_SIMULATOR_BLOCKCACHE_H
@@ -0,0 +1,39 @@
+#include "BlockDevice.h"
+#include "MemoryBlockDevice.h"
+#include "FileBlockDevice.h"
+#include "MmapBlockDevice.h"
+
+const char* BlockDevice::view(off_t, size_t) const {
+    return nullptr; // Not addressable unless the backend says otherwise
+}
+
+int BlockDevice::getHandle() const {
+    return -1;
+}
+
+BlockDevice* BlockDevice::create(DeviceType type, off_t size, bool keepContent) {
+    BlockDevice* device = nullptr;
+
+    switch (type)
+    {
+        case DEVICE_MEMORY:
+            return new MemoryBlockDevice(size);
+
+        case DEVICE_FILE:
+            device = new FileBlockDevice(DISK_SIM_FILE, size, keepContent);
+            break;
+
+        case DEVICE_MMAP:
+            device = new MmapBlockDevice(DISK_SIM_FILE, size, keepContent);
+            break;
+    }
+
+    // File based devices may fail to open their image
+    if (device != nullptr && device->getSize() < size)
+    {
+        delete device;
+        return nullptr;
+    }
+
+    return device;
+}
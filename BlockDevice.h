@@ -0,0 +1,108 @@
+#ifndef DISK_SIMULATOR_BLOCKDEVICE_H
+#define DISK_SIMULATOR_BLOCKDEVICE_H
+
+#include <cstddef>
+#include <sys/types.h>
+
+#define DISK_SIM_FILE "DISK_SIM_FILE.txt"
+
+/**
+ * Storage backends a BlockDevice can be created with.
+ */
+enum DeviceType {
+    DEVICE_MEMORY,  // Image lives in RAM only, no syscalls at all
+    DEVICE_FILE,    // Image is a regular file accessed with pread/pwrite
+    DEVICE_MMAP     // Image is a regular file mapped into memory
+};
+
+/**
+ * BlockDevice class is the storage interface fsDisk talks to.
+ * It exposes the simulated disk image as a flat range of bytes addressed by absolute offsets.
+ */
+class BlockDevice {
+
+public:
+
+    virtual ~BlockDevice() = default;
+
+    /**
+     * Read bytes from the device at an absolute offset.
+     *
+     * @param buf: Pointer to the buffer to store the read data.
+     * @param len: The amount of bytes to read.
+     * @param offset: The absolute offset on the device to read from.
+     * @return 1 if all bytes were read, -1 if there's an error.
+     */
+    virtual int read(char* buf, size_t len, off_t offset) = 0;
+
+    /**
+     * Write bytes to the device at an absolute offset.
+     *
+     * @param buf: Pointer to the buffer containing data to write.
+     * @param len: The amount of bytes to write.
+     * @param offset: The absolute offset on the device to write to.
+     * @return 1 if all bytes were written, -1 if there's an error.
+     */
+    virtual int write(const char* buf, size_t len, off_t offset) = 0;
+
+    /**
+     * Get a direct pointer into the image, when the backend keeps it addressable.
+     * The pointer stays valid until the device is resized or destroyed.
+     *
+     * @param offset: The absolute offset on the device.
+     * @param len: The amount of bytes that will be accessed through the pointer.
+     * @return Pointer to the bytes at 'offset', or nullptr if the backend can't expose them.
+     */
+    virtual const char* view(off_t offset, size_t len) const;
+
+    /**
+     * Get the file descriptor of the image, for callers that access it with their own system calls.
+     *
+     * @return The descriptor, or -1 if the backend doesn't keep the image in a file it accesses with pread/pwrite.
+     */
+    virtual int getHandle() const;
+
+    /**
+     * Drop the whole content of the device, so every byte reads as zero.
+     * Backends release the storage instead of writing zeros, so this is O(1) in the device size.
+     *
+     * @return 1 if successful, -1 if there's an error.
+     */
+    virtual int zero() = 0;
+
+    /**
+     * Flush all written bytes to stable storage.
+     *
+     * @return 1 if successful, -1 if there's an error.
+     */
+    virtual int flush() = 0;
+
+    /**
+     * Change the size of the device. Bytes past the old size read as zeros.
+     * Pointers returned by view() are invalidated. If it fails, the device keeps its old size and content.
+     *
+     * @param size: The new size of the device in bytes.
+     * @return 1 if successful, -1 if there's an error.
+     */
+    virtual int resize(off_t size) = 0;
+
+    /**
+     * Get the size of the device.
+     *
+     * @return The size of the device in bytes.
+     */
+    virtual off_t getSize() const = 0;
+
+    /**
+     * Create a device of the given type.
+     *
+     * @param type: The storage backend to use.
+     * @param size: The size of the device in bytes (the minimum size when keeping an existing image).
+     * @param keepContent: Whether an existing image file is opened as is instead of being truncated.
+     *                     The in-memory backend always starts empty.
+     * @return Pointer to the new device, or nullptr if it could not be created.
+     */
+    static BlockDevice* create(DeviceType type, off_t size, bool keepContent = false);
+};
+
+#endif //DISK_SIMULATOR_BLOCKDEVICE_H
@@ -0,0 +1,89 @@
+#include "BlockRangeSet.h"
+
+void BlockRangeSet::add(off_t first, off_t last) {
+    split(first);
+    split(last + 1);
+
+    // Count the range in the spans inside it, and cover the gaps between them with new spans
+    off_t next = first;
+    auto it = spans.lower_bound(first);
+    while (next <= last)
+    {
+        if (it != spans.end() && it->first == next)
+        {
+            it->second.count++;
+            next = it->second.last + 1;
+            ++it;
+            continue;
+        }
+
+        off_t gapEnd = (it != spans.end() && it->first <= last) ? it->first - 1 : last;
+        spans.emplace_hint(it, next, Span{gapEnd, 1});
+        next = gapEnd + 1;
+    }
+
+    merge(first);
+    merge(last + 1);
+}
+
+void BlockRangeSet::remove(off_t first, off_t last) {
+    split(first);
+    split(last + 1);
+
+    auto it = spans.lower_bound(first);
+    while (it != spans.end() && it->first <= last)
+    {
+        if (--it->second.count == 0)
+            it = spans.erase(it);
+        else
+            ++it;
+    }
+
+    merge(first);
+    merge(last + 1);
+}
+
+bool BlockRangeSet::overlaps(off_t first, off_t last) const {
+    // The spans are disjoint, so only the last one starting at or before 'last' can reach 'first'
+    auto it = spans.upper_bound(last);
+    if (it == spans.begin())
+        return false;
+
+    --it;
+    return it->second.last >= first;
+}
+
+bool BlockRangeSet::empty() const {
+    return spans.empty();
+}
+
+void BlockRangeSet::clear() {
+    spans.clear();
+}
+
+void BlockRangeSet::split(off_t block) {
+    auto it = spans.upper_bound(block);
+    if (it == spans.begin())
+        return;
+
+    --it;
+    if (it->first == block || it->second.last < block)
+        return;
+
+    Span tail = {it->second.last, it->second.count};
+    it->second.last = block - 1;
+    spans.emplace_hint(std::next(it), block, tail);
+}
+
+void BlockRangeSet::merge(off_t block) {
+    auto it = spans.find(block);
+    if (it == spans.end() || it == spans.begin())
+        return;
+
+    auto previous = std::prev(it);
+    if (previous->second.last + 1 == block && previous->second.count == it->second.count)
+    {
+        previous->second.last = it->second.last;
+        spans.erase(it);
+    }
+}
@@ -0,0 +1,83 @@
+#ifndef DISK_SIMULATOR_BLOCKRANGESET_H
+#define DISK_SIMULATOR_BLOCKRANGESET_H
+
+#include <map>
+#include <sys/types.h>
+
+/**
+ * BlockRangeSet class counts how many added ranges cover each block, for ranges that may overlap.
+ * The covered blocks are kept as disjoint spans in a map keyed by their first block, each with the
+ * number of ranges covering it, so checking whether a range meets any covered block is one map search.
+ * Adding or removing a range splits the spans at its ends and merges them back where the counts match,
+ * and spans no range covers anymore are dropped, so the map only grows with the ranges present.
+ * The set has no lock of its own, its owner guards it.
+ */
+class BlockRangeSet {
+
+    /**
+     * A run of blocks covered by the same number of ranges.
+     */
+    struct Span {
+        off_t last;     // Last block of the span
+        int count;      // Number of ranges covering it
+    };
+
+    std::map<off_t, Span> spans; // First block of each span to the span, spans never overlap
+
+public:
+
+    /**
+     * Add a range of blocks.
+     *
+     * @param first: The first block of the range.
+     * @param last: The last block of the range, not before 'first'.
+     */
+    void add(off_t first, off_t last);
+
+    /**
+     * Remove a range of blocks added before.
+     *
+     * @param first: The first block of the range, as it was added.
+     * @param last: The last block of the range, as it was added.
+     */
+    void remove(off_t first, off_t last);
+
+    /**
+     * Check if any block of a range is covered.
+     *
+     * @param first: The first block of the range.
+     * @param last: The last block of the range.
+     * @return True if an added range shares a block with it, false otherwise.
+     */
+    bool overlaps(off_t first, off_t last) const;
+
+    /**
+     * Check if no block is covered.
+     *
+     * @return True if every added range was removed, false otherwise.
+     */
+    bool empty() const;
+
+    /**
+     * Forget every range.
+     */
+    void clear();
+
+private:
+
+    /**
+     * Make a block the first of its span, splitting the span covering it.
+     *
+     * @param block: The block to start a span at.
+     */
+    void split(off_t block);
+
+    /**
+     * Join the span starting at a block to the span before it, if they touch and have the same count.
+     *
+     * @param block: The first block of the span.
+     */
+    void merge(off_t block);
+};
+
+#endif //DISK_SIMULATOR_BLOCKRANGESET_H
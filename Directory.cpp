@@ -0,0 +1,148 @@
+#include <functional>
+#include "Directory.h"
+
+Directory::Directory() {
+    clear();
+}
+
+int Directory::find(std::string_view name) const {
+    return buckets[probe(name, std::hash<std::string_view>{}(name))];
+}
+
+std::pair<int, bool> Directory::insert(std::string_view name) {
+    size_t hash = std::hash<std::string_view>{}(name);
+    size_t bucket = probe(name, hash);
+    if (buckets[bucket] != -1)
+        return {buckets[bucket], false};
+
+    if (count + 1 > buckets.size() * DIRECTORY_MAX_LOAD)
+    {
+        grow();
+        bucket = probe(name, hash);
+    }
+
+    int id = freeNode;
+    if (id != -1)
+        freeNode = nodes[id].nextFree;
+    else
+    {
+        id = static_cast<int>(nodes.size());
+        nodes.emplace_back();
+    }
+
+    Node& node = nodes[id];
+    node.name.assign(name);
+    node.hash = hash;
+    node.entry = {nullptr, -1, 0, false, {}, -1, -1, INODE_FILE};
+    node.used = true;
+    node.nextFree = -1;
+
+    buckets[bucket] = id;
+    count++;
+    return {id, true};
+}
+
+bool Directory::rename(int id, std::string_view newName) {
+    size_t hash = std::hash<std::string_view>{}(newName);
+    if (buckets[probe(newName, hash)] != -1)
+        return false;
+
+    unlink(id);
+
+    Node& node = nodes[id];
+    node.name.assign(newName);
+    node.hash = hash;
+    buckets[probe(newName, hash)] = id;
+    return true;
+}
+
+void Directory::erase(int id) {
+    unlink(id);
+
+    Node& node = nodes[id];
+    node.name.clear();
+    node.used = false;
+    node.nextFree = freeNode;
+    freeNode = id;
+    count--;
+}
+
+void Directory::clear() {
+    nodes.clear();
+    freeNode = -1;
+    buckets.assign(DIRECTORY_MIN_BUCKETS, -1);
+    count = 0;
+}
+
+size_t Directory::size() const {
+    return count;
+}
+
+DirEntry& Directory::get(int id) {
+    return nodes[id].entry;
+}
+
+const std::string& Directory::getName(int id) const {
+    return nodes[id].name;
+}
+
+int Directory::first() const {
+    return next(-1);
+}
+
+int Directory::next(int id) const {
+    for (size_t i = id + 1; i < nodes.size(); i++)
+        if (nodes[i].used)
+            return static_cast<int>(i);
+
+    return -1;
+}
+
+size_t Directory::probe(std::string_view name, size_t hash) const {
+    size_t mask = buckets.size() - 1;
+    size_t bucket = hash & mask;
+
+    while (buckets[bucket] != -1)
+    {
+        const Node& node = nodes[buckets[bucket]];
+        if (node.hash == hash && node.name == name)
+            break;
+
+        bucket = (bucket + 1) & mask;
+    }
+
+    return bucket;
+}
+
+void Directory::unlink(int id) {
+    size_t mask = buckets.size() - 1;
+    size_t hole = probe(nodes[id].name, nodes[id].hash);
+    buckets[hole] = -1;
+
+    // Move back every id whose probe sequence passes through the hole, until an empty bucket
+    for (size_t bucket = (hole + 1) & mask; buckets[bucket] != -1; bucket = (bucket + 1) & mask)
+    {
+        size_t home = nodes[buckets[bucket]].hash & mask;
+        bool passesHole = (hole <= bucket) ? (home <= hole || home > bucket) : (home <= hole && home > bucket);
+        if (!passesHole)
+            continue;
+
+        buckets[hole] = buckets[bucket];
+        buckets[bucket] = -1;
+        hole = bucket;
+    }
+}
+
+void Directory::grow() {
+    buckets.assign(buckets.size() * 2, -1);
+    size_t mask = buckets.size() - 1;
+
+    for (int id = first(); id != -1; id = next(id))
+    {
+        size_t bucket = nodes[id].hash & mask;
+        while (buckets[bucket] != -1)
+            bucket = (bucket + 1) & mask;
+
+        buckets[bucket] = id;
+    }
+}
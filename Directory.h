@@ -0,0 +1,165 @@
+#ifndef DISK_SIMULATOR_DIRECTORY_H
+#define DISK_SIMULATOR_DIRECTORY_H
+
+#include <deque>
+#include <list>
+#include <string>
+#include <string_view>
+#include <utility>
+#include <vector>
+#include <sys/types.h>
+#include "fsInode.h"
+
+#define DIRECTORY_MIN_BUCKETS 16 // Buckets of an empty directory, a power of two
+#define DIRECTORY_MAX_LOAD 0.75 // Share of the buckets in use before the table doubles
+
+/**
+ * Directory entry of a file. The inode is read from the inode table on the image the first time
+ * the file is used, and may be dropped again once it's saved, unused and least recently used.
+ */
+struct DirEntry {
+    fsInode* inode;                 // The file's inode, nullptr while it's only on the image
+    off_t recordOffset;             // Offset of the saved inode record in the inode table, -1 if never saved
+    int recordSize;                 // Size of the saved inode record in bytes
+    bool dirty;                     // The inode may differ from its saved record
+    std::list<int>::iterator lru;   // Position in the resident inode list while the inode is in memory
+    int fd;                         // The file descriptor the file is open with, -1 if it's closed
+    int parent;                     // Entry id of the directory holding the entry, -1 for the root
+    InodeType type;                 // Whether the entry is a file or a directory, known without its inode
+};
+
+/**
+ * Directory class maps file names to their entries with an open-addressing hash table.
+ *
+ * Entries are kept in a pool and referred to by id, which, like the entry's address, stays the same
+ * until the entry is erased, also across a rename. The table holds entry ids and is probed linearly
+ * from the name's hash; erasing shifts the following ids back, so there are no tombstones.
+ * Names are looked up as string_views, so a lookup never allocates.
+ */
+class Directory {
+
+    /**
+     * Pooled entry: the name, its hash and the entry, or a link to the next free node.
+     */
+    struct Node {
+        std::string name;
+        size_t hash;
+        DirEntry entry;
+        bool used;
+        int nextFree;
+    };
+
+    std::deque<Node> nodes;     // Entry pool, indexed by entry id; a deque never moves its nodes
+    int freeNode;               // First node of the free list, -1 if none
+    std::vector<int> buckets;   // Entry id in each bucket, -1 if empty; the size is a power of two
+    size_t count;               // Number of entries
+
+public:
+
+    /**
+     * Constructor to initialize an empty directory.
+     */
+    Directory();
+
+    /**
+     * Find a file.
+     *
+     * @param name: The name of the file.
+     * @return The id of the file's entry, or -1 if there's no such file.
+     */
+    int find(std::string_view name) const;
+
+    /**
+     * Find a file, adding a new entry for it if there's none, with a single probe of the table.
+     * A new entry starts with no inode, no saved record and no descriptor.
+     *
+     * @param name: The name of the file.
+     * @return The id of the file's entry, and whether it was added.
+     */
+    std::pair<int, bool> insert(std::string_view name);
+
+    /**
+     * Rename a file. The entry keeps its id and address, only its place in the table changes.
+     *
+     * @param id: The id of the file's entry.
+     * @param newName: The new name of the file.
+     * @return True if successful, false if a file with the new name exists.
+     */
+    bool rename(int id, std::string_view newName);
+
+    /**
+     * Remove a file's entry. Its id may be given to a later entry.
+     *
+     * @param id: The id of the file's entry.
+     */
+    void erase(int id);
+
+    /**
+     * Remove every entry.
+     */
+    void clear();
+
+    /**
+     * Get the number of files.
+     *
+     * @return The number of entries.
+     */
+    size_t size() const;
+
+    /**
+     * Get an entry.
+     *
+     * @param id: The id of the entry.
+     * @return Reference to the entry.
+     */
+    DirEntry& get(int id);
+
+    /**
+     * Get the name of an entry's file.
+     *
+     * @param id: The id of the entry.
+     * @return The name of the file.
+     */
+    const std::string& getName(int id) const;
+
+    /**
+     * Get the first entry, in id order. With next, iterates over every entry:
+     * `for (int id = dir.first(); id != -1; id = dir.next(id))`.
+     *
+     * @return The id of the first entry, or -1 if the directory is empty.
+     */
+    int first() const;
+
+    /**
+     * Get the entry after a given one, in id order.
+     *
+     * @param id: The id of an entry.
+     * @return The id of the next entry, or -1 if it's the last.
+     */
+    int next(int id) const;
+
+private:
+
+    /**
+     * Find the bucket holding a name, or the empty bucket ending its probe sequence.
+     *
+     * @param name: The name to look for.
+     * @param hash: The hash of the name.
+     * @return The index of the bucket.
+     */
+    size_t probe(std::string_view name, size_t hash) const;
+
+    /**
+     * Take an entry id out of the table, shifting the ids probed after it back into place.
+     *
+     * @param id: The id of the entry, in the table.
+     */
+    void unlink(int id);
+
+    /**
+     * Double the table and put every id back into it.
+     */
+    void grow();
+};
+
+#endif //DISK_SIMULATOR_DIRECTORY_H
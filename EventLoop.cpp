@@ -0,0 +1,56 @@
+#include "EventLoop.h"
+
+EventLoop::EventLoop(fsDisk* _disk) {
+    disk = _disk;
+    waiting = 0;
+}
+
+void EventLoop::spawn(Task task) {
+    ready.push_back(task.detach());
+}
+
+void EventLoop::schedule(std::coroutine_handle<> handle) {
+    ready.push_back(handle);
+}
+
+int EventLoop::submit(const IoRequest& request, std::coroutine_handle<> handle, int* result) {
+    long long ticket = disk->SubmitAsync(request, [this, handle, result](const IoRequest& done) {
+        *result = done.result;
+        waiting--;
+        schedule(handle);
+    });
+
+    if (ticket == -1)
+        return -1;
+
+    waiting++;
+    return 1;
+}
+
+void EventLoop::run() {
+    while (!ready.empty() || waiting > 0)
+    {
+        // Coroutines made ready meanwhile get their turn in the next round
+        size_t turns = ready.size();
+        for (size_t i = 0; i < turns; i++)
+        {
+            std::coroutine_handle<> handle = ready.front();
+            ready.pop_front();
+            handle.resume();
+        }
+
+        if (waiting == 0)
+            continue;
+
+        // Block only when there's nothing else to run
+        if (!ready.empty())
+            disk->PollCompletions();
+
+        else if (disk->WaitCompletions(1) <= 0)
+            break; // Nothing completes any more, the waiting coroutines can't go on
+    }
+}
+
+fsDisk* EventLoop::getDisk() const {
+    return disk;
+}
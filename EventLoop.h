@@ -0,0 +1,66 @@
+#ifndef DISK_SIMULATOR_EVENTLOOP_H
+#define DISK_SIMULATOR_EVENTLOOP_H
+
+#include <coroutine>
+#include <deque>
+#include "Task.h"
+#include "fsDisk.h"
+
+/**
+ * EventLoop class is a single-threaded executor for coroutines using a disk.
+ * It resumes the coroutines that are ready one after the other, and when all of them wait for the disk
+ * it waits for the disk's asynchronous requests, whose callbacks make their coroutines ready again.
+ */
+class EventLoop {
+
+    fsDisk* disk;                                   // The disk the coroutines use
+    std::deque<std::coroutine_handle<>> ready;      // Coroutines to resume, in order
+    int waiting;                                    // Coroutines suspended on an asynchronous request
+
+public:
+
+    /**
+     * Constructor to create an empty loop.
+     *
+     * @param _disk: Pointer to the disk whose completions the loop waits for.
+     */
+    explicit EventLoop(fsDisk* _disk);
+
+    /**
+     * Add a task to the loop. It starts on the next run and frees itself when it ends.
+     *
+     * @param task: The task to run.
+     */
+    void spawn(Task task);
+
+    /**
+     * Resume a suspended coroutine on the loop's next turn.
+     *
+     * @param handle: The coroutine.
+     */
+    void schedule(std::coroutine_handle<> handle);
+
+    /**
+     * Submit an asynchronous request for a coroutine, which the loop resumes once the request completed.
+     *
+     * @param request: The request.
+     * @param handle: The suspended coroutine.
+     * @param result: Where the request's result is stored before the coroutine is resumed.
+     * @return 1 if the request was submitted, -1 if there's an error (the coroutine isn't resumed then).
+     */
+    int submit(const IoRequest& request, std::coroutine_handle<> handle, int* result);
+
+    /**
+     * Run until no coroutine is ready or waiting for the disk.
+     */
+    void run();
+
+    /**
+     * Get the disk of the loop.
+     *
+     * @return Pointer to the disk.
+     */
+    fsDisk* getDisk() const;
+};
+
+#endif //DISK_SIMULATOR_EVENTLOOP_H
@@ -0,0 +1,92 @@
+#include <cerrno>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/stat.h>
+#include "FileBlockDevice.h"
+
+FileBlockDevice::FileBlockDevice(const char* path, off_t _size, bool keepContent) {
+    size = -1;
+    fd = open(path, O_RDWR | O_CREAT | (keepContent ? 0 : O_TRUNC), 0644);
+
+    struct stat st;
+    if (fd == -1 || fstat(fd, &st) != 0)
+        return;
+
+    if (st.st_size >= _size)
+        size = st.st_size;
+
+    else if (ftruncate(fd, _size) == 0)
+        size = _size;
+}
+
+FileBlockDevice::~FileBlockDevice() {
+    if (fd == -1)
+        return;
+
+    fdatasync(fd);
+    close(fd);
+}
+
+int FileBlockDevice::read(char* buf, size_t len, off_t offset) {
+    while (len > 0)
+    {
+        ssize_t ret = pread(fd, buf, len, offset);
+        if (ret == -1 && errno == EINTR)
+            continue;
+
+        if (ret <= 0) // Error or unexpected end of the image
+            return -1;
+
+        buf += ret;
+        len -= ret;
+        offset += ret;
+    }
+
+    return 1;
+}
+
+int FileBlockDevice::write(const char* buf, size_t len, off_t offset) {
+    while (len > 0)
+    {
+        ssize_t ret = pwrite(fd, buf, len, offset);
+        if (ret == -1 && errno == EINTR)
+            continue;
+
+        if (ret <= 0)
+            return -1;
+
+        buf += ret;
+        len -= ret;
+        offset += ret;
+    }
+
+    return 1;
+}
+
+int FileBlockDevice::zero() {
+    // Cutting the file and growing it back leaves a sparse file with no data blocks
+    if (ftruncate(fd, 0) != 0 || ftruncate(fd, size) != 0)
+        return -1;
+
+    return 1;
+}
+
+int FileBlockDevice::flush() {
+    return (fdatasync(fd) == 0) ? 1 : -1;
+}
+
+int FileBlockDevice::resize(off_t _size) {
+    if (ftruncate(fd, _size) != 0)
+        return -1;
+
+    size = _size;
+    return 1;
+}
+
+off_t FileBlockDevice::getSize() const {
+    return size;
+}
+
+int FileBlockDevice::getHandle() const {
+    return fd;
+}
@@ -0,0 +1,47 @@
+#ifndef DISK_SIMULATOR_FILEBLOCKDEVICE_H
+#define DISK_SIMULATOR_FILEBLOCKDEVICE_H
+
+#include "BlockDevice.h"
+
+/**
+ * FileBlockDevice class keeps the disk image in a regular file.
+ * All accesses are positional (pread/pwrite), so the shared file offset is never touched.
+ */
+class FileBlockDevice : public BlockDevice {
+
+    int fd;         // Raw descriptor of the image file
+    off_t size;     // Size of the image in bytes
+
+public:
+
+    /**
+     * Constructor to open the image file and size it.
+     * A kept image smaller than '_size' is grown to it, a larger one keeps its size.
+     *
+     * @param path: The path of the image file.
+     * @param _size: The size of the image in bytes.
+     * @param keepContent: Whether an existing image is kept instead of truncated (default: false).
+     */
+    FileBlockDevice(const char* path, off_t _size, bool keepContent = false);
+
+    /**
+     * Destructor to flush and close the image file.
+     */
+    ~FileBlockDevice() override;
+
+    int read(char* buf, size_t len, off_t offset) override;
+
+    int write(const char* buf, size_t len, off_t offset) override;
+
+    int zero() override;
+
+    int flush() override;
+
+    int resize(off_t _size) override;
+
+    off_t getSize() const override;
+
+    int getHandle() const override;
+};
+
+#endif //DISK_SIMULATOR_FILEBLOCKDEVICE_H
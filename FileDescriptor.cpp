@@ -4,9 +4,10 @@ FileDescriptor::FileDescriptor(std::string FileName, fsInode* fsi) {
     file.first = FileName;
     file.second = fsi;
     b_inUse = true;
+    offset = 0;
 }
 
-std::string FileDescriptor::getFileName() const {
+const std::string& FileDescriptor::getFileName() const {
     return file.first;
 }
 
@@ -14,7 +15,7 @@ fsInode* FileDescriptor::getInode() const {
     return file.second;
 }
 
-int FileDescriptor::GetFileSize() const {
+off_t FileDescriptor::GetFileSize() const {
     if (file.second == nullptr)
         return -1;
 
@@ -29,6 +30,19 @@ void FileDescriptor::setInUse(bool _inUse) {
     b_inUse = _inUse ;
 }
 
+void FileDescriptor::release() {
+    b_inUse = false;
+    file.second = nullptr;
+}
+
+off_t FileDescriptor::getOffset() const {
+    return offset;
+}
+
+void FileDescriptor::setOffset(off_t _offset) {
+    offset = _offset;
+}
+
 void FileDescriptor::setName(std::string name) {
     file.first = name;
 }
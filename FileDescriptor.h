@@ -2,6 +2,8 @@
 #define DISK_SIMULATOR_FILEDESCRIPTOR_H
 
 #include <string>
+#include <utility>
+#include <sys/types.h>
 #include "fsInode.h"
 
 /**
@@ -10,8 +12,9 @@
  */
 class FileDescriptor {
 
-    pair<string, fsInode*> file; // Pair containing file name and associated inode
+    std::pair<std::string, fsInode*> file; // Pair containing file name and associated inode
     bool b_inUse; // Indicates whether the file descriptor is currently in use
+    off_t offset; // Current position of the descriptor in the file, in bytes
 
 public:
 
@@ -28,7 +31,7 @@ public:
      *
      * @return The name of the file.
      */
-    std::string getFileName() const;
+    const std::string& getFileName() const;
 
     /**
      * Get the associated fsInode pointer for this file descriptor.
@@ -43,7 +46,7 @@ public:
      *
      * @return The size of the file in bytes, or -1 if the associated inode is nullptr.
      */
-    int GetFileSize() const;
+    off_t GetFileSize() const;
 
     /**
      * Check if the file descriptor is currently in use.
@@ -59,6 +62,25 @@ public:
      */
     void setInUse(bool _inUse);
 
+    /**
+     * Close the file descriptor. It no longer references the inode, which may be dropped from memory.
+     */
+    void release();
+
+    /**
+     * Get the current position of the descriptor in the file.
+     *
+     * @return The offset in bytes from the start of the file.
+     */
+    off_t getOffset() const;
+
+    /**
+     * Set the current position of the descriptor in the file.
+     *
+     * @param _offset: The new offset in bytes from the start of the file.
+     */
+    void setOffset(off_t _offset);
+
     /**
      * Set the name of the file associated with this file descriptor.
      *
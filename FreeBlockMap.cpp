@@ -0,0 +1,240 @@
+#include <algorithm>
+#include "FreeBlockMap.h"
+
+#define WORDS_IN_GROUP (ALLOCATION_GROUP_BLOCKS / BITS_IN_WORD)
+
+FreeBlockMap::FreeBlockMap() {
+    words = nullptr;
+    wordsCount = 0;
+    blocksCount = 0;
+    groups = nullptr;
+    groupsCount = 0;
+}
+
+FreeBlockMap::~FreeBlockMap() {
+    delete[] words;
+    delete[] groups;
+}
+
+void FreeBlockMap::reset(int _blocksCount) {
+    resize(_blocksCount);
+
+    for (int i = 0; i < wordsCount; i++)
+        words[i].store(0, std::memory_order_relaxed);
+
+    // Bits past the last block are marked as used so they are never handed out
+    int tail = blocksCount % BITS_IN_WORD;
+    if (tail != 0)
+        words[wordsCount - 1].store(~0ULL << tail, std::memory_order_relaxed);
+
+    recount();
+}
+
+void FreeBlockMap::load(const uint64_t* src, int _blocksCount) {
+    resize(_blocksCount);
+
+    for (int i = 0; i < wordsCount; i++)
+        words[i].store(src[i], std::memory_order_relaxed);
+
+    recount();
+}
+
+void FreeBlockMap::getWords(std::vector<uint64_t>& dest) const {
+    dest.resize(wordsCount);
+
+    for (int i = 0; i < wordsCount; i++)
+        dest[i] = words[i].load(std::memory_order_relaxed);
+}
+
+int FreeBlockMap::findFree(int group) {
+    for (int i = 0; i < groupsCount; i++)
+    {
+        int current = (group + i) % groupsCount;
+        if (groups[current].freeCount.load(std::memory_order_relaxed) == 0)
+            continue;
+
+        int block = scanGroup(current, false);
+        if (block != -1)
+            return block;
+    }
+
+    return -1;
+}
+
+int FreeBlockMap::allocate(int group) {
+    // The own group first, then steal from the following ones
+    for (int i = 0; i < groupsCount; i++)
+    {
+        int current = (group + i) % groupsCount;
+        if (groups[current].freeCount.load(std::memory_order_relaxed) == 0)
+            continue;
+
+        int block = scanGroup(current, true);
+        if (block != -1)
+            return block;
+    }
+
+    return -1;
+}
+
+int FreeBlockMap::allocateRun(int goal, int maxCount, int group, int* count) {
+    // Right after the file's last block first, so the file stays in one piece
+    if (goal >= 0 && goal < blocksCount)
+    {
+        *count = claimRun(goal, maxCount);
+        if (*count > 0)
+            return goal;
+    }
+
+    int block = allocate(group);
+    if (block == -1)
+    {
+        *count = 0;
+        return -1;
+    }
+
+    *count = 1 + claimRun(block + 1, maxCount - 1);
+    return block;
+}
+
+void FreeBlockMap::set(int block) {
+    uint64_t mask = 1ULL << (block % BITS_IN_WORD);
+    uint64_t old = words[block / BITS_IN_WORD].fetch_or(mask, std::memory_order_acq_rel);
+
+    if ((old & mask) == 0)
+        groups[getGroup(block)].freeCount.fetch_sub(1, std::memory_order_relaxed);
+}
+
+void FreeBlockMap::clear(int block) {
+    uint64_t mask = 1ULL << (block % BITS_IN_WORD);
+    uint64_t old = words[block / BITS_IN_WORD].fetch_and(~mask, std::memory_order_acq_rel);
+
+    if ((old & mask) == 0)
+        return;
+
+    AllocationGroup& group = groups[getGroup(block)];
+    group.freeCount.fetch_add(1, std::memory_order_relaxed);
+
+    // Lower the hint, so the group keeps handing out its lowest free blocks first
+    int word = block / BITS_IN_WORD;
+    int hint = group.hint.load(std::memory_order_relaxed);
+    while (word < hint && !group.hint.compare_exchange_weak(hint, word, std::memory_order_relaxed));
+}
+
+bool FreeBlockMap::isUsed(int block) const {
+    return (words[block / BITS_IN_WORD].load(std::memory_order_relaxed) >> (block % BITS_IN_WORD)) & 1ULL;
+}
+
+int FreeBlockMap::getUsedCount() const {
+    int freeBlocks = 0;
+    for (int i = 0; i < groupsCount; i++)
+        freeBlocks += groups[i].freeCount.load(std::memory_order_relaxed);
+
+    return blocksCount - freeBlocks;
+}
+
+int FreeBlockMap::getBlocksCount() const {
+    return blocksCount;
+}
+
+int FreeBlockMap::getGroup(int block) const {
+    return block / ALLOCATION_GROUP_BLOCKS;
+}
+
+int FreeBlockMap::getThreadGroup() const {
+    static std::atomic<int> nextGroup(0);
+    thread_local int threadGroup = nextGroup.fetch_add(1, std::memory_order_relaxed);
+
+    return (groupsCount == 0) ? 0 : threadGroup % groupsCount;
+}
+
+int FreeBlockMap::scanGroup(int group, bool claim) {
+    int first = group * WORDS_IN_GROUP;
+    int amount = std::min(WORDS_IN_GROUP, wordsCount - first);
+    int start = groups[group].hint.load(std::memory_order_relaxed);
+
+    // The hint is only where to start, the scan wraps around to cover the whole group
+    for (int i = 0; i < amount; i++)
+    {
+        int index = first + (start - first + i) % amount;
+        uint64_t word = words[index].load(std::memory_order_relaxed);
+
+        while (word != ~0ULL)
+        {
+            uint64_t mask = 1ULL << __builtin_ctzll(~word);
+
+            if (!claim)
+                return index * BITS_IN_WORD + __builtin_ctzll(~word);
+
+            // Another thread may take the bit first, then the word is reloaded and the next free bit tried
+            if (words[index].compare_exchange_weak(word, word | mask, std::memory_order_acq_rel))
+            {
+                groups[group].freeCount.fetch_sub(1, std::memory_order_relaxed);
+                groups[group].hint.store(index, std::memory_order_relaxed);
+                return index * BITS_IN_WORD + __builtin_ctzll(mask);
+            }
+        }
+    }
+
+    return -1;
+}
+
+int FreeBlockMap::claimRun(int block, int maxCount) {
+    int claimed = 0;
+
+    while (claimed < maxCount && block + claimed < blocksCount)
+    {
+        int index = (block + claimed) / BITS_IN_WORD;
+        int bit = (block + claimed) % BITS_IN_WORD;
+        uint64_t word = words[index].load(std::memory_order_relaxed);
+        uint64_t mask;
+        int amount;
+
+        // Claim the free bits from 'bit' up to the first used one with a single compare-and-swap
+        do
+        {
+            uint64_t freeBits = ~word >> bit;
+            amount = (~freeBits == 0) ? BITS_IN_WORD : __builtin_ctzll(~freeBits);
+            amount = std::min(amount, maxCount - claimed);
+            if (amount == 0)
+                return claimed;
+
+            mask = ((amount == BITS_IN_WORD) ? ~0ULL : (1ULL << amount) - 1) << bit;
+        } while (!words[index].compare_exchange_weak(word, word | mask, std::memory_order_acq_rel));
+
+        groups[getGroup(block + claimed)].freeCount.fetch_sub(amount, std::memory_order_relaxed);
+        claimed += amount;
+
+        if (bit + amount < BITS_IN_WORD) // Stopped before the end of the word
+            break;
+    }
+
+    return claimed;
+}
+
+void FreeBlockMap::resize(int _blocksCount) {
+    blocksCount = _blocksCount;
+
+    delete[] words;
+    wordsCount = (blocksCount + BITS_IN_WORD - 1) / BITS_IN_WORD;
+    words = new std::atomic<uint64_t>[wordsCount];
+
+    delete[] groups;
+    groupsCount = (wordsCount + WORDS_IN_GROUP - 1) / WORDS_IN_GROUP;
+    groups = new AllocationGroup[groupsCount];
+}
+
+void FreeBlockMap::recount() {
+    for (int group = 0; group < groupsCount; group++)
+    {
+        int first = group * WORDS_IN_GROUP;
+        int amount = std::min(WORDS_IN_GROUP, wordsCount - first);
+
+        int bits = 0;
+        for (int i = first; i < first + amount; i++)
+            bits += __builtin_popcountll(words[i].load(std::memory_order_relaxed));
+
+        groups[group].freeCount.store(amount * BITS_IN_WORD - bits, std::memory_order_relaxed);
+        groups[group].hint.store(first, std::memory_order_relaxed);
+    }
+}
@@ -0,0 +1,184 @@
+#ifndef DISK_SIMULATOR_FREEBLOCKMAP_H
+#define DISK_SIMULATOR_FREEBLOCKMAP_H
+
+#include <atomic>
+#include <cstdint>
+#include <vector>
+
+#define BITS_IN_WORD 64
+#define ALLOCATION_GROUP_BLOCKS 4096 // Blocks per allocation group, a multiple of BITS_IN_WORD
+
+/**
+ * FreeBlockMap class tracks which blocks of the disk are in use.
+ * It keeps one bit per block packed into 64-bit words, and finds free blocks
+ * with a count-trailing-zeros scan that starts at a "next free" hint.
+ *
+ * The disk is split into allocation groups of ALLOCATION_GROUP_BLOCKS blocks, each with
+ * its own free count and hint. Bits are claimed with a compare-and-swap, so threads
+ * allocate without a lock, and threads starting in different groups don't meet at all.
+ */
+class FreeBlockMap {
+
+    /**
+     * Bookkeeping of one allocation group, on a cache line of its own.
+     */
+    struct alignas(64) AllocationGroup {
+        std::atomic<int> freeCount;     // Number of free blocks in the group
+        std::atomic<int> hint;          // Index of the word the next scan of the group starts at
+    };
+
+    std::atomic<uint64_t>* words;   // Packed occupancy bits, 1 = block in use
+    int wordsCount;                 // Number of words
+    int blocksCount;                // Number of blocks tracked by the map
+    AllocationGroup* groups;        // The allocation groups, in disk order
+    int groupsCount;                // Number of allocation groups
+
+public:
+
+    /**
+     * Constructor to initialize an empty map tracking no blocks.
+     */
+    FreeBlockMap();
+
+    /**
+     * Destructor to release the words and the groups.
+     */
+    ~FreeBlockMap();
+
+    /**
+     * Resize the map and mark every block as free.
+     *
+     * @param _blocksCount: The number of blocks to track.
+     */
+    void reset(int _blocksCount);
+
+    /**
+     * Replace the map with previously saved words, and recount the blocks in use.
+     *
+     * @param src: Pointer to the saved words, as returned by getWords.
+     * @param _blocksCount: The number of blocks the saved map tracks.
+     */
+    void load(const uint64_t* src, int _blocksCount);
+
+    /**
+     * Copy the packed words of the map, for saving it.
+     *
+     * @param dest: Vector to fill with the words, one bit per block, 1 = block in use.
+     */
+    void getWords(std::vector<uint64_t>& dest) const;
+
+    /**
+     * Get the index of a free block without claiming it, looking in a given group first.
+     *
+     * @param group: The group to look in first.
+     * @return The index of the free block, or -1 if no free blocks are available.
+     */
+    int findFree(int group);
+
+    /**
+     * Claim a free block, from a given group if it has one, otherwise from the next group that does.
+     *
+     * @param group: The group to claim from first.
+     * @return The index of the claimed block, or -1 if no free blocks are available.
+     */
+    int allocate(int group);
+
+    /**
+     * Claim a run of adjacent free blocks. The run starts at the goal block if that one is free,
+     * otherwise at a free block found like allocate does, and is as long as the blocks after it allow.
+     *
+     * @param goal: The block the run should start at, -1 for none.
+     * @param maxCount: The maximum length of the run.
+     * @param group: The group to claim from first when the goal block isn't free.
+     * @param count: Pointer to store the length of the claimed run.
+     * @return The index of the first block of the run, or -1 if no free blocks are available.
+     */
+    int allocateRun(int goal, int maxCount, int group, int* count);
+
+    /**
+     * Mark a block as in use.
+     *
+     * @param block: The index of the block.
+     */
+    void set(int block);
+
+    /**
+     * Mark a block as free.
+     *
+     * @param block: The index of the block.
+     */
+    void clear(int block);
+
+    /**
+     * Check if a block is in use.
+     *
+     * @param block: The index of the block.
+     * @return True if the block is in use, false otherwise.
+     */
+    bool isUsed(int block) const;
+
+    /**
+     * Get the number of blocks currently in use. It sums the free counts of every group,
+     * so it's meant for occasional queries, not for each allocation.
+     *
+     * @return The number of blocks in use.
+     */
+    int getUsedCount() const;
+
+    /**
+     * Get the number of blocks tracked by the map.
+     *
+     * @return The number of blocks.
+     */
+    int getBlocksCount() const;
+
+    /**
+     * Get the allocation group a block belongs to.
+     *
+     * @param block: The index of the block.
+     * @return The index of the group.
+     */
+    int getGroup(int block) const;
+
+    /**
+     * Get the allocation group of the calling thread. Threads are spread over the groups
+     * round-robin the first time they ask, and keep their group after.
+     *
+     * @return The index of the group, or 0 if the map tracks no blocks.
+     */
+    int getThreadGroup() const;
+
+private:
+
+    /**
+     * Scan one group for a free block, from its hint around to the word before it.
+     *
+     * @param group: The index of the group.
+     * @param claim: Whether to claim the block found.
+     * @return The index of the block, or -1 if the group is full.
+     */
+    int scanGroup(int group, bool claim);
+
+    /**
+     * Claim the free blocks from a given block on, up to the first one in use.
+     *
+     * @param block: The index of the first block to claim.
+     * @param maxCount: The maximum number of blocks to claim.
+     * @return The number of blocks claimed, 0 if the first one is in use.
+     */
+    int claimRun(int block, int maxCount);
+
+    /**
+     * Allocate the words and the groups for a number of blocks. The words are left uninitialized.
+     *
+     * @param _blocksCount: The number of blocks to track.
+     */
+    void resize(int _blocksCount);
+
+    /**
+     * Recount the free blocks of each group from the words themselves (popcount per word).
+     */
+    void recount();
+};
+
+#endif //DISK_SIMULATOR_FREEBLOCKMAP_H
@@ -0,0 +1,59 @@
+#include <new>
+#include "InodeSlab.h"
+
+InodeSlab::InodeSlab() {
+    blockSize = 0;
+    format = INODE_INDIRECT;
+    inUse = 0;
+}
+
+InodeSlab::~InodeSlab() {
+    for (char* chunk : chunks)
+        ::operator delete(chunk, std::align_val_t(alignof(fsInode)));
+}
+
+void InodeSlab::reset(int _blockSize, InodeFormat _format) {
+    for (char* chunk : chunks)
+        ::operator delete(chunk, std::align_val_t(alignof(fsInode)));
+
+    chunks.clear();
+    freeSlots.clear();
+    inUse = 0;
+    blockSize = _blockSize;
+    format = _format;
+}
+
+fsInode* InodeSlab::allocate(InodeType type) {
+    if (freeSlots.empty())
+    {
+        // The slots of a new chunk are pushed in reverse, so they're handed out in address order
+        size_t chunkSize = sizeof(fsInode) * INODE_SLAB_CHUNK;
+        char* chunk = static_cast<char*>(::operator new(chunkSize, std::align_val_t(alignof(fsInode))));
+        chunks.push_back(chunk);
+        for (int i = INODE_SLAB_CHUNK - 1; i >= 0; i--)
+            freeSlots.push_back(chunk + i * sizeof(fsInode));
+    }
+
+    char* slot = freeSlots.back();
+    freeSlots.pop_back();
+    inUse++;
+
+    return new (slot) fsInode(blockSize, format, type);
+}
+
+void InodeSlab::release(fsInode* inode) {
+    if (inode == nullptr)
+        return;
+
+    inode->~fsInode();
+    freeSlots.push_back(reinterpret_cast<char*>(inode));
+    inUse--;
+}
+
+size_t InodeSlab::getFootprint() const {
+    return chunks.size() * INODE_SLAB_CHUNK * sizeof(fsInode);
+}
+
+size_t InodeSlab::getInUse() const {
+    return inUse;
+}
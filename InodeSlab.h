@@ -0,0 +1,80 @@
+#ifndef DISK_SIMULATOR_INODESLAB_H
+#define DISK_SIMULATOR_INODESLAB_H
+
+#include <cstddef>
+#include <vector>
+#include "fsInode.h"
+
+#define INODE_SLAB_CHUNK 64 // Slots added at once when every slot is in use
+
+/**
+ * InodeSlab class hands out the fsInodes of a disk from pooled storage.
+ *
+ * Each slot holds one inode, and slots are allocated a chunk at a time, so creating an inode never touches
+ * the heap once the slab has grown to the disk's working set. Released slots go to a free list and are
+ * reused first, so creating and deleting files keeps the memory flat. Chunks are aligned like fsInode,
+ * so every inode starts on a cache line.
+ */
+class InodeSlab {
+
+    int blockSize;                  // Block size of the inodes
+    InodeFormat format;             // Format of the inodes
+
+    std::vector<char*> chunks;      // Storage of INODE_SLAB_CHUNK slots each
+    std::vector<char*> freeSlots;   // Slots not holding an inode, the last one is reused first
+    size_t inUse;                   // Number of slots holding an inode
+
+public:
+
+    /**
+     * Constructor to initialize an empty slab. It must be reset before allocating.
+     */
+    InodeSlab();
+
+    /**
+     * Destructor to free the storage. Inodes still in use are not destroyed.
+     */
+    ~InodeSlab();
+
+    InodeSlab(const InodeSlab&) = delete;
+    InodeSlab& operator=(const InodeSlab&) = delete;
+
+    /**
+     * Free the storage and change the geometry of the inodes. Every inode must be released first.
+     *
+     * @param _blockSize: The block size of the disk.
+     * @param _format: How the inodes map the blocks of their file.
+     */
+    void reset(int _blockSize, InodeFormat _format);
+
+    /**
+     * Construct an empty inode in a free slot, growing the slab by a chunk if there's none.
+     *
+     * @param type: What the inode's file holds (default: INODE_FILE).
+     * @return Pointer to the inode, valid until it's released.
+     */
+    fsInode* allocate(InodeType type = INODE_FILE);
+
+    /**
+     * Destroy an inode and return its slot to the free list.
+     *
+     * @param inode: Pointer to an inode allocated by this slab, may be nullptr.
+     */
+    void release(fsInode* inode);
+
+    /**
+     * Get the memory the slab holds, in use or free.
+     *
+     * @return The size of the storage in bytes.
+     */
+    size_t getFootprint() const;
+
+    /**
+     * Get the number of inodes in use.
+     *
+     * @return The number of allocated slots.
+     */
+    size_t getInUse() const;
+};
+
+#endif //DISK_SIMULATOR_INODESLAB_H
@@ -0,0 +1,347 @@
+#include <algorithm>
+#include <cstring>
+#include "Journal.h"
+
+/**
+ * Header written in front of the records of every committed transaction.
+ */
+struct JournalHeader {
+    uint32_t magic;         // JOURNAL_MAGIC
+    uint32_t length;        // Size of the records in bytes
+    uint64_t sequence;      // Sequence number of the transaction
+    uint32_t checksum;      // Checksum of the sequence number and the records
+};
+
+Journal::Journal(BlockDevice* _device, BlockCache* _cache) {
+    device = _device;
+    cache = _cache;
+    regionOffset = 0;
+    regionSize = 0;
+    head = 0;
+    sequence = 0;
+    batchCount = 0;
+}
+
+void Journal::reset(off_t _regionOffset, off_t _regionSize, uint64_t _sequence) {
+    std::lock_guard<std::mutex> guard(lock);
+    regionOffset = _regionOffset;
+    regionSize = _regionSize;
+    head = 0;
+    sequence = _sequence;
+    batch.clear();
+    batchCount = 0;
+    batchFrees.clear();
+}
+
+void Journal::begin() {
+    current().depth++;
+}
+
+bool Journal::end() {
+    OpenTransaction& transaction = current();
+    if (--transaction.depth > 0)
+        return false;
+
+    if (transaction.sizeChange != 0)
+    {
+        append<uint8_t>(transaction.records, JOURNAL_DISK_SIZE);
+        append<int64_t>(transaction.records, transaction.sizeChange);
+    }
+
+    std::lock_guard<std::mutex> guard(lock);
+    if (!transaction.records.empty())
+    {
+        JournalHeader header;
+        memset(&header, 0, sizeof(header));
+        header.magic = JOURNAL_MAGIC;
+        header.length = transaction.records.size();
+        header.sequence = sequence;
+
+        std::string hashed(reinterpret_cast<const char*>(&header.sequence), sizeof(header.sequence));
+        hashed += transaction.records;
+        header.checksum = checksum(hashed.data(), hashed.size());
+
+        batch.append(reinterpret_cast<const char*>(&header), sizeof(header));
+        batch += transaction.records;
+        batchFrees.insert(batchFrees.end(), transaction.frees.begin(), transaction.frees.end());
+
+        batchCount++;
+        sequence++;
+    }
+
+    transactions.erase(std::this_thread::get_id());
+    return true;
+}
+
+bool Journal::isActive() const {
+    return find() != nullptr;
+}
+
+int Journal::getDepth() const {
+    const OpenTransaction* transaction = find();
+    return (transaction == nullptr) ? 0 : transaction->depth;
+}
+
+bool Journal::hasRecords() const {
+    const OpenTransaction* transaction = find();
+    return transaction != nullptr && !transaction->records.empty();
+}
+
+void Journal::logPointer(off_t location, int block) {
+    std::string& records = current().records;
+    append<uint8_t>(records, JOURNAL_POINTER);
+    append<int64_t>(records, location);
+    append<int32_t>(records, block);
+}
+
+void Journal::logAllocate(int block) {
+    std::string& records = current().records;
+    append<uint8_t>(records, JOURNAL_ALLOCATE);
+    append<int32_t>(records, block);
+}
+
+void Journal::logRelease(int block) {
+    OpenTransaction& transaction = current();
+    append<uint8_t>(transaction.records, JOURNAL_RELEASE);
+    append<int32_t>(transaction.records, block);
+    transaction.frees.push_back(block);
+}
+
+void Journal::logInode(const std::string& name, const fsInode* inode) {
+    std::string record(sizeof(DiskInode), '\0');
+    inode->serialize(&record[0]);
+
+    std::string& records = current().records;
+    append<uint8_t>(records, JOURNAL_INODE);
+    appendString(records, name);
+    appendString(records, record);
+}
+
+void Journal::logDelete(const std::string& name) {
+    std::string& records = current().records;
+    append<uint8_t>(records, JOURNAL_DELETE);
+    appendString(records, name);
+}
+
+void Journal::logRename(const std::string& oldName, const std::string& newName) {
+    std::string& records = current().records;
+    append<uint8_t>(records, JOURNAL_RENAME);
+    appendString(records, oldName);
+    appendString(records, newName);
+}
+
+void Journal::logDiskSizeChange(off_t change) {
+    current().sizeChange += change;
+}
+
+void Journal::touch(const std::string& name) {
+    std::vector<std::string>& files = current().files;
+
+    if (std::find(files.begin(), files.end(), name) == files.end())
+        files.push_back(name);
+}
+
+const std::vector<std::string>& Journal::getTouchedFiles() {
+    return current().files;
+}
+
+int Journal::getPendingFrees() const {
+    std::lock_guard<std::mutex> guard(lock);
+    return static_cast<int>(batchFrees.size());
+}
+
+void Journal::takeFrees(std::vector<int>& blocks) {
+    std::lock_guard<std::mutex> guard(lock);
+    blocks.insert(blocks.end(), batchFrees.begin(), batchFrees.end());
+    batchFrees.clear();
+}
+
+int Journal::getBatchCount() const {
+    std::lock_guard<std::mutex> guard(lock);
+    return batchCount;
+}
+
+size_t Journal::getBatchBytes() const {
+    std::lock_guard<std::mutex> guard(lock);
+    return batch.size();
+}
+
+bool Journal::fits() const {
+    std::lock_guard<std::mutex> guard(lock);
+    return head + static_cast<off_t>(batch.size()) <= regionSize;
+}
+
+int Journal::commit(std::vector<int>& released) {
+    // Held throughout, so no transaction joins the batch between the cache write-back and the commit
+    std::lock_guard<std::mutex> guard(lock);
+
+    if (head + static_cast<off_t>(batch.size()) > regionSize)
+        return -1;
+
+    if (cache->flush() == -1)
+        return -1;
+
+    if (!batch.empty() && device->write(batch.data(), batch.size(), regionOffset + head) == -1)
+        return -1;
+
+    if (device->flush() == -1)
+        return -1;
+
+    head += batch.size();
+    batch.clear();
+    batchCount = 0;
+    released.insert(released.end(), batchFrees.begin(), batchFrees.end());
+    batchFrees.clear();
+    return 1;
+}
+
+uint64_t Journal::getSequence() const {
+    std::lock_guard<std::mutex> guard(lock);
+    return sequence;
+}
+
+int Journal::replay(std::vector<JournalRecord>& records) {
+    int applied = 0;
+    off_t position = 0;
+
+    while (position + static_cast<off_t>(sizeof(JournalHeader)) <= regionSize)
+    {
+        JournalHeader header;
+        if (device->read(reinterpret_cast<char*>(&header), sizeof(header), regionOffset + position) == -1)
+            return -1;
+
+        // A stale transaction from before the last checkpoint, or never written
+        if (header.magic != JOURNAL_MAGIC || header.sequence != sequence ||
+            position + static_cast<off_t>(sizeof(header) + header.length) > regionSize)
+            break;
+
+        std::string hashed(reinterpret_cast<const char*>(&header.sequence), sizeof(header.sequence));
+        hashed.resize(sizeof(header.sequence) + header.length);
+        if (device->read(&hashed[sizeof(header.sequence)], header.length, regionOffset + position + sizeof(header)) == -1)
+            return -1;
+
+        // A torn transaction, the crash hit while it was written
+        if (checksum(hashed.data(), hashed.size()) != header.checksum)
+            break;
+
+        if (decode(hashed.substr(sizeof(header.sequence)), records) == -1)
+            break;
+
+        position += sizeof(header) + header.length;
+        sequence++;
+        applied++;
+    }
+
+    head = position;
+    return applied;
+}
+
+Journal::OpenTransaction& Journal::current() {
+    std::lock_guard<std::mutex> guard(lock);
+    return transactions[std::this_thread::get_id()];
+}
+
+const Journal::OpenTransaction* Journal::find() const {
+    std::lock_guard<std::mutex> guard(lock);
+    auto it = transactions.find(std::this_thread::get_id());
+    return (it == transactions.end()) ? nullptr : &it->second;
+}
+
+void Journal::appendString(std::string& records, const std::string& str) {
+    append<uint32_t>(records, str.size());
+    records += str;
+}
+
+uint32_t Journal::checksum(const char* data, size_t len) {
+    uint32_t hash = 2166136261u;
+
+    for (size_t i = 0; i < len; i++)
+    {
+        hash ^= static_cast<uint8_t>(data[i]);
+        hash *= 16777619u;
+    }
+
+    return hash;
+}
+
+int Journal::decode(const std::string& data, std::vector<JournalRecord>& records) {
+    size_t pos = 0;
+
+    // Readers of the fixed-size fields and the length-prefixed strings, false past the end
+    auto read = [&](void* dest, size_t len) {
+        if (pos + len > data.size())
+            return false;
+
+        memcpy(dest, data.data() + pos, len);
+        pos += len;
+        return true;
+    };
+
+    auto readString = [&](std::string& dest) {
+        uint32_t len;
+        if (!read(&len, sizeof(len)) || pos + len > data.size())
+            return false;
+
+        dest.assign(data, pos, len);
+        pos += len;
+        return true;
+    };
+
+    // Check the whole transaction before keeping any of it
+    std::vector<JournalRecord> decoded;
+    while (pos < data.size())
+    {
+        uint8_t type;
+        int64_t location = 0;
+        int32_t block = 0;
+        JournalRecord record = {};
+
+        if (!read(&type, sizeof(type)))
+            return -1;
+
+        record.type = static_cast<JournalRecordType>(type);
+        bool ok;
+        switch (record.type)
+        {
+            case JOURNAL_POINTER:
+                ok = read(&location, sizeof(location)) && read(&block, sizeof(block));
+                record.location = location;
+                record.block = block;
+                break;
+
+            case JOURNAL_ALLOCATE:
+            case JOURNAL_RELEASE:
+                ok = read(&block, sizeof(block));
+                record.block = block;
+                break;
+
+            case JOURNAL_INODE:
+                ok = readString(record.name) && readString(record.inodeRecord);
+                break;
+
+            case JOURNAL_DELETE:
+                ok = readString(record.name);
+                break;
+
+            case JOURNAL_RENAME:
+                ok = readString(record.name) && readString(record.newName);
+                break;
+
+            case JOURNAL_DISK_SIZE:
+                ok = read(&location, sizeof(location));
+                record.location = location;
+                break;
+
+            default:
+                ok = false;
+        }
+
+        if (!ok)
+            return -1;
+
+        decoded.push_back(record);
+    }
+
+    records.insert(records.end(), decoded.begin(), decoded.end());
+    return 1;
+}
@@ -0,0 +1,312 @@
+#ifndef DISK_SIMULATOR_JOURNAL_H
+#define DISK_SIMULATOR_JOURNAL_H
+
+#include <cstdint>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <unordered_map>
+#include <vector>
+#include "BlockCache.h"
+#include "BlockDevice.h"
+#include "fsInode.h"
+
+#define JOURNAL_SIZE (1 << 20)          // Bytes reserved for the journal between the superblock and the data area
+#define JOURNAL_GROUP_SIZE 32           // Transactions committed together by one flush
+#define JOURNAL_BATCH_BYTES (64 << 10)  // A batch this large is committed without waiting for the group to fill
+#define JOURNAL_MAGIC 0x4c4e524a        // "JRNL", starts every committed transaction
+
+/**
+ * Kinds of journal records. Each one is a redo step applied on top of the last saved metadata.
+ */
+enum JournalRecordType {
+    JOURNAL_POINTER = 1,    // A block pointer was written at a disk location
+    JOURNAL_ALLOCATE,       // A block was marked as in use
+    JOURNAL_RELEASE,        // A block was marked as free
+    JOURNAL_INODE,          // A file was created or its inode changed, holds the whole inode record
+    JOURNAL_DELETE,         // A file was removed from the directory
+    JOURNAL_RENAME,         // A file was renamed, or a directory along with every entry under it
+    JOURNAL_DISK_SIZE       // Change in the amount of file data stored on the disk made by the transaction
+};
+
+/**
+ * A decoded journal record, only the fields of its type are set.
+ */
+struct JournalRecord {
+    JournalRecordType type;
+    off_t location;             // JOURNAL_POINTER: disk location, JOURNAL_DISK_SIZE: the change in bytes
+    int block;                  // JOURNAL_POINTER, JOURNAL_ALLOCATE, JOURNAL_RELEASE: block index
+    std::string name;           // JOURNAL_INODE, JOURNAL_DELETE, JOURNAL_RENAME: file name
+    std::string newName;        // JOURNAL_RENAME: new file name
+    std::string inodeRecord;    // JOURNAL_INODE: the record written by fsInode::serialize
+};
+
+/**
+ * Journal class is a write-ahead log of metadata changes kept in a fixed region of the disk image.
+ *
+ * Each filesystem operation is one transaction. Closed transactions wait in memory and are
+ * written together as a batch, followed by a single device flush, so durability costs one sync
+ * per batch instead of one per changed block. Every transaction carries a sequence number and
+ * a checksum, replay stops at the first one that's stale or torn.
+ *
+ * Every thread builds its own transaction, so operations running in parallel never mix their
+ * records. Closing a transaction and committing the batch are serialized by the journal's lock.
+ */
+class Journal {
+
+    /**
+     * A transaction opened by one thread, with what it changed besides its records.
+     */
+    struct OpenTransaction {
+        std::string records;                // Records logged so far
+        int depth;                          // Nesting depth
+        off_t sizeChange;                   // Change in the amount of file data
+        std::vector<std::string> files;     // Files whose inode was changed
+        std::vector<int> frees;             // Blocks freed
+    };
+
+    BlockDevice* device;        // Device holding the journal region
+    BlockCache* cache;          // Cache holding the file data, written back before each commit
+    off_t regionOffset;         // Device offset of the journal region
+    off_t regionSize;           // Size of the journal region in bytes
+    off_t head;                 // Offset in the region the next batch is written at
+    uint64_t sequence;          // Sequence number of the next transaction to close
+
+    std::unordered_map<std::thread::id, OpenTransaction> transactions; // Open transaction of each thread
+    std::string batch;          // Closed transactions not written yet
+    int batchCount;             // Number of transactions in the batch
+    std::vector<int> batchFrees; // Blocks freed by the batch, reusable once it's committed
+    mutable std::mutex lock;    // Guards everything but the records of an open transaction
+
+public:
+
+    /**
+     * Constructor to initialize an empty journal.
+     *
+     * @param _device: Pointer to the device holding the journal region.
+     * @param _cache: Pointer to the cache in front of the data area.
+     */
+    Journal(BlockDevice* _device, BlockCache* _cache);
+
+    /**
+     * Start the journal region over, dropping the batch. Called once the metadata it covers is saved,
+     * after takeFrees.
+     *
+     * @param _regionOffset: The device offset of the journal region.
+     * @param _regionSize: The size of the journal region in bytes.
+     * @param _sequence: The sequence number the first transaction of the region gets.
+     */
+    void reset(off_t _regionOffset, off_t _regionSize, uint64_t _sequence);
+
+    /**
+     * Open a transaction for the calling thread, or nest into its open one.
+     */
+    void begin();
+
+    /**
+     * Close the calling thread's outermost transaction and move it to the batch, with the blocks it freed.
+     * Empty transactions are dropped.
+     *
+     * @return True if the outermost transaction was closed, false if still nested.
+     */
+    bool end();
+
+    /**
+     * Check if the calling thread has a transaction open.
+     *
+     * @return True if a transaction is open, false otherwise.
+     */
+    bool isActive() const;
+
+    /**
+     * Get the nesting depth of the open transaction.
+     *
+     * @return The depth, 0 when no transaction is open.
+     */
+    int getDepth() const;
+
+    /**
+     * Check if the open transaction holds any records.
+     *
+     * @return True if it holds records, false otherwise.
+     */
+    bool hasRecords() const;
+
+    /**
+     * Record that a block pointer was written.
+     *
+     * @param location: The absolute offset on the disk the pointer was written to.
+     * @param block: The block index stored in the pointer.
+     */
+    void logPointer(off_t location, int block);
+
+    /**
+     * Record that a block was marked as in use.
+     *
+     * @param block: The index of the block.
+     */
+    void logAllocate(int block);
+
+    /**
+     * Record that a block was marked as free. The block stays in use until the transaction is committed.
+     *
+     * @param block: The index of the block.
+     */
+    void logRelease(int block);
+
+    /**
+     * Record the current state of a file's inode, creating the file if it doesn't exist.
+     *
+     * @param name: The name of the file.
+     * @param inode: Pointer to the file's inode.
+     */
+    void logInode(const std::string& name, const fsInode* inode);
+
+    /**
+     * Record that a file was removed from the directory.
+     *
+     * @param name: The name of the file.
+     */
+    void logDelete(const std::string& name);
+
+    /**
+     * Record that a file was renamed. For a directory, the one record covers every entry under it,
+     * since their paths start with the directory's.
+     *
+     * @param oldName: The current name of the file.
+     * @param newName: The new name of the file.
+     */
+    void logRename(const std::string& oldName, const std::string& newName);
+
+    /**
+     * Record a change in the amount of file data stored on the disk.
+     * The changes of a transaction are summed into one record when it's closed.
+     *
+     * @param change: The change in bytes.
+     */
+    void logDiskSizeChange(off_t change);
+
+    /**
+     * Mark a file's inode as changed by the open transaction.
+     *
+     * @param name: The name of the file.
+     */
+    void touch(const std::string& name);
+
+    /**
+     * Get the files whose inode the open transaction changed.
+     *
+     * @return The names of the files, in the order they were marked.
+     */
+    const std::vector<std::string>& getTouchedFiles();
+
+    /**
+     * Get the number of blocks freed by the batch.
+     *
+     * @return The number of blocks waiting for a commit to be reusable.
+     */
+    int getPendingFrees() const;
+
+    /**
+     * Take the blocks freed by the batch, before saved metadata makes the batch unnecessary.
+     *
+     * @param blocks: Vector to append the blocks to.
+     */
+    void takeFrees(std::vector<int>& blocks);
+
+    /**
+     * Get the number of closed transactions waiting to be committed.
+     *
+     * @return The number of transactions in the batch.
+     */
+    int getBatchCount() const;
+
+    /**
+     * Get the size of the closed transactions waiting to be committed.
+     *
+     * @return The batch size in bytes.
+     */
+    size_t getBatchBytes() const;
+
+    /**
+     * Check if the batch fits in what's left of the journal region.
+     *
+     * @return True if it fits, false if the region must be started over first.
+     */
+    bool fits() const;
+
+    /**
+     * Write the batch to the journal region and flush the device once, also when the batch is empty.
+     * The cache is written back first, so the committed metadata never points at data still in memory.
+     *
+     * @param released: Vector to append the blocks freed by the committed transactions to.
+     * @return 1 if successful, -1 if there's an error or the batch doesn't fit.
+     */
+    int commit(std::vector<int>& released);
+
+    /**
+     * Get the sequence number the next transaction will get.
+     *
+     * @return The sequence number.
+     */
+    uint64_t getSequence() const;
+
+    /**
+     * Read the committed transactions from the start of the region, in order.
+     * Stops at the first transaction with another sequence number or a bad checksum.
+     *
+     * @param records: Vector to append the records of each valid transaction to.
+     * @return The number of transactions read, or -1 if the region can't be read.
+     */
+    int replay(std::vector<JournalRecord>& records);
+
+private:
+
+    /**
+     * Get the calling thread's transaction. Only that thread touches it, so its records are
+     * appended without holding the lock.
+     *
+     * @return The transaction, with depth 0 if none is open.
+     */
+    OpenTransaction& current();
+
+    /**
+     * Get the calling thread's transaction without opening one.
+     *
+     * @return Pointer to the transaction, or nullptr if none is open.
+     */
+    const OpenTransaction* find() const;
+
+    /**
+     * Append a fixed-size value to a transaction.
+     */
+    template <typename T>
+    static void append(std::string& records, const T& value) {
+        records.append(reinterpret_cast<const char*>(&value), sizeof(value));
+    }
+
+    /**
+     * Append a length-prefixed string to a transaction.
+     */
+    static void appendString(std::string& records, const std::string& str);
+
+    /**
+     * Compute the checksum of a transaction (32-bit FNV-1a).
+     *
+     * @param data: Pointer to the bytes to hash.
+     * @param len: The amount of bytes.
+     * @return The checksum.
+     */
+    static uint32_t checksum(const char* data, size_t len);
+
+    /**
+     * Decode the records of one transaction, all or none of them.
+     *
+     * @param data: The records.
+     * @param records: Vector to append the records to.
+     * @return 1 if successful, -1 if a record is malformed.
+     */
+    static int decode(const std::string& data, std::vector<JournalRecord>& records);
+};
+
+#endif //DISK_SIMULATOR_JOURNAL_H
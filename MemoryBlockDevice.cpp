@@ -0,0 +1,69 @@
+#include <cstring>
+#include <sys/mman.h>
+#include "MemoryBlockDevice.h"
+
+MemoryBlockDevice::MemoryBlockDevice(off_t _size) {
+    size = -1;
+
+    // Anonymous pages are only backed once written, untouched ones read as zeros
+    void* mapping = mmap(nullptr, _size, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS | MAP_NORESERVE, -1, 0);
+    if (mapping == MAP_FAILED)
+    {
+        image = nullptr;
+        return;
+    }
+
+    image = static_cast<char*>(mapping);
+    size = _size;
+}
+
+MemoryBlockDevice::~MemoryBlockDevice() {
+    if (image != nullptr)
+        munmap(image, size);
+}
+
+int MemoryBlockDevice::read(char* buf, size_t len, off_t offset) {
+    if (offset < 0 || offset + static_cast<off_t>(len) > size)
+        return -1;
+
+    memcpy(buf, image + offset, len);
+    return 1;
+}
+
+int MemoryBlockDevice::write(const char* buf, size_t len, off_t offset) {
+    if (offset < 0 || offset + static_cast<off_t>(len) > size)
+        return -1;
+
+    memcpy(image + offset, buf, len);
+    return 1;
+}
+
+const char* MemoryBlockDevice::view(off_t offset, size_t len) const {
+    if (offset < 0 || offset + static_cast<off_t>(len) > size)
+        return nullptr;
+
+    return image + offset;
+}
+
+int MemoryBlockDevice::zero() {
+    // Hand the pages back, the next access maps fresh zero pages
+    return (madvise(image, size, MADV_DONTNEED) == 0) ? 1 : -1;
+}
+
+int MemoryBlockDevice::flush() {
+    return 1; // Nothing to flush
+}
+
+int MemoryBlockDevice::resize(off_t _size) {
+    void* mapping = mremap(image, size, _size, MREMAP_MAYMOVE);
+    if (mapping == MAP_FAILED)
+        return -1;
+
+    image = static_cast<char*>(mapping);
+    size = _size;
+    return 1;
+}
+
+off_t MemoryBlockDevice::getSize() const {
+    return size;
+}
@@ -0,0 +1,45 @@
+#ifndef DISK_SIMULATOR_MEMORYBLOCKDEVICE_H
+#define DISK_SIMULATOR_MEMORYBLOCKDEVICE_H
+
+#include "BlockDevice.h"
+
+/**
+ * MemoryBlockDevice class keeps the whole disk image in anonymous memory.
+ * Nothing ever reaches the host filesystem, and reads and writes issue no syscall.
+ * Pages are only backed once written, so a large image costs nothing until it's used.
+ */
+class MemoryBlockDevice : public BlockDevice {
+
+    char* image;    // Start of the anonymous mapping of the image
+    off_t size;     // Size of the image in bytes
+
+public:
+
+    /**
+     * Constructor to initialize a zeroed in-memory image.
+     *
+     * @param _size: The size of the image in bytes.
+     */
+    explicit MemoryBlockDevice(off_t _size);
+
+    /**
+     * Destructor to release the image.
+     */
+    ~MemoryBlockDevice() override;
+
+    int read(char* buf, size_t len, off_t offset) override;
+
+    int write(const char* buf, size_t len, off_t offset) override;
+
+    const char* view(off_t offset, size_t len) const override;
+
+    int zero() override;
+
+    int flush() override;
+
+    int resize(off_t _size) override;
+
+    off_t getSize() const override;
+};
+
+#endif //DISK_SIMULATOR_MEMORYBLOCKDEVICE_H
@@ -0,0 +1,118 @@
+#include <cstring>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include "MmapBlockDevice.h"
+
+MmapBlockDevice::MmapBlockDevice(const char* path, off_t _size, bool keepContent) {
+    size = -1;
+    image = nullptr;
+    fd = open(path, O_RDWR | O_CREAT | (keepContent ? 0 : O_TRUNC), 0644);
+
+    struct stat st;
+    if (fd == -1 || fstat(fd, &st) != 0)
+        return;
+
+    if (st.st_size > _size)
+        _size = st.st_size;
+
+    else if (ftruncate(fd, _size) != 0)
+        return;
+
+    void* mapping = mmap(nullptr, _size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+    if (mapping == MAP_FAILED)
+        return;
+
+    image = static_cast<char*>(mapping);
+    size = _size;
+}
+
+MmapBlockDevice::~MmapBlockDevice() {
+    if (image != nullptr)
+    {
+        msync(image, size, MS_SYNC);
+        munmap(image, size);
+    }
+
+    if (fd != -1)
+        close(fd);
+}
+
+int MmapBlockDevice::read(char* buf, size_t len, off_t offset) {
+    if (offset < 0 || offset + static_cast<off_t>(len) > size)
+        return -1;
+
+    memcpy(buf, image + offset, len);
+    return 1;
+}
+
+int MmapBlockDevice::write(const char* buf, size_t len, off_t offset) {
+    if (offset < 0 || offset + static_cast<off_t>(len) > size)
+        return -1;
+
+    memcpy(image + offset, buf, len);
+    return 1;
+}
+
+const char* MmapBlockDevice::view(off_t offset, size_t len) const {
+    if (offset < 0 || offset + static_cast<off_t>(len) > getSize())
+        return nullptr;
+
+    return image + offset;
+}
+
+int MmapBlockDevice::zero() {
+    // Cutting the file drops its pages from the shared mapping, growing it back maps zero pages
+    if (ftruncate(fd, 0) != 0 || ftruncate(fd, size) != 0)
+        return -1;
+
+    return 1;
+}
+
+int MmapBlockDevice::flush() {
+    if (image == nullptr)
+        return -1;
+
+    return (msync(image, size, MS_SYNC) == 0) ? 1 : -1;
+}
+
+int MmapBlockDevice::resize(off_t _size) {
+    if (image == nullptr)
+        return -1;
+
+    // The mapping must not pass the file end, so the file grows before the mapping and shrinks after it.
+    // A failed step is undone, so a failed resize leaves the device usable at its old size
+    if (_size > size && ftruncate(fd, _size) != 0)
+        return -1;
+
+    void* mapping = mremap(image, size, _size, MREMAP_MAYMOVE);
+    bool remapped = (mapping != MAP_FAILED);
+    if (remapped && (_size >= size || ftruncate(fd, _size) == 0))
+    {
+        image = static_cast<char*>(mapping);
+        size = _size;
+        return 1;
+    }
+
+    if (!remapped)
+    {
+        // The old mapping is untouched, only the grown file is cut back (a longer file is harmless)
+        if (_size > size && ftruncate(fd, size) != 0)
+            return -1;
+    }
+    else
+    {
+        // The file kept its old size, so the shrunk mapping can grow back over it
+        void* restored = mremap(mapping, _size, size, MREMAP_MAYMOVE);
+        image = static_cast<char*>((restored != MAP_FAILED) ? restored : mapping);
+        if (restored == MAP_FAILED)
+            size = _size;
+    }
+
+    return -1;
+}
+
+off_t MmapBlockDevice::getSize() const {
+    return size;
+}
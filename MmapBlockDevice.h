@@ -0,0 +1,48 @@
+#ifndef DISK_SIMULATOR_MMAPBLOCKDEVICE_H
+#define DISK_SIMULATOR_MMAPBLOCKDEVICE_H
+
+#include "BlockDevice.h"
+
+/**
+ * MmapBlockDevice class keeps the disk image in a regular file mapped into memory.
+ * Reads and writes are plain memory copies, the kernel writes the pages back.
+ */
+class MmapBlockDevice : public BlockDevice {
+
+    int fd;         // Raw descriptor of the image file
+    char* image;    // Start of the shared mapping of the image
+    off_t size;     // Size of the image in bytes
+
+public:
+
+    /**
+     * Constructor to open the image file and size it and map it.
+     * A kept image smaller than '_size' is grown to it, a larger one keeps its size.
+     *
+     * @param path: The path of the image file.
+     * @param _size: The size of the image in bytes.
+     * @param keepContent: Whether an existing image is kept instead of truncated (default: false).
+     */
+    MmapBlockDevice(const char* path, off_t _size, bool keepContent = false);
+
+    /**
+     * Destructor to flush and unmap the image.
+     */
+    ~MmapBlockDevice() override;
+
+    int read(char* buf, size_t len, off_t offset) override;
+
+    int write(const char* buf, size_t len, off_t offset) override;
+
+    const char* view(off_t offset, size_t len) const override;
+
+    int zero() override;
+
+    int flush() override;
+
+    int resize(off_t _size) override;
+
+    off_t getSize() const override;
+};
+
+#endif //DISK_SIMULATOR_MMAPBLOCKDEVICE_H
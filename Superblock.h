@@ -0,0 +1,46 @@
+#ifndef DISK_SIMULATOR_SUPERBLOCK_H
+#define DISK_SIMULATOR_SUPERBLOCK_H
+
+#include <cstdint>
+
+#define SUPERBLOCK_MAGIC "FSDISK01"
+#define SUPERBLOCK_VERSION 9
+#define SUPERBLOCK_SIZE 512 // Bytes reserved for the superblock at the start of the image
+
+/**
+ * Superblock is the fixed header at offset 0 of a disk image.
+ * It records the disk geometry and where each metadata region of the image lives.
+ *
+ * Image layout:
+ *   [superblock][journal][data area: diskSize bytes][free bitmap][inode table][directory]
+ *
+ * The metadata regions are written after the previous ones when they would overlap them,
+ * so the superblock keeps pointing at intact metadata until it's replaced.
+ */
+struct Superblock {
+    char magic[8];                  // SUPERBLOCK_MAGIC, identifies a formatted image
+    uint32_t version;               // SUPERBLOCK_VERSION of the layout
+    uint32_t blockSize;             // Size of each block in bytes
+    uint32_t inodeFormat;           // InodeFormat of every inode on the disk
+    uint64_t diskSize;              // Size of the data area in bytes
+    uint64_t currentDiskSize;       // Amount of file data stored on the disk in bytes
+    uint64_t dataOffset;            // Image offset of block 0
+
+    uint64_t journalOffset;         // Image offset of the journal region
+    uint64_t journalSize;           // Size of the journal region in bytes
+    uint64_t journalSequence;       // Sequence number of the first transaction to replay
+
+    uint64_t bitmapOffset;          // Image offset of the free bitmap (64-bit words)
+    uint64_t bitmapBytes;           // Size of the free bitmap in bytes
+
+    uint64_t inodeTableOffset;      // Image offset of the inode table (one DiskInode per file and directory)
+    uint64_t inodeTableBytes;       // Size of the inode table in bytes
+
+    uint64_t directoryOffset;       // Image offset of the directory (path, inode record offset and size, type per entry)
+    uint64_t directoryBytes;        // Size of the directory in bytes
+    uint32_t filesCount;            // Number of directory entries
+};
+
+static_assert(sizeof(Superblock) <= SUPERBLOCK_SIZE, "Superblock must fit its reserved region");
+
+#endif //DISK_SIMULATOR_SUPERBLOCK_H
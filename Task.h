@@ -0,0 +1,91 @@
+#ifndef DISK_SIMULATOR_TASK_H
+#define DISK_SIMULATOR_TASK_H
+
+#include <coroutine>
+#include <exception>
+#include <utility>
+
+/**
+ * Task class is a coroutine returning nothing. It starts suspended, and runs either when it's spawned
+ * on an EventLoop or when another coroutine co_awaits it; in the second case the awaiting coroutine
+ * goes on once the task ends. A coroutine has no stack of its own, so thousands of them are cheap.
+ */
+class Task {
+
+public:
+
+    struct promise_type;
+    using Handle = std::coroutine_handle<promise_type>;
+
+    /**
+     * Resumes whoever waits for the task once it ends, or frees a spawned task's frame.
+     */
+    struct FinalAwaiter {
+        bool await_ready() const noexcept { return false; }
+
+        std::coroutine_handle<> await_suspend(Handle handle) noexcept {
+            std::coroutine_handle<> continuation = handle.promise().continuation;
+            if (handle.promise().detached)
+            {
+                handle.destroy(); // Nobody owns the frame of a spawned task
+                return std::noop_coroutine();
+            }
+
+            return continuation ? continuation : std::noop_coroutine();
+        }
+
+        void await_resume() const noexcept {}
+    };
+
+    struct promise_type {
+        std::coroutine_handle<> continuation;   // The coroutine awaiting this task, empty if none
+        bool detached = false;                  // Spawned on a loop, the frame frees itself when done
+
+        Task get_return_object() { return Task(Handle::from_promise(*this)); }
+        std::suspend_always initial_suspend() noexcept { return {}; }
+        FinalAwaiter final_suspend() noexcept { return {}; }
+        void return_void() {}
+        void unhandled_exception() { std::terminate(); }
+    };
+
+    Task(Task&& other) noexcept : handle(std::exchange(other.handle, nullptr)) {}
+
+    Task(const Task&) = delete;
+
+    Task& operator=(const Task&) = delete;
+
+    ~Task() {
+        if (handle)
+            handle.destroy();
+    }
+
+    bool await_ready() const noexcept { return false; }
+
+    /**
+     * Start the task, the awaiting coroutine is resumed when it ends.
+     */
+    std::coroutine_handle<> await_suspend(std::coroutine_handle<> awaiting) noexcept {
+        handle.promise().continuation = awaiting;
+        return handle;
+    }
+
+    void await_resume() const noexcept {}
+
+    /**
+     * Give up the ownership of the coroutine, its frame frees itself once it ends.
+     *
+     * @return The coroutine, to be resumed by the caller.
+     */
+    std::coroutine_handle<> detach() {
+        handle.promise().detached = true;
+        return std::exchange(handle, nullptr);
+    }
+
+private:
+
+    Handle handle; // The coroutine, empty once it was detached
+
+    explicit Task(Handle _handle) : handle(_handle) {}
+};
+
+#endif //DISK_SIMULATOR_TASK_H
@@ -0,0 +1,75 @@
+#include <algorithm>
+#include "ThreadPoolAsyncEngine.h"
+
+ThreadPoolAsyncEngine::ThreadPoolAsyncEngine(BlockDevice* _device, int depth) {
+    device = _device;
+    outstanding = 0;
+    stopping = false;
+
+    for (int i = 0; i < depth; i++)
+        workers.emplace_back(&ThreadPoolAsyncEngine::run, this);
+}
+
+ThreadPoolAsyncEngine::~ThreadPoolAsyncEngine() {
+    {
+        std::lock_guard<std::mutex> guard(lock);
+        stopping = true;
+    }
+
+    work.notify_all();
+    for (std::thread& worker : workers)
+        worker.join();
+}
+
+int ThreadPoolAsyncEngine::submit(const AsyncOp& op) {
+    {
+        std::lock_guard<std::mutex> guard(lock);
+        if (stopping)
+            return -1;
+
+        queued.push_back(op);
+        outstanding++;
+    }
+
+    work.notify_one();
+    return 1;
+}
+
+int ThreadPoolAsyncEngine::reap(std::vector<AsyncOp>& completed, int minimum) {
+    std::unique_lock<std::mutex> guard(lock);
+    int wanted = std::min(minimum, outstanding);
+    done.wait(guard, [&] { return static_cast<int>(finished.size()) >= wanted; });
+
+    int amount = static_cast<int>(finished.size());
+    completed.insert(completed.end(), finished.begin(), finished.end());
+    finished.clear();
+    outstanding -= amount;
+    return amount;
+}
+
+int ThreadPoolAsyncEngine::getOutstanding() const {
+    std::lock_guard<std::mutex> guard(lock);
+    return outstanding;
+}
+
+void ThreadPoolAsyncEngine::run() {
+    std::unique_lock<std::mutex> guard(lock);
+
+    while (true)
+    {
+        work.wait(guard, [&] { return stopping || !queued.empty(); });
+        if (queued.empty())
+            return; // Stopping with nothing left to run
+
+        AsyncOp op = queued.front();
+        queued.pop_front();
+
+        // The device access runs without the lock, next to the other workers' accesses
+        guard.unlock();
+        op.result = op.write ? device->write(op.buf, op.len, op.offset) : device->read(op.buf, op.len, op.offset);
+        guard.lock();
+
+        finished.push_back(op);
+        done.notify_all();
+    }
+}
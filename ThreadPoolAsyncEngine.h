@@ -0,0 +1,55 @@
+#ifndef DISK_SIMULATOR_THREADPOOLASYNCENGINE_H
+#define DISK_SIMULATOR_THREADPOOLASYNCENGINE_H
+
+#include <condition_variable>
+#include <deque>
+#include <mutex>
+#include <thread>
+#include "AsyncEngine.h"
+
+/**
+ * ThreadPoolAsyncEngine class runs device accesses on a fixed pool of worker threads,
+ * each calling the device's blocking read or write. Works with every backend.
+ */
+class ThreadPoolAsyncEngine : public AsyncEngine {
+
+    BlockDevice* device;                    // Device the workers access
+    std::vector<std::thread> workers;       // One thread per access in flight
+    std::deque<AsyncOp> queued;             // Accesses no worker took yet
+    std::vector<AsyncOp> finished;          // Accesses done but not reaped
+    int outstanding;                        // Accesses submitted but not reaped
+    bool stopping;                          // The workers exit once the queue is empty
+    mutable std::mutex lock;                // Guards the queues and the counters
+    std::condition_variable work;           // Signaled when an access is queued or the pool stops
+    std::condition_variable done;           // Signaled when an access finishes
+
+public:
+
+    /**
+     * Constructor to start the worker threads.
+     *
+     * @param _device: Pointer to the device to access.
+     * @param depth: The number of worker threads.
+     */
+    ThreadPoolAsyncEngine(BlockDevice* _device, int depth);
+
+    /**
+     * Destructor to finish the queued accesses and join the workers.
+     */
+    ~ThreadPoolAsyncEngine() override;
+
+    int submit(const AsyncOp& op) override;
+
+    int reap(std::vector<AsyncOp>& completed, int minimum) override;
+
+    int getOutstanding() const override;
+
+private:
+
+    /**
+     * Body of a worker thread: take queued accesses and run them until the pool stops.
+     */
+    void run();
+};
+
+#endif //DISK_SIMULATOR_THREADPOOLASYNCENGINE_H
@@ -0,0 +1,219 @@
+#ifdef __linux__
+
+#include <algorithm>
+#include <cerrno>
+#include <cstring>
+#include <linux/io_uring.h>
+#include <sys/mman.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+#include "UringAsyncEngine.h"
+
+UringAsyncEngine::UringAsyncEngine(int _deviceFd, int depth) {
+    deviceFd = _deviceFd;
+    sqRing = nullptr;
+    cqRing = nullptr;
+    sqes = nullptr;
+    sqRingSize = 0;
+    cqRingSize = 0;
+    sqesSize = 0;
+    unsubmitted = 0;
+    outstanding = 0;
+
+    io_uring_params params;
+    memset(&params, 0, sizeof(params));
+    ringFd = static_cast<int>(syscall(__NR_io_uring_setup, depth, &params));
+    if (ringFd < 0)
+    {
+        ringFd = -1; // No io_uring in this kernel, or not allowed to use it
+        return;
+    }
+
+    sqRingSize = params.sq_off.array + params.sq_entries * sizeof(unsigned);
+    cqRingSize = params.cq_off.cqes + params.cq_entries * sizeof(io_uring_cqe);
+    bool singleMapping = params.features & IORING_FEAT_SINGLE_MMAP;
+    if (singleMapping)
+        sqRingSize = cqRingSize = std::max(sqRingSize, cqRingSize);
+
+    void* sq = mmap(nullptr, sqRingSize, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, ringFd, IORING_OFF_SQ_RING);
+    void* cq = singleMapping ? sq : mmap(nullptr, cqRingSize, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, ringFd, IORING_OFF_CQ_RING);
+    sqesSize = params.sq_entries * sizeof(io_uring_sqe);
+    void* entries = mmap(nullptr, sqesSize, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, ringFd, IORING_OFF_SQES);
+
+    sqRing = (sq == MAP_FAILED) ? nullptr : static_cast<char*>(sq);
+    cqRing = (cq == MAP_FAILED) ? nullptr : static_cast<char*>(cq);
+    sqes = (entries == MAP_FAILED) ? nullptr : static_cast<io_uring_sqe*>(entries);
+    if (sqRing == nullptr || cqRing == nullptr || sqes == nullptr)
+    {
+        close(ringFd);
+        ringFd = -1;
+        return;
+    }
+
+    sqTail = reinterpret_cast<unsigned*>(sqRing + params.sq_off.tail);
+    sqMask = reinterpret_cast<unsigned*>(sqRing + params.sq_off.ring_mask);
+    sqArray = reinterpret_cast<unsigned*>(sqRing + params.sq_off.array);
+    cqHead = reinterpret_cast<unsigned*>(cqRing + params.cq_off.head);
+    cqTail = reinterpret_cast<unsigned*>(cqRing + params.cq_off.tail);
+    cqMask = reinterpret_cast<unsigned*>(cqRing + params.cq_off.ring_mask);
+    cqes = reinterpret_cast<io_uring_cqe*>(cqRing + params.cq_off.cqes);
+
+    // One slot per submission entry, so the submission ring never overflows
+    slots.resize(params.sq_entries);
+    for (int i = static_cast<int>(params.sq_entries) - 1; i >= 0; i--)
+        freeSlots.push_back(i);
+}
+
+UringAsyncEngine::~UringAsyncEngine() {
+    if (ringFd != -1)
+    {
+        // The kernel may still be using the buffers of the accesses in flight
+        std::lock_guard<std::mutex> guard(lock);
+        while (static_cast<int>(freeSlots.size()) < static_cast<int>(slots.size()) && enter(1) != -1)
+            drainCompletions();
+
+        close(ringFd);
+    }
+
+    if (sqes != nullptr)
+        munmap(sqes, sqesSize);
+
+    if (cqRing != nullptr && cqRing != sqRing)
+        munmap(cqRing, cqRingSize);
+
+    if (sqRing != nullptr)
+        munmap(sqRing, sqRingSize);
+}
+
+bool UringAsyncEngine::isReady() const {
+    return ringFd != -1;
+}
+
+int UringAsyncEngine::submit(const AsyncOp& op) {
+    std::lock_guard<std::mutex> guard(lock);
+    if (ringFd == -1)
+        return -1;
+
+    queued.push_back(op);
+    outstanding++;
+    fill();
+
+    // Entries the kernel doesn't take now stay in the ring for the next system call
+    enter(0);
+    return 1;
+}
+
+int UringAsyncEngine::reap(std::vector<AsyncOp>& completed, int minimum) {
+    std::lock_guard<std::mutex> guard(lock);
+    int wanted = std::min(minimum, outstanding);
+
+    while (true)
+    {
+        drainCompletions();
+        fill();
+
+        if (static_cast<int>(finished.size()) >= wanted || enter(1) == -1)
+            break;
+    }
+
+    // Resubmitted remainders and newly filled slots
+    if (unsubmitted > 0)
+        enter(0);
+
+    int amount = static_cast<int>(finished.size());
+    completed.insert(completed.end(), finished.begin(), finished.end());
+    finished.clear();
+    outstanding -= amount;
+    return amount;
+}
+
+int UringAsyncEngine::getOutstanding() const {
+    std::lock_guard<std::mutex> guard(lock);
+    return outstanding;
+}
+
+void UringAsyncEngine::fill() {
+    while (!queued.empty() && !freeSlots.empty())
+    {
+        int slot = freeSlots.back();
+        freeSlots.pop_back();
+
+        RingSlot& ringSlot = slots[slot];
+        ringSlot.op = queued.front();
+        ringSlot.iov = {ringSlot.op.buf, ringSlot.op.len};
+        queued.pop_front();
+
+        prepare(slot);
+    }
+}
+
+void UringAsyncEngine::prepare(int slot) {
+    RingSlot& ringSlot = slots[slot];
+    size_t done = static_cast<char*>(ringSlot.iov.iov_base) - ringSlot.op.buf;
+
+    unsigned tail = *sqTail;
+    unsigned index = tail & *sqMask;
+    io_uring_sqe& sqe = sqes[index];
+    memset(&sqe, 0, sizeof(sqe));
+    sqe.opcode = ringSlot.op.write ? IORING_OP_WRITEV : IORING_OP_READV;
+    sqe.fd = deviceFd;
+    sqe.addr = reinterpret_cast<unsigned long long>(&ringSlot.iov);
+    sqe.len = 1;
+    sqe.off = ringSlot.op.offset + done;
+    sqe.user_data = slot;
+
+    sqArray[index] = index;
+    __atomic_store_n(sqTail, tail + 1, __ATOMIC_RELEASE); // The kernel sees the entry only after it's filled
+    unsubmitted++;
+}
+
+int UringAsyncEngine::enter(unsigned wait) {
+    while (true)
+    {
+        long ret = syscall(__NR_io_uring_enter, ringFd, unsubmitted, wait, wait > 0 ? IORING_ENTER_GETEVENTS : 0, nullptr, 0);
+        if (ret >= 0)
+        {
+            unsubmitted -= std::min<unsigned>(unsubmitted, static_cast<unsigned>(ret));
+            return 1;
+        }
+
+        if (errno != EINTR)
+            return -1;
+    }
+}
+
+void UringAsyncEngine::drainCompletions() {
+    unsigned head = *cqHead;
+    unsigned tail = __atomic_load_n(cqTail, __ATOMIC_ACQUIRE);
+
+    for (; head != tail; head++)
+    {
+        io_uring_cqe& cqe = cqes[head & *cqMask];
+        int slot = static_cast<int>(cqe.user_data);
+        RingSlot& ringSlot = slots[slot];
+
+        if (cqe.res == -EINTR || cqe.res == -EAGAIN)
+        {
+            prepare(slot);
+            continue;
+        }
+
+        // A short transfer goes on from where it stopped
+        if (cqe.res > 0 && static_cast<size_t>(cqe.res) < ringSlot.iov.iov_len)
+        {
+            ringSlot.iov.iov_base = static_cast<char*>(ringSlot.iov.iov_base) + cqe.res;
+            ringSlot.iov.iov_len -= cqe.res;
+            prepare(slot);
+            continue;
+        }
+
+        // Nothing transferred for a non-empty access means an error or the end of the image
+        ringSlot.op.result = (cqe.res >= 0 && static_cast<size_t>(cqe.res) == ringSlot.iov.iov_len) ? 1 : -1;
+        finished.push_back(ringSlot.op);
+        freeSlots.push_back(slot);
+    }
+
+    __atomic_store_n(cqHead, head, __ATOMIC_RELEASE);
+}
+
+#endif // __linux__
@@ -0,0 +1,110 @@
+#ifndef DISK_SIMULATOR_URINGASYNCENGINE_H
+#define DISK_SIMULATOR_URINGASYNCENGINE_H
+
+#include <deque>
+#include <mutex>
+#include <sys/uio.h>
+#include "AsyncEngine.h"
+
+struct io_uring_sqe;
+struct io_uring_cqe;
+
+/**
+ * UringAsyncEngine class runs device accesses through a Linux io_uring on the image's file descriptor.
+ * The ring is driven with the raw system calls, so no library is needed. Accesses are handed to the
+ * kernel in one system call per submit or reap, and a short transfer is resubmitted for its remainder.
+ */
+class UringAsyncEngine : public AsyncEngine {
+
+    /**
+     * An access in the ring: the access and the part of its buffer left to transfer.
+     */
+    struct RingSlot {
+        AsyncOp op;
+        iovec iov;
+    };
+
+    int ringFd;                     // Descriptor of the ring, -1 if it could not be set up
+    int deviceFd;                   // Descriptor of the image file
+
+    char* sqRing;                   // Mapping of the submission ring
+    size_t sqRingSize;
+    char* cqRing;                   // Mapping of the completion ring, may be the submission ring's
+    size_t cqRingSize;
+    io_uring_sqe* sqes;             // Mapping of the submission entries
+    size_t sqesSize;
+
+    unsigned* sqTail;
+    unsigned* sqMask;
+    unsigned* sqArray;
+    unsigned* cqHead;
+    unsigned* cqTail;
+    unsigned* cqMask;
+    io_uring_cqe* cqes;
+
+    std::vector<RingSlot> slots;    // Accesses in the ring, indexed by their user data
+    std::vector<int> freeSlots;     // Slots not holding an access
+    std::deque<AsyncOp> queued;     // Accesses waiting for a free slot
+    std::vector<AsyncOp> finished;  // Accesses done but not reaped
+    unsigned unsubmitted;           // Entries added to the submission ring since the last system call
+    int outstanding;                // Accesses submitted but not reaped
+    mutable std::mutex lock;        // Guards the rings and the queues
+
+public:
+
+    /**
+     * Constructor to set up the ring.
+     *
+     * @param _deviceFd: The file descriptor of the image.
+     * @param depth: The amount of entries of the ring.
+     */
+    UringAsyncEngine(int _deviceFd, int depth);
+
+    /**
+     * Destructor to finish the accesses in flight and release the ring.
+     */
+    ~UringAsyncEngine() override;
+
+    /**
+     * Check whether the kernel gave us a ring.
+     *
+     * @return True if the engine can be used.
+     */
+    bool isReady() const;
+
+    int submit(const AsyncOp& op) override;
+
+    int reap(std::vector<AsyncOp>& completed, int minimum) override;
+
+    int getOutstanding() const override;
+
+private:
+
+    /**
+     * Move queued accesses into free slots and add them to the submission ring.
+     */
+    void fill();
+
+    /**
+     * Add the remaining transfer of a slot to the submission ring.
+     *
+     * @param slot: The index of the slot.
+     */
+    void prepare(int slot);
+
+    /**
+     * Hand the new submission entries to the kernel and optionally wait for completions.
+     *
+     * @param wait: The amount of completions to wait for.
+     * @return 1 if successful, -1 if there's an error.
+     */
+    int enter(unsigned wait);
+
+    /**
+     * Take every entry off the completion ring. Finished accesses move to the finished list,
+     * short transfers are prepared again for their remainder.
+     */
+    void drainCompletions();
+};
+
+#endif //DISK_SIMULATOR_URINGASYNCENGINE_H
@@ -1,124 +1,475 @@
 #include "fsDisk.h"
 
+thread_local fsDisk* fsDisk::lockingDisk = nullptr;
+thread_local bool fsDisk::lockingExclusive = false;
+
+fsDisk::OperationLock::OperationLock(fsDisk* _disk, bool _exclusive)
+{
+    disk = _disk;
+    owner = (lockingDisk != disk);
+    exclusive = _exclusive;
+    inode = nullptr;
+    inodeExclusive = false;
+
+    if (!owner)
+        return;
+
+    if (!disk->journal->fits())
+    {
+        unique_lock<shared_mutex> checkpoint(disk->dirLock);
+        if (!disk->journal->fits())
+            disk->writeMetadata();
+    }
+
+    if (exclusive)
+        disk->dirLock.lock();
+    else
+        disk->dirLock.lock_shared();
+
+    lockingDisk = disk;
+    lockingExclusive = exclusive;
+}
+
+void fsDisk::OperationLock::lockInode(fsInode* _inode, bool _exclusive)
+{
+    if (!owner)
+        return;
+
+    inode = _inode;
+    inodeExclusive = _exclusive;
+
+    if (inodeExclusive)
+        inode->getLock().lock();
+    else
+        inode->getLock().lock_shared();
+}
+
+fsDisk::OperationLock::~OperationLock()
+{
+    if (!owner)
+        return;
+
+    if (inode != nullptr)
+    {
+        if (inodeExclusive)
+            inode->getLock().unlock();
+        else
+            inode->getLock().unlock_shared();
+    }
+
+    lockingDisk = nullptr;
+    lockingExclusive = false;
+
+    if (exclusive)
+        disk->dirLock.unlock();
+    else
+        disk->dirLock.unlock_shared();
+}
+
 int fsDisk::getFreeDiskSpace()
 {
-    if (BitVector == nullptr)
-        return - 1;
+    int index = freeMap.findFree(freeMap.getThreadGroup());
 
-    for (int i = 0 ; i < BitVectorSize ; i++)
-        if (BitVector[i] == 0)
-            return i;
+    // Blocks freed by closed transactions come back once the journal holds them
+    if (index == -1 && journal->getPendingFrees() > 0 && commitJournal() == 1)
+        index = freeMap.findFree(freeMap.getThreadGroup());
 
-    return -1;
+    return index;
+}
+
+int fsDisk::allocateBlock(int group)
+{
+    int count;
+    return allocateRun(-1, 1, group, &count);
+}
+
+int fsDisk::allocateRun(int goal, int maxCount, int group, int* count)
+{
+    int index = freeMap.allocateRun(goal, maxCount, group, count);
+
+    // Blocks freed by closed transactions come back once the journal holds them
+    if (index == -1 && journal->getPendingFrees() > 0 && commitJournal() == 1)
+        index = freeMap.allocateRun(goal, maxCount, group, count);
+
+    if (index != -1 && journal->isActive())
+        for (int i = 0; i < *count; i++)
+            journal->logAllocate(index + i);
+
+    return index;
 }
 
-int fsDisk::getFreeLocation()
+int fsDisk::getHomeGroup(fsInode* inode)
 {
-    for (int i = 0 ; i < openFileDescriptors.size() ; i++)
-        if (!openFileDescriptors[i].isInUse())
-            return i;
+    // A file stays in the group its first block went to, a new file starts in the writer's group
+    int first = inode->getFirstBlock();
+    return (first == -1) ? freeMap.getThreadGroup() : freeMap.getGroup(first);
+}
 
-    return openFileDescriptors.size();
+int fsDisk::getFreeBlocksCount()
+{
+    return freeMap.getBlocksCount() - freeMap.getUsedCount() + journal->getPendingFrees();
 }
 
-int fsDisk::getFileDescriptor(string name)
+void fsDisk::releaseBlock(int block)
 {
+    if (!journal->isActive())
+    {
+        freeMap.clear(block);
+        return;
+    }
 
-    for (int i = 0 ; i < openFileDescriptors.size() ; i++)
-        if (openFileDescriptors[i].getFileName() == name)
-            return i;
+    // The journal keeps the block until the transaction is committed
+    journal->logRelease(block);
+}
 
-    return -1;
+void fsDisk::beginTransaction()
+{
+    journal->begin();
+}
+
+void fsDisk::endTransaction()
+{
+    if (journal->getDepth() == 1)
+    {
+        for (const string& name : journal->getTouchedFiles())
+        {
+            int id = MainDir.find(name);
+            if (id != -1 && MainDir.get(id).inode != nullptr)
+                journal->logInode(name, MainDir.get(id).inode);
+        }
+    }
+
+    if (!journal->end())
+        return; // Still nested in an outer operation
+
+    if (journal->getBatchCount() >= JOURNAL_GROUP_SIZE || journal->getBatchBytes() >= JOURNAL_BATCH_BYTES)
+        commitJournal();
+}
+
+void fsDisk::touchFile(const string& name)
+{
+    if (journal->isActive())
+        journal->touch(name);
+}
+
+void fsDisk::changeDiskSize(off_t change)
+{
+    currentDiskSize += change;
+
+    if (journal->isActive())
+        journal->logDiskSizeChange(change);
+}
+
+int fsDisk::commitJournal()
+{
+    if (!journal->fits())
+    {
+        // Saving the metadata covers the batch, but not in the middle of an operation,
+        // nor while other operations may change what's saved
+        if (journal->isActive() || lockingDisk != this || !lockingExclusive)
+            return -1;
+
+        return writeMetadata();
+    }
+
+    // The journal writes back the cache first, so the committed metadata never points at blocks still in it
+    vector<int> released;
+    if (journal->commit(released) == -1)
+        return -1;
+
+    for (int block : released)
+        freeMap.clear(block);
+
+    return 1;
 }
 
-int fsDisk::insertIntoVector(FileDescriptor fd)
+void fsDisk::applyRecord(const JournalRecord& record)
 {
-    int index = getFreeLocation();
+    bool hasBlock = record.type == JOURNAL_POINTER || record.type == JOURNAL_ALLOCATE || record.type == JOURNAL_RELEASE;
+    if (hasBlock && (record.block < 0 || record.block >= freeMap.getBlocksCount()))
+        return;
+
+    switch (record.type)
+    {
+        case JOURNAL_POINTER:
+            if (record.location >= 0 && record.location + POINTER_SIZE <= diskSize)
+                writePointer(record.block, record.location);
+            break;
+
+        case JOURNAL_ALLOCATE:
+            freeMap.set(record.block);
+            break;
+
+        case JOURNAL_RELEASE:
+            freeMap.clear(record.block);
+            break;
+
+        case JOURNAL_INODE:
+        {
+            if (record.inodeRecord.size() < sizeof(DiskInode))
+                break;
+
+            fsInode* inode = inodeSlab.allocate();
+            inode->deserialize(record.inodeRecord.data());
+
+            int id = MainDir.find(record.name);
+            if (id != -1)
+                deleteFromMainDir(id, false);
+
+            insertInode(MainDir.insert(record.name).first, inode);
+            break;
+        }
+
+        case JOURNAL_DELETE:
+        {
+            int id = MainDir.find(record.name);
+            if (id != -1)
+                deleteFromMainDir(id, false);
+            break;
+        }
+
+        case JOURNAL_RENAME:
+        {
+            int id = MainDir.find(record.name);
+            if (id == -1 || !MainDir.rename(id, record.newName))
+                break;
+
+            // A directory's record covers the entries under it, whose paths start with the directory's
+            vector<int> subtree;
+            for (int child = MainDir.first(); child != -1; child = MainDir.next(child))
+            {
+                const string& name = MainDir.getName(child);
+                if (name.size() > record.name.size() && name[record.name.size()] == '/' &&
+                    name.compare(0, record.name.size(), record.name) == 0)
+                    subtree.push_back(child);
+            }
+
+            for (int child : subtree)
+                MainDir.rename(child, string(record.newName).append(MainDir.getName(child), record.name.size()));
+            break;
+        }
+
+        case JOURNAL_DISK_SIZE:
+            currentDiskSize += record.location;
+            break;
+    }
+}
 
-    if (index < openFileDescriptors.size())
-        openFileDescriptors[index] = fd;
+int fsDisk::allocateDescriptor(int id)
+{
+    DirEntry& entry = MainDir.get(id);
+    FileDescriptor descriptor(MainDir.getName(id), entry.inode);
 
+    int index = freeDescriptor;
+    if (index != -1)
+    {
+        freeDescriptor = descriptorSlots[index].nextFree;
+        descriptorSlots[index].descriptor = std::move(descriptor);
+    }
     else
-        openFileDescriptors.push_back(fd);
+    {
+        if (descriptorSlots.size() == FD_SLOTS)
+            return -1;
 
-    return index;
+        index = static_cast<int>(descriptorSlots.size());
+        descriptorSlots.push_back({std::move(descriptor), 0, -1});
+    }
+
+    entry.fd = static_cast<int>(descriptorSlots[index].generation << FD_INDEX_BITS) | index;
+    return entry.fd;
+}
+
+void fsDisk::releaseDescriptor(int fd)
+{
+    int index = fd & (FD_SLOTS - 1);
+    DescriptorSlot& slot = descriptorSlots[index];
+
+    // An open file can't be renamed or deleted, so its entry is still found by the descriptor's name
+    MainDir.get(MainDir.find(slot.descriptor.getFileName())).fd = -1;
+    slot.descriptor.release();
+
+    // Handles to the old generation are stale from now on
+    slot.generation = (slot.generation + 1) % FD_GENERATIONS;
+    slot.nextFree = freeDescriptor;
+    freeDescriptor = index;
+}
+
+FileDescriptor& fsDisk::getDescriptor(int fd)
+{
+    return descriptorSlots[fd & (FD_SLOTS - 1)].descriptor;
+}
+
+
+fsInode* fsDisk::getInode(int id)
+{
+    DirEntry& entry = MainDir.get(id);
+
+    if (entry.inode != nullptr)
+    {
+        residentInodes.splice(residentInodes.begin(), residentInodes, entry.lru);
+        return entry.inode;
+    }
+
+    // Page the inode in from its saved record
+    vector<char> record(entry.recordSize);
+    if (sim_disk->read(record.data(), entry.recordSize, inodeTableOffset + entry.recordOffset) == -1)
+        return nullptr;
+
+    entry.inode = inodeSlab.allocate();
+    entry.inode->deserialize(record.data());
+    entry.dirty = false;
+    residentInodes.push_front(id);
+    entry.lru = residentInodes.begin();
+
+    evictInodes();
+    return entry.inode;
 }
 
-bool fsDisk::isInMap(string name)
+void fsDisk::insertInode(int id, fsInode* inode)
 {
-    return !(MainDir.find(name) == MainDir.end());
+    residentInodes.push_front(id);
+    DirEntry& entry = MainDir.get(id);
+    entry.inode = inode;
+    entry.recordOffset = -1;
+    entry.recordSize = 0;
+    entry.dirty = true;
+    entry.lru = residentInodes.begin();
+    entry.fd = -1;
+    entry.type = inode->getType();
+    evictInodes();
+}
+
+void fsDisk::evictInodes()
+{
+    // The most recently used inode is never dropped, its caller is about to use it
+    auto pos = prev(residentInodes.end());
+    while (residentInodes.size() > MAX_RESIDENT_INODES && pos != residentInodes.begin())
+    {
+        auto victim = pos--;
+        DirEntry& entry = MainDir.get(*victim);
+
+        if (entry.dirty || entry.recordOffset == -1 || entry.fd != -1)
+            continue;
+
+        inodeSlab.release(entry.inode);
+        entry.inode = nullptr;
+        residentInodes.erase(victim);
+    }
 }
 
 bool fsDisk::isLegalFD(int fd)
 {
-    return (fd >= 0 && fd < openFileDescriptors.size() && openFileDescriptors[fd].isInUse());
+    if (fd < 0)
+        return false;
+
+    size_t index = fd & (FD_SLOTS - 1);
+    unsigned generation = static_cast<unsigned>(fd) >> FD_INDEX_BITS;
+    return index < descriptorSlots.size() && descriptorSlots[index].generation == generation &&
+           descriptorSlots[index].descriptor.isInUse();
+}
+
+
+int fsDisk::readDisk(char* buf, size_t len, off_t location)
+{
+    waitForAsync(location, len);
+    return cache->readRange(location, buf, len);
 }
 
+int fsDisk::writeDisk(const char* buf, size_t len, off_t location)
+{
+    waitForAsync(location, len);
+    return cache->writeRange(location, buf, len);
+}
+
+int fsDisk::writePointer(int block, off_t location)
+{
+    char pointer[POINTER_SIZE];
+    encodePointer(block, pointer);
 
-int fsDisk::writeLocation(char charToWrite, int location)
+    if (journal->isActive())
+        journal->logPointer(location, block);
+
+    // Write the pointer to the disk at the specified location.
+    return writeDisk(pointer, POINTER_SIZE, location);
+}
+
+int fsDisk::readPointer(off_t location)
 {
-    // Reposition the file offset to the specified location.
-    if (fseek(sim_disk_fd, location, SEEK_SET) != 0)
-        return -1; // Return -1 if there's an error.
+    char pointer[POINTER_SIZE];
 
-    // Write the data to the file at the specified location.
-    if (fwrite(&charToWrite, 1, 1, sim_disk_fd) == -1)
+    if (readDisk(pointer, POINTER_SIZE, location) == -1)
         return -1;
 
+    return decodePointer(pointer);
+}
+
+int fsDisk::writeFromCursor(WriteCursor& cursor, int amount, off_t location)
+{
+    while (amount > 0)
+    {
+        if (cursor.iovOffset == cursor.iov->iov_len) // Move on to the next buffer
+        {
+            cursor.iov++;
+            cursor.iovOffset = 0;
+            continue;
+        }
+
+        int part = static_cast<int>(min<size_t>(amount, cursor.iov->iov_len - cursor.iovOffset));
+        if (writeDisk(static_cast<const char*>(cursor.iov->iov_base) + cursor.iovOffset, part, location) == -1)
+            return -1;
+
+        cursor.iovOffset += part;
+        cursor.remaining -= part;
+        amount -= part;
+        location += part;
+    }
+
     return 1;
 }
 
-int fsDisk::writeBlock(int* writtenAmount, char*& buf, int amount, int location)
+int fsDisk::writeBlock(int* writtenAmount, WriteCursor& cursor, int amount, off_t location)
 {
-    int index = location;
-    size_t file_offset = location;
+    int index = static_cast<int>(location / blockSize);
+    off_t file_offset = location;
 
     if (location == -1)
     {
-        index = getFreeDiskSpace();
+        index = allocateBlock(cursor.group);
         if (index == -1)
             return -1;
 
         // Calculate the absolute file offset to write to
-        file_offset = index * blockSize;
+        file_offset = static_cast<off_t>(index) * blockSize;
     }
 
-    // Reposition the file offset to the specified location.
-    if (fseek(sim_disk_fd, file_offset, SEEK_SET) != 0)
-        return -1; // Return -1 if there's an error.
+    int bytes_written = (cursor.remaining <= amount) ? cursor.remaining : amount;
 
-    size_t bytes_to_write = (strlen(buf) <= amount) ? strlen(buf) : amount;
-
-    // Write the data to the file at the specified location.
-    size_t bytes_written = fwrite(buf, 1, bytes_to_write, sim_disk_fd);
+    // Write the data to the disk at the specified location, straight from the caller's buffers.
+    if (writeFromCursor(cursor, bytes_written, file_offset) == -1)
+    {
+        if (location == -1)
+            releaseBlock(index);
 
-    // Check if the write operation was successful.
-    if (bytes_written != bytes_to_write)
         return -1; // Return -1 if there was an error.
+    }
 
-    currentDiskSize += bytes_written;
+    changeDiskSize(bytes_written);
     *writtenAmount = bytes_written;
-    buf += bytes_written;
-
-    if (location == -1)
-    {
-        BitVector[index] = 1;
-        blocksUsed++;
-    }
 
-    fflush(sim_disk_fd);
     return index;
 }
 
-int fsDisk::writeDirect(char*& buf, fsInode* inode)
+int fsDisk::writeDirect(WriteCursor& cursor, fsInode* inode)
 {
 
     int written;
     int fragAmount = inode->getInternalFragAmount(1);
     if (fragAmount != 0)
     {
-        int fragLocation = inode->getInternalFragLocation(fragAmount);
-        writeBlock(&written, buf, fragAmount, fragLocation);
+        off_t fragLocation = inode->getInternalFragLocation(fragAmount);
+        if (writeBlock(&written, cursor, fragAmount, fragLocation) == -1)
+            return -1;
+
         inode->addFileSize(written);
     }
 
@@ -126,10 +477,10 @@ int fsDisk::writeDirect(char*& buf, fsInode* inode)
     if (directBlock == -1) // No direct blocks available
         return 0;
 
-    if (strlen(buf) <= 0) // Nothing to write
+    if (cursor.remaining <= 0) // Nothing to write
         return 1;
 
-    if (currentDiskSize + blockSize > DISK_SIZE) // No space on the DISK_SIZE
+    if (currentDiskSize + blockSize > diskSize) // No space on the disk
         return 1;
 
 
@@ -138,7 +489,7 @@ int fsDisk::writeDirect(char*& buf, fsInode* inode)
     if (directBlock == -1) // No direct blocks available
         return 0;
 
-    int index = writeBlock(&written, buf, blockSize, -1);
+    int index = writeBlock(&written, cursor, blockSize, -1);
 
     if (index == -1) // Failed
         return -1;
@@ -149,90 +500,85 @@ int fsDisk::writeDirect(char*& buf, fsInode* inode)
     return 2; // Finished
 }
 
-int fsDisk::writeSingle(char*& buf, fsInode* inode, int indexSingleBlock)
+int fsDisk::writeSingle(WriteCursor& cursor, fsInode* inode)
 {
     int written;
 
-    if (strlen(buf) <= 0) // Nothing to write
+    if (cursor.remaining <= 0) // Nothing to write
         return 1;
 
-    int singleIndex = getFreeDiskSpace();
+    int singleIndex = allocateBlock(cursor.group);
     if (singleIndex == -1)
         return -1;
 
-    BitVector[singleIndex] = 1;
-    blocksUsed++;
-
+    int index = writeBlock(&written, cursor, blockSize, -1);
 
-    int index = writeBlock(&written, buf, blockSize, -1);
-
-    if (index == -1)
+    if (index == -1) // No block left for the data, or it failed to be written
+    {
+        releaseBlock(singleIndex);
         return -1;
+    }
 
     inode->addFileSize(written);
 
     // Write the new block under the singleInDirect
-    if (writeLocation(decToBinaryChar(index), singleIndex * blockSize) == -1)
+    if (writePointer(index, static_cast<off_t>(singleIndex) * blockSize) == -1)
         return -1;
 
     return singleIndex;
 }
 
-int fsDisk::getLastBlockInSingle(fsInode* inode)
+off_t fsDisk::getLastBlockInSingle(fsInode* inode)
 {
-    char* buf = new char[blockSize];
-
-    fseek(sim_disk_fd, inode->getSingleInDirect() * blockSize, SEEK_SET);
-    makeRead(inode->getBlocksInSingleInDirect(), buf, 0);
-    int location = static_cast<int>(buf[inode->getBlocksInSingleInDirect() - 1]) * blockSize;
-
-    delete[] buf;
-    return location;
+    return getLastBlockInSingle(static_cast<off_t>(inode->getSingleInDirect()) * blockSize, inode->getBlocksInSingleInDirect());
 }
 
-int fsDisk::getLastBlockInSingle(int location, int blocksAmount)
+off_t fsDisk::getLastBlockInSingle(off_t location, int blocksAmount)
 {
-    char* buf = new char[blockSize];
-
-    fseek(sim_disk_fd, location, SEEK_SET);
-    makeRead(blocksAmount, buf, 0);
-    location = static_cast<int>(buf[blocksAmount - 1]) * blockSize;
+    // Only the last pointer is needed, read it on its own
+    int block = readPointer(location + static_cast<off_t>(blocksAmount - 1) * POINTER_SIZE);
+    if (block == -1)
+        return -1;
 
-    delete[] buf;
-    return location;
+    return static_cast<off_t>(block) * blockSize;
 }
 
-int fsDisk::writeSingleInDirect(char*& buf, fsInode* inode)
+int fsDisk::writeSingleInDirect(WriteCursor& cursor, fsInode* inode)
 {
 
     int written;
     int fragAmount = inode->getInternalFragAmount(2);
-    if (fragAmount != 0 && strlen(buf) > 0)
+    if (fragAmount != 0 && cursor.remaining > 0)
     {
-        int location = getLastBlockInSingle(inode);
-        int fragLocation = inode->getInternalFragLocation(fragAmount, location);
-        writeBlock(&written, buf, fragAmount, fragLocation);
+        off_t location = getLastBlockInSingle(inode);
+        if (location == -1)
+            return -1;
+
+        off_t fragLocation = inode->getInternalFragLocation(fragAmount, location);
+        if (writeBlock(&written, cursor, fragAmount, fragLocation) == -1)
+            return -1;
+
         inode->addFileSize(written);
     }
 
-    if (inode->getBlocksInSingleInDirect() >= blockSize)
+    if (inode->getBlocksInSingleInDirect() >= inode->getFanout())
         return 0; // Not finished but also no space in single
 
-    if (strlen(buf) <= 0) // Nothing to write
+    if (cursor.remaining <= 0) // Nothing to write
         return 1;
 
-    if (inode->getSingleInDirect() == -1 && blocksUsed + 1 >= DISK_SIZE / blockSize) // No space for data
+    if (inode->getSingleInDirect() == -1 && getFreeBlocksCount() <= 1) // No space for data
         return 0;
 
     int isFirst = (inode-> getSingleInDirect() == -1) ? blockSize : 0;
-    if (currentDiskSize + isFirst + blockSize > DISK_SIZE) // No space on the DISK_SIZE
+    if (currentDiskSize + isFirst + blockSize > diskSize) // No space on the disk
         return 1;
 
     int index;
 
     if (inode->getSingleInDirect() == -1)
     {
-        index = writeSingle(buf, inode, -1);
+        index = writeSingle(cursor, inode);
 
         if (index == -1)
             return -1;
@@ -242,7 +588,7 @@ int fsDisk::writeSingleInDirect(char*& buf, fsInode* inode)
 
     else
     {
-        index = writeBlock(&written, buf, blockSize, -1);
+        index = writeBlock(&written, cursor, blockSize, -1);
 
         if (index == -1)
             return -1;
@@ -250,8 +596,9 @@ int fsDisk::writeSingleInDirect(char*& buf, fsInode* inode)
         inode->addFileSize(written);
 
 
-        int singleLocation = inode->getSingleInDirect() * blockSize + inode->getBlocksInSingleInDirect();
-        index = writeLocation(decToBinaryChar(index), singleLocation); // Write the location of the fresh written block
+        off_t singleLocation = static_cast<off_t>(inode->getSingleInDirect()) * blockSize
+                               + static_cast<off_t>(inode->getBlocksInSingleInDirect()) * POINTER_SIZE;
+        index = writePointer(index, singleLocation); // Write the location of the fresh written block
 
         if (index == -1)
             return -1;
@@ -260,79 +607,74 @@ int fsDisk::writeSingleInDirect(char*& buf, fsInode* inode)
 
     }
 
-    inode->addBlocksInSingleInDirect(1);
     inode->addBlockInUse(1);
     return 2; // Finished but unknown need more
 }
 
-int fsDisk::writeDoubleInDirect(char*& buf, fsInode* inode)
+int fsDisk::writeDoubleInDirect(WriteCursor& cursor, fsInode* inode)
 {
     int fragAmount = inode->getInternalFragAmount(3);
     int index;
     int written;
 
-    if (fragAmount != 0 && strlen(buf) > 0)
+    if (fragAmount != 0 && cursor.remaining > 0)
     {
-        int lastSingle = inode->getSingleBlockLocation(inode->getSingleBlocksCount() - 1);
-        int location = getLastBlockInSingle(lastSingle, inode->getBlocksInEachSingle(inode->getSingleBlocksCount() - 1));
-        int fragLocation = inode->getInternalFragLocation(fragAmount, location);
+        off_t lastSingle = static_cast<off_t>(getLastSingleInDouble(inode)) * blockSize;
+        off_t location = getLastBlockInSingle(lastSingle, inode->getBlocksInEachSingle(inode->getSingleBlocksCount() - 1));
+        if (location == -1)
+            return -1;
+
+        off_t fragLocation = inode->getInternalFragLocation(fragAmount, location);
+        if (writeBlock(&written, cursor, fragAmount, fragLocation) == -1)
+            return -1;
 
-        writeBlock(&written, buf, fragAmount, fragLocation);
         inode->addFileSize(written);
     }
 
-    if (strlen(buf) <= 0) // Nothing to write
+    if (cursor.remaining <= 0) // Nothing to write
         return 1;
 
     if (inode->isSpace()) // inode is full
         return 1;
 
 
-    if (inode->getSingleBlocksCount() > blockSize)
-        return 0; // Not finished but also no space in doubleInDirect
-
 
-    if (inode->getDoubleInDirect() == -1 &&  2*blockSize + currentDiskSize > DISK_SIZE)
+    if (inode->getDoubleInDirect() == -1 &&  2*blockSize + currentDiskSize > diskSize)
         return 0; // No space on the disk to create new doubleInDirect
 
 
     // First doubleInDirect
     if (inode->getDoubleInDirect() == -1)
     {
-        index = getFreeDiskSpace();
-        if (index == -1)
+        if (getFreeBlocksCount() <= 2) // No space for data
             return -1;
 
-        if (blocksUsed + 2 >= DISK_SIZE / blockSize) // No space for data
+        index = allocateBlock(cursor.group);
+        if (index == -1)
             return -1;
 
-        BitVector[index] = 1;
-        blocksUsed++;
         inode->setDoubleInDirect(index);
 
-        int singleIndex = writeSingle(buf, inode, -1);
+        int singleIndex = writeSingle(cursor, inode);
         if (singleIndex == -1)
             return -1;
 
         // Write the new single block under the doubleInDirect
-        writeLocation(decToBinaryChar(singleIndex), index * blockSize);
+        writePointer(singleIndex, static_cast<off_t>(index) * blockSize);
 
-        inode->addSingleBlocksCount(1); // Double has one more singleInDirect
-        inode->addBlocksInEachSingle(0, 1); // singleInDirect of doubleInDirect has one more block
-        inode->setSingleBlockLocation(0, singleIndex * blockSize); // First singleInDirect location of the doubleInDirect
-        inode->addBlockInUse(1);
+        inode->addBlockInUse(1); // The doubleInDirect now has one single with one block
 
         return 2; // Finished
     }
 
 
-    if (blockSize + currentDiskSize > DISK_SIZE)
+    if (blockSize + currentDiskSize > diskSize)
         return 0; // No space on the disk to create new block
 
     int blocksAmountInLastSingle = inode->getBlocksInEachSingle(inode->getSingleBlocksCount() - 1);
-    if (blocksAmountInLastSingle < blockSize) // If the last single is not full
+    if (blocksAmountInLastSingle < inode->getFanout()) // If the last single is not full
     {
-        index = writeBlock(&written, buf, blockSize, -1);
+        index = writeBlock(&written, cursor, blockSize, -1);
 
         if (index == -1)
             return -1;
@@ -340,593 +682,2468 @@ int fsDisk::writeDoubleInDirect(char*& buf, fsInode* inode)
         inode->addFileSize(written);
 
 
-        int singleLocation = inode->getSingleBlockLocation(inode->getSingleBlocksCount() - 1) + blocksAmountInLastSingle;
-        index = writeLocation(decToBinaryChar(index), singleLocation);
+        int lastSingle = getLastSingleInDouble(inode);
+        if (lastSingle == -1)
+            return -1;
+
+        off_t singleLocation = static_cast<off_t>(lastSingle) * blockSize
+                               + static_cast<off_t>(blocksAmountInLastSingle) * POINTER_SIZE;
+        index = writePointer(index, singleLocation);
 
         if (index == -1)
             return -1;
 
-        inode->addBlockInUse(1);
-        inode->addBlocksInEachSingle(inode->getSingleBlocksCount() - 1, 1); // singleInDirect of doubleInDirect has one more block
+        inode->addBlockInUse(1); // The last single of the doubleInDirect has one more block
 
         return 2;
     }
 
 
-    if (2*blockSize + currentDiskSize > DISK_SIZE)
-        return 0; // No space on the disk to create new single
+    if (inode->getSingleBlocksCount() >= inode->getFanout())
+        return 0; // Not finished but also no space in doubleInDirect
 
-    // Continue to create a new single
-    if (blocksUsed + 1 >= DISK_SIZE / blockSize) // No space for data
-        return -1;
+    if (2*blockSize + currentDiskSize > diskSize)
+        return 0; // No space on the disk to create new single
 
-    int singleIndex = writeSingle(buf, inode, -1);
+    // Continue to create a new single, writeSingle gives it back if no block is left for the data
+    int singleIndex = writeSingle(cursor, inode);
     if (singleIndex == -1)
         return -1;
 
     // Write the new single block under the doubleInDirect
-    int writeIndex = inode->getDoubleInDirect() * blockSize + inode->getSingleBlocksCount();
-    writeLocation(decToBinaryChar(singleIndex), writeIndex);
+    off_t writeIndex = static_cast<off_t>(inode->getDoubleInDirect()) * blockSize
+                       + static_cast<off_t>(inode->getSingleBlocksCount()) * POINTER_SIZE;
+    writePointer(singleIndex, writeIndex);
 
-    inode->addSingleBlocksCount(1); // Double has one more singleInDirect
-    inode->addBlocksInEachSingle(inode->getSingleBlocksCount() - 1, 1); // singleInDirect of doubleInDirect has one more block
-    inode->setSingleBlockLocation(inode->getSingleBlocksCount() - 1, singleIndex * blockSize); // First singleInDirect location of the doubleInDirect
-    inode->addBlockInUse(1);
+    inode->addBlockInUse(1); // The doubleInDirect has one more single, with one block
 
     return 2; // Finished
 }
 
-
-bool fsDisk::isStringOnlySpaces(const string &str)
+int fsDisk::writeTripleInDirect(WriteCursor& cursor, fsInode* inode)
 {
-    for (char c : str)
-        if (c != ' ' && c != '\t' && c != '\n' && c != '\r')
-            // If any non-space character is found, return false.
-            return false;
+    int written;
+    int fragAmount = inode->getInternalFragAmount(4);
 
-    // If the loop completes without finding any non-space character, return true.
-    return true;
-}
+    if (fragAmount != 0 && cursor.remaining > 0)
+    {
+        int last = getFileBlock(inode, inode->getBlockInUse() - 1);
+        if (last == -1)
+            return -1;
 
-bool fsDisk::deleteFromMainDir(const string& name, bool reduceDiskSize)
-{
-    if (!isInMap(name))
-        return false; // File not found
+        if (writeBlock(&written, cursor, fragAmount, static_cast<off_t>(last) * blockSize + (blockSize - fragAmount)) == -1)
+            return -1;
 
-    auto it = MainDir.find(name);
+        inode->addFileSize(written);
+    }
 
-    if (reduceDiskSize)
+    if (cursor.remaining <= 0) // Nothing to write
+        return 1;
+
+    if (inode->isSpace()) // inode is full
+        return 1;
+
+    // Where the new block goes: which double under the triple, which single under that double, which pointer
+    long long fanout = inode->getFanout();
+    long long index = inode->getBlocksInTripleInDirect();
+    int slot = static_cast<int>(index % fanout);
+    int singleSlot = static_cast<int>((index / fanout) % fanout);
+    int doubleSlot = static_cast<int>(index / (fanout * fanout));
+
+    bool newSingle = (slot == 0);
+    bool newDouble = newSingle && singleSlot == 0;
+    bool newTriple = (inode->getTripleInDirect() == -1);
+    if (currentDiskSize + blockSize > diskSize)
+        return 1; // No space on the disk for the block
+
+    // The new pointer blocks and the data block are claimed before anything is linked, in that order.
+    // A failed claim means the disk is full: the blocks claimed so far are given back and the inode is untouched
+    int claimed[4];
+    int needed = 1 + newTriple + newDouble + newSingle;
+    for (int i = 0; i < needed; i++)
     {
-        currentDiskSize -= it->second->getFileSize();
-        it->second->addFileSize(-it->second->getFileSize());
+        claimed[i] = allocateBlock(cursor.group);
+        if (claimed[i] == -1)
+        {
+            while (i-- > 0)
+                releaseBlock(claimed[i]);
+
+            return 1; // No space on the disk for the block and the pointer blocks it needs
+        }
     }
 
-    deletedFiles.push_back(it->second);
-    MainDir.erase(it); // Erase the key-value pair from the map.
-    return true; // Return true to indicate success.
-}
+    int next = 0;
+    if (newTriple)
+        inode->setTripleInDirect(claimed[next++]);
 
-int fsDisk::makeRead(int len, char*& buf, int buf_index)
-{
-    int amountToRead;
-    char* text = new char[blockSize];
+    off_t doubleLocation = static_cast<off_t>(inode->getTripleInDirect()) * blockSize + static_cast<off_t>(doubleSlot) * POINTER_SIZE;
+    int doubleIndex = newDouble ? claimed[next++] : readPointer(doubleLocation);
+    if (doubleIndex == -1 || (newDouble && writePointer(doubleIndex, doubleLocation) == -1))
+        return -1;
 
-    len > blockSize ? amountToRead = blockSize : amountToRead = len;
+    off_t singleLocation = static_cast<off_t>(doubleIndex) * blockSize + static_cast<off_t>(singleSlot) * POINTER_SIZE;
+    int singleIndex = newSingle ? claimed[next++] : readPointer(singleLocation);
+    if (singleIndex == -1 || (newSingle && writePointer(singleIndex, singleLocation) == -1))
+        return -1;
 
-    fread(text, 1, amountToRead, sim_disk_fd);
+    int block = claimed[next];
+    if (writeBlock(&written, cursor, blockSize, static_cast<off_t>(block) * blockSize) == -1)
+    {
+        releaseBlock(block);
+        return -1;
+    }
 
-    // Copy the read data from 'text' to 'buf' at the correct position
-    memcpy(buf + buf_index, text, amountToRead);
+    inode->addFileSize(written);
 
-    // Update the buffer index for the next iteration
-    buf_index += amountToRead;
+    if (writePointer(block, static_cast<off_t>(singleIndex) * blockSize + static_cast<off_t>(slot) * POINTER_SIZE) == -1)
+        return -1;
 
-    delete[] text;
+    inode->addBlockInUse(1);
+    return 2; // Finished but unknown need more
+}
 
-    // return the read amount
-    return amountToRead;
+int fsDisk::getLastSingleInDouble(fsInode* inode)
+{
+    return readPointer(static_cast<off_t>(inode->getDoubleInDirect()) * blockSize
+                       + static_cast<off_t>(inode->getSingleBlocksCount() - 1) * POINTER_SIZE);
 }
 
-int fsDisk::readSingleInDirect(int *len, char*& buf, int *buf_index, int singleAddress, int blocksAmount, bool isIndex)
+int fsDisk::collectDoubleSingles(fsInode* inode, vector<pair<int, int>>& singles)
 {
+    int count = inode->getSingleBlocksCount();
+    if (inode->getDoubleInDirect() == -1 || count == 0)
+        return 1;
 
-    char* pointers = new char[blockSize];
-    int readBytes;
+    vector<char> pointers(blockSize);
+    if (readDisk(pointers.data(), blockSize, static_cast<off_t>(inode->getDoubleInDirect()) * blockSize) == -1)
+        return -1;
 
-    if(isIndex)
-        singleAddress *= blockSize;
+    for (int i = 0; i < count; i++)
+        singles.push_back({decodePointer(pointers.data() + i * POINTER_SIZE), inode->getBlocksInEachSingle(i)});
 
+    return 1;
+}
 
-    // Read the singleInDirect pointers
-    if (fseek(sim_disk_fd, singleAddress, SEEK_SET) != 0)
-    {
-        delete[] pointers;
-        return -1;
-    }
+int fsDisk::collectTripleSingles(fsInode* inode, vector<pair<int, int>>& singles, vector<int>* doubles)
+{
+    long long fanout = inode->getFanout();
+    long long blocks = inode->getBlocksInTripleInDirect();
 
-    fread(pointers, 1, blockSize, sim_disk_fd);
+    if (inode->getTripleInDirect() == -1 || blocks == 0)
+        return 1;
 
+    vector<char> triple(blockSize);
+    vector<char> pointers(blockSize);
+    if (readDisk(triple.data(), blockSize, static_cast<off_t>(inode->getTripleInDirect()) * blockSize) == -1)
+        return -1;
 
-    for(int i = 0 ; i < blocksAmount ; i++)
+    // Every double and single but the last ones is full, files only grow at their end
+    for (int i = 0; blocks > 0; i++)
     {
+        int doubleIndex = decodePointer(triple.data() + i * POINTER_SIZE);
+        if (doubles != nullptr)
+            doubles->push_back(doubleIndex);
 
-        int location = static_cast<int>(pointers[i]);
+        if (readDisk(pointers.data(), blockSize, static_cast<off_t>(doubleIndex) * blockSize) == -1)
+            return -1;
 
-        if (fseek(sim_disk_fd, location * blockSize, SEEK_SET) != 0)
+        for (int j = 0; j < fanout && blocks > 0; j++)
         {
-            delete[] pointers;
-            return -1;
+            int amount = static_cast<int>(min(blocks, fanout));
+            singles.push_back({decodePointer(pointers.data() + j * POINTER_SIZE), amount});
+            blocks -= amount;
         }
+    }
 
-        // Update len to the remaining length of data to be read
-        readBytes = makeRead(*len, buf, *buf_index);
-        *buf_index += readBytes;
-        *len -= readBytes;
+    return 1;
+}
+
+bool fsDisk::isStringOnlySpaces(const string &str)
+{
+    for (char c : str)
+        if (c != ' ' && c != '\t' && c != '\n' && c != '\r')
+            // If any non-space character is found, return false.
+            return false;
+
+    // If the loop completes without finding any non-space character, return true.
+    return true;
+}
+
+bool fsDisk::deleteFromMainDir(int id, bool reduceDiskSize)
+{
+    fsInode* inode = getInode(id);
+    if (inode == nullptr)
+        return false;
+
+    if (reduceDiskSize)
+    {
+        changeDiskSize(-inode->getFileSize());
+        inode->addFileSize(-inode->getFileSize());
     }
 
-    delete[] pointers;
+    if (journal->isActive())
+        journal->logDelete(MainDir.getName(id));
+
+    // No descriptor holds a deleted file's inode, so its slot is reused right away
+    inodeSlab.release(inode);
+    residentInodes.erase(MainDir.get(id).lru);
+    MainDir.erase(id); // Erase the entry from the directory.
+    return true; // Return true to indicate success.
+}
+
+string_view fsDisk::canonicalPath(string_view path)
+{
+    // Paths start at the root directory, with or without a leading slash
+    if (!path.empty() && path[0] == '/')
+        path.remove_prefix(1);
+
+    return path;
+}
+
+string_view fsDisk::parentPath(string_view path)
+{
+    size_t slash = path.rfind('/');
+    return (slash == string_view::npos) ? string_view() : path.substr(0, slash);
+}
+
+string_view fsDisk::leafName(string_view path)
+{
+    size_t slash = path.rfind('/');
+    return (slash == string_view::npos) ? path : path.substr(slash + 1);
+}
+
+int fsDisk::lookupPath(string_view path, int* parent)
+{
+    *parent = -1;
+    if (path.empty())
+        return rootId;
+
+    // Every component must be a name
+    for (size_t start = 0; start <= path.size(); )
+    {
+        size_t end = min(path.find('/', start), path.size());
+        string_view name = path.substr(start, end - start);
+        if (name.empty() || name == "." || name == "..")
+            return -1;
+
+        start = end + 1;
+    }
+
+    // The directories above an entry exist as long as it does, so an existing path takes a single probe
+    // and its entry knows its parent. Otherwise only the parent is probed, it must be a directory
+    int id = MainDir.find(path);
+    if (id != -1)
+    {
+        *parent = MainDir.get(id).parent;
+        return id;
+    }
+
+    string_view dirPath = parentPath(path);
+    int dir = dirPath.empty() ? rootId : MainDir.find(dirPath);
+    if (dir != -1 && isDirectory(dir))
+        *parent = dir;
+
+    return -1;
+}
+
+bool fsDisk::isDirectory(int id)
+{
+    return MainDir.get(id).type == INODE_DIRECTORY;
+}
+
+int fsDisk::createEntry(string_view path, int parent, InodeType type)
+{
+    // The name goes into the parent first, so a full disk leaves no entry behind
+    string_view name = leafName(path);
+    if (linkEntry(parent, name) == -1)
+        return -1;
+
+    int id = MainDir.insert(path).first;
+    insertInode(id, inodeSlab.allocate(type));
+    MainDir.get(id).parent = parent;
+    touchFile(MainDir.getName(id));
+
+    if (parent == rootId)
+        rootEntries.insert(id);
+
+    return id;
+}
+
+int fsDisk::detachEntry(int id)
+{
+    int parent = MainDir.get(id).parent;
+    if (parent == -1 || unlinkEntry(parent, leafName(MainDir.getName(id))) == -1)
+        return -1;
+
+    rootEntries.erase(id);
     return 1;
 }
 
+int fsDisk::decodeRecord(const string& data, size_t* pos, string_view* name)
+{
+    uint32_t header;
+    if (*pos + DIRENT_HEADER_SIZE > data.size())
+        return -1;
+
+    memcpy(&header, &data[*pos], DIRENT_HEADER_SIZE);
+    size_t length = header & ~DIRENT_DELETED;
+    if (*pos + DIRENT_HEADER_SIZE + length > data.size())
+        return -1;
+
+    *name = string_view(data).substr(*pos + DIRENT_HEADER_SIZE, length);
+    *pos += DIRENT_HEADER_SIZE + length;
+    return (header & DIRENT_DELETED) ? 0 : 1;
+}
+
+bool fsDisk::hasRoomFor(int len)
+{
+    // A partly written record would hide the records after it, so records are only written when they
+    // surely fit: every new block may take a single and a double indirect block along, besides the roots
+    int blocks = len / blockSize + 2;
+    return getFreeBlocksCount() >= 3 * blocks + 3;
+}
+
+int fsDisk::readDirectory(int dir, string& data)
+{
+    fsInode* inode = getInode(dir);
+    if (inode == nullptr || inode->getFileSize() > INT_MAX)
+        return -1;
 
+    data.resize(inode->getFileSize());
+    int len = static_cast<int>(data.size());
+    return (readFromInode(inode, data.data(), len, 0) == len) ? 1 : -1;
+}
 
-bool fsDisk::deleteSingleBlock(int singleLocation, int blocksAmount)
+int fsDisk::listDirectory(int dir, vector<int>& ids)
 {
-    int blockLocation;
-    int currentSingleBlocksAmount = blocksAmount;
+    if (dir == rootId)
+    {
+        ids.insert(ids.end(), rootEntries.begin(), rootEntries.end());
+        return 1;
+    }
 
-    // Delete the singleInDirect blocks
-    for (int i = 0 ; i < blocksAmount ; i++ )
+    string data;
+    if (readDirectory(dir, data) == -1)
+        return -1;
+
+    // A record written back before its operation was committed may outlive a crash,
+    // so only the names that resolve are listed
+    const string& path = MainDir.getName(dir);
+    string childPath;
+    string_view name;
+    size_t pos = 0;
+    int live;
+    while ((live = decodeRecord(data, &pos, &name)) != -1)
     {
-        blockLocation = getLastBlockInSingle(singleLocation, currentSingleBlocksAmount);
+        if (live == 0)
+            continue;
 
-        BitVector[blockLocation / blockSize] = 0;
-        blocksUsed--;
-        currentSingleBlocksAmount--;
+        childPath.assign(path).append(path.empty() ? "" : "/").append(name);
+        int child = MainDir.find(childPath);
+        if (child != -1)
+            ids.push_back(child);
     }
 
+    return 1;
+}
 
-    BitVector[singleLocation / blockSize] = 0;
-    blocksUsed--;
+int fsDisk::collectSubtree(int dir, vector<int>& ids)
+{
+    size_t first = ids.size();
+    if (listDirectory(dir, ids) == -1)
+        return -1;
 
-    return true;
+    for (size_t i = first, end = ids.size(); i < end; i++)
+        if (isDirectory(ids[i]) && collectSubtree(ids[i], ids) == -1)
+            return -1;
+
+    return 1;
 }
 
+int fsDisk::linkEntry(int dir, string_view name)
+{
+    if (dir == rootId)
+        return 1; // Kept in rootEntries
 
-int fsDisk::deleteBlocks(fsInode* inode)
+    fsInode* inode = getInode(dir);
+    uint32_t header = static_cast<uint32_t>(name.size());
+    int len = DIRENT_HEADER_SIZE + static_cast<int>(name.size());
+    if (inode == nullptr || !hasRoomFor(len))
+        return -1;
+
+    iovec iov[2] = {{&header, DIRENT_HEADER_SIZE}, {const_cast<char*>(name.data()), name.size()}};
+    return (appendToInode(MainDir.getName(dir), inode, iov, len) == len) ? 1 : -1;
+}
+
+int fsDisk::unlinkEntry(int dir, string_view name)
 {
-    int blockLocation;
-    int max;
-    int amountOfBlocks = inode->getBlockInUse();
-    // Delete the direct blocks
-    max = AMOUNT_OF_DIRECT < amountOfBlocks ? AMOUNT_OF_DIRECT : amountOfBlocks; // Max loop iterations
-    for (int i = 1; i <= max; i++)
+    if (dir == rootId)
+        return 1; // Kept in rootEntries
+
+    string data;
+    if (readDirectory(dir, data) == -1)
+        return -1;
+
+    size_t record = string::npos;
+    size_t liveBytes = 0;
+    string_view entryName;
+    size_t pos = 0;
+    for (size_t start = 0; ; start = pos)
     {
-        blockLocation = inode->getDirectBlock(i);
+        int live = decodeRecord(data, &pos, &entryName);
+        if (live == -1)
+            break;
+
+        if (live == 1 && record == string::npos && entryName == name)
+            record = start;
+        else if (live == 1)
+            liveBytes += pos - start;
+    }
+
+    if (record == string::npos)
+        return 1; // Nothing to remove
+
+    // Once removed records take most of the file, it's written again with the live records only
+    if (liveBytes * 2 < data.size() && hasRoomFor(static_cast<int>(liveBytes)))
+        return rewriteDirectory(dir, data, record);
+
+    // Otherwise the record is only marked as removed
+    uint32_t header = DIRENT_DELETED | static_cast<uint32_t>(name.size());
+    fsInode* inode = getInode(dir);
+    if (inode == nullptr || overwriteInode(inode, reinterpret_cast<const char*>(&header), DIRENT_HEADER_SIZE, record) != DIRENT_HEADER_SIZE)
+        return -1;
+
+    return 1;
+}
+
+int fsDisk::rewriteDirectory(int dir, const string& data, size_t skip)
+{
+    string records;
+    string_view name;
+    size_t pos = 0;
+    for (size_t start = 0; ; start = pos)
+    {
+        int live = decodeRecord(data, &pos, &name);
+        if (live == -1)
+            break;
 
-        BitVector[blockLocation] = 0; // Mark the block as free
-        blocksUsed--;
+        if (live == 1 && start != skip)
+            records.append(data, start, pos - start);
     }
 
-    amountOfBlocks -= max;
+    fsInode* inode = getInode(dir);
+    if (inode == nullptr)
+        return -1;
 
+    // Free the old blocks and start the directory over with an empty inode
+    deleteBlocks(inode);
+    DirEntry& entry = MainDir.get(dir);
+    inodeSlab.release(inode);
+    entry.inode = inodeSlab.allocate(INODE_DIRECTORY);
+    entry.dirty = true;
+    touchFile(MainDir.getName(dir));
 
-    // Delete single indirect blocks
-    if (inode->getSingleInDirect() != -1)
+    if (records.empty())
+        return 1;
+
+    int len = static_cast<int>(records.size());
+    iovec iov = {records.data(), records.size()};
+    return (appendToInode(MainDir.getName(dir), entry.inode, &iov, len) == len) ? 1 : -1;
+}
+
+int fsDisk::makeRead(int len, char*& buf, int buf_index, off_t location)
+{
+    int amountToRead;
+
+    len > blockSize ? amountToRead = blockSize : amountToRead = len;
+
+    // Read straight into 'buf' at the correct position
+    if (amountToRead > 0 && readDisk(buf + buf_index, amountToRead, location) == -1)
+        return -1;
+
+    // return the read amount
+    return amountToRead;
+}
+
+int fsDisk::readSingleInDirect(int *len, char*& buf, int *buf_index, off_t singleAddress, int blocksAmount, bool isIndex)
+{
+
+    char* pointers = new char[blockSize];
+    int readBytes;
+
+    if(isIndex)
+        singleAddress *= blockSize;
+
+
+    // Read the singleInDirect pointers
+    if (readDisk(pointers, blockSize, singleAddress) == -1)
     {
-        amountOfBlocks -= inode->getBlocksInSingleInDirect();
-        deleteSingleBlock(inode->getSingleInDirect() * blockSize, inode->getBlocksInSingleInDirect());
+        delete[] pointers;
+        return -1;
     }
 
 
-    // Delete double indirect blocks
-    if (inode->getDoubleInDirect() != -1)
+    for(int i = 0 ; i < blocksAmount ; i++)
+    {
+
+        int location = decodePointer(pointers + i * POINTER_SIZE);
+
+        // Update len to the remaining length of data to be read
+        readBytes = makeRead(*len, buf, *buf_index, static_cast<off_t>(location) * blockSize);
+        if (readBytes == -1)
+        {
+            delete[] pointers;
+            return -1;
+        }
+
+        *buf_index += readBytes;
+        *len -= readBytes;
+    }
+
+    delete[] pointers;
+    return 1;
+}
+
+
+
+int fsDisk::collectBlocks(fsInode* inode, int blocksToRead, vector<int>& blocks)
+{
+    if (inode->getFormat() == INODE_EXTENTS)
     {
-        for (int i = 0; i < amountOfBlocks; i++)
-            deleteSingleBlock(inode->getSingleBlockLocation(i), inode->getBlocksInEachSingle(i));
+        vector<pair<int, int>> extents;
+        if (collectExtents(inode, extents, nullptr) == -1)
+            return -1;
+
+        for (size_t i = 0; i < extents.size() && blocksToRead > 0; i++)
+            for (int j = 0; j < extents[i].second && blocksToRead > 0; j++, blocksToRead--)
+                blocks.push_back(extents[i].first + j);
 
-        BitVector[inode->getDoubleInDirect()] = 0; // Mark the doubleInDirect as free
-        blocksUsed--;
+        return 1;
     }
 
+    // Direct blocks
+    for (int i = 1; i <= AMOUNT_OF_DIRECT && blocksToRead > 0 && inode->getDirectBlock(i) != -1; i++, blocksToRead--)
+        blocks.push_back(inode->getDirectBlock(i));
 
-    currentDiskSize -= inode->getFileSize();
-    inode->addFileSize(-inode->getFileSize());
-    return 1; // Successful block deletion
+    // singleInDirect, then each singleInDirect of the doubleInDirect, then those under the tripleInDirect
+    vector<pair<int, int>> singles;
+    singles.push_back({inode->getSingleInDirect(), inode->getBlocksInSingleInDirect()});
+    if (collectDoubleSingles(inode, singles) == -1)
+        return -1;
+
+    if (collectTripleSingles(inode, singles, nullptr) == -1)
+        return -1;
+
+    char* pointers = new char[blockSize];
+
+    for (size_t single = 0; single < singles.size() && blocksToRead > 0; single++)
+    {
+        off_t singleAddress = static_cast<off_t>(singles[single].first) * blockSize;
+        int blocksAmount = singles[single].second;
+
+        if (singleAddress < 0 || blocksAmount <= 0)
+            continue;
+
+        if (readDisk(pointers, blockSize, singleAddress) == -1)
+        {
+            delete[] pointers;
+            return -1;
+        }
+
+        for (int i = 0; i < blocksAmount && blocksToRead > 0; i++, blocksToRead--)
+            blocks.push_back(decodePointer(pointers + i * POINTER_SIZE));
+    }
+
+    delete[] pointers;
+    return 1;
 }
 
-int fsDisk::countUsedBlocks(fsInode* inode)
+int fsDisk::getFileBlock(fsInode* inode, int index, int* run)
 {
-    int requiredBlocks = inode->getBlockInUse();
+    if (index < 0 || index >= inode->getBlockInUse())
+        return -1;
 
-    if (inode->getSingleInDirect() != -1)
-        requiredBlocks++;
+    if (inode->getFormat() == INODE_EXTENTS)
+    {
+        vector<pair<int, int>> entries(inode->getExtentCount());
+        for (size_t i = 0; i < entries.size(); i++)
+            inode->getExtent(static_cast<int>(i), &entries[i].first, &entries[i].second);
 
-    if (inode->getDoubleInDirect() != -1)
+        // Down the tree, skipping the entries that cover the blocks before 'index' on each level
+        for (int height = inode->getExtentDepth(); ; height--)
+        {
+            size_t i = 0;
+            while (i < entries.size() && index >= entries[i].second)
+                index -= entries[i++].second;
+
+            if (i == entries.size())
+                return -1;
+
+            if (height == 0)
+            {
+                if (run != nullptr)
+                    *run = entries[i].second - index;
+
+                return entries[i].first + index;
+            }
+
+            ExtentNode node;
+            if (readExtentNode(entries[i].first, node) == -1)
+                return -1;
+
+            entries = node.entries;
+        }
+    }
+
+    if (run != nullptr)
+        *run = 1;
+
+    if (index < AMOUNT_OF_DIRECT)
+        return inode->getDirectBlock(index + 1);
+
+    index -= AMOUNT_OF_DIRECT;
+    int fanout = inode->getFanout();
+
+    if (index < fanout) // Under the singleInDirect
+        return readPointer(static_cast<off_t>(inode->getSingleInDirect()) * blockSize + static_cast<off_t>(index) * POINTER_SIZE);
+
+    // Under the doubleInDirect, a pointer read per level
+    index -= fanout;
+    if (index < static_cast<long long>(fanout) * fanout)
+    {
+        int single = readPointer(static_cast<off_t>(inode->getDoubleInDirect()) * blockSize
+                                 + static_cast<off_t>(index / fanout) * POINTER_SIZE);
+        if (single == -1)
+            return -1;
+
+        return readPointer(static_cast<off_t>(single) * blockSize + static_cast<off_t>(index % fanout) * POINTER_SIZE);
+    }
+
+    // Under the tripleInDirect, a pointer read per level
+    long long tripleIndex = index - static_cast<long long>(fanout) * fanout;
+    int doubleIndex = readPointer(static_cast<off_t>(inode->getTripleInDirect()) * blockSize
+                                  + static_cast<off_t>(tripleIndex / fanout / fanout) * POINTER_SIZE);
+    if (doubleIndex == -1)
+        return -1;
+
+    int single = readPointer(static_cast<off_t>(doubleIndex) * blockSize + static_cast<off_t>(tripleIndex / fanout % fanout) * POINTER_SIZE);
+    if (single == -1)
+        return -1;
+
+    return readPointer(static_cast<off_t>(single) * blockSize + static_cast<off_t>(tripleIndex % fanout) * POINTER_SIZE);
+}
+
+int fsDisk::writeExtents(WriteCursor& cursor, fsInode* inode)
+{
+    int goal = -1;
+
+    if (inode->getBlockInUse() > 0)
+    {
+        int last = getFileBlock(inode, inode->getBlockInUse() - 1);
+        if (last == -1)
+            return -1;
+
+        // The file grows best right after its last block
+        goal = last + 1;
+
+        // Fill the unused tail of the last block first
+        int fragAmount = static_cast<int>(static_cast<off_t>(inode->getBlockInUse()) * blockSize - inode->getFileSize());
+        int amount = min(fragAmount, cursor.remaining);
+        if (amount > 0)
+        {
+            if (writeFromCursor(cursor, amount, static_cast<off_t>(last) * blockSize + (blockSize - fragAmount)) == -1)
+                return -1;
+
+            changeDiskSize(amount);
+            inode->addFileSize(amount);
+        }
+    }
+
+    while (cursor.remaining > 0)
+    {
+        // As many blocks as the data needs, as long as the block count stays an int
+        long long wanted = (cursor.remaining + static_cast<long long>(blockSize) - 1) / blockSize;
+        wanted = min<long long>(wanted, INT_MAX - inode->getBlockInUse());
+        if (wanted == 0)
+            return 1; // The file is full
+
+        int count;
+        int start = allocateRun(goal, static_cast<int>(wanted), cursor.group, &count);
+        if (start == -1)
+            return 1; // The disk is full
+
+        // The whole run is written with one disk write per buffer
+        int amount = static_cast<int>(min<long long>(cursor.remaining, static_cast<long long>(count) * blockSize));
+        int added = -1;
+        if (writeFromCursor(cursor, amount, static_cast<off_t>(start) * blockSize) == -1 ||
+            (added = appendExtent(inode, start, count, cursor.group)) != 1)
+        {
+            for (int i = 0; i < count; i++)
+                releaseBlock(start + i);
+
+            return (added == 0) ? 1 : -1; // A full extent tree leaves the file full
+        }
+
+        changeDiskSize(amount);
+        inode->addFileSize(amount);
+        inode->addBlockInUse(count);
+        goal = start + count;
+    }
+
+    return 1;
+}
+
+int fsDisk::appendExtent(fsInode* inode, int start, int count, int group)
+{
+    int entries = inode->getExtentCount();
+    int depth = inode->getExtentDepth();
+    int lastStart = -1;
+    int lastLength = 0;
+
+    if (entries > 0)
+        inode->getExtent(entries - 1, &lastStart, &lastLength);
+
+    if (depth == 0)
+    {
+        // A run right after the last extent just makes it longer
+        if (entries > 0 && lastStart + lastLength == start)
+        {
+            inode->setExtent(entries - 1, lastStart, lastLength + count);
+            return 1;
+        }
+
+        if (entries < INLINE_EXTENTS)
+        {
+            inode->setExtent(entries, start, count);
+            inode->setExtentCount(entries + 1);
+            return 1;
+        }
+    }
+    else
+    {
+        int ret = appendToExtentNode(inode, lastStart, start, count, group);
+        if (ret != 0)
+        {
+            if (ret == 1)
+                inode->setExtent(entries - 1, lastStart, lastLength + count);
+
+            return ret;
+        }
+
+        if (entries < INLINE_EXTENTS)
+        {
+            int branch = newExtentBranch(inode, depth - 1, start, count, group);
+            if (branch == -1)
+                return -1;
+
+            inode->setExtent(entries, branch, count);
+            inode->setExtentCount(entries + 1);
+            return 1;
+        }
+    }
+
+    if (depth == EXTENT_MAX_DEPTH)
+        return 0;
+
+    // The inline entries are full: move them to a new node, the inode then points at that node alone
+    int node = allocateBlock(group);
+    if (node == -1)
+        return -1;
+
+    inode->addTreeBlocks(1);
+    int covered = 0;
+    for (int i = 0; i < entries; i++)
+    {
+        int first;
+        int second;
+        inode->getExtent(i, &first, &second);
+        covered += second;
+
+        if (writeExtentEntry(node, i, first, second) == -1)
+            return -1;
+    }
+
+    if (writeExtentHeader(node, entries, depth) == -1)
+        return -1;
+
+    for (int i = 1; i < INLINE_EXTENTS; i++)
+        inode->setExtent(i, -1, 0);
+
+    inode->setExtent(0, node, covered);
+    inode->setExtentCount(1);
+    inode->setExtentDepth(depth + 1);
+
+    return appendExtent(inode, start, count, group);
+}
+
+int fsDisk::appendToExtentNode(fsInode* inode, int node, int start, int count, int group)
+{
+    ExtentNode content;
+    if (readExtentNode(node, content) == -1 || content.entries.empty())
+        return -1;
+
+    int entries = static_cast<int>(content.entries.size());
+    int capacity = (blockSize - EXTENT_HEADER_SIZE) / EXTENT_SIZE;
+    pair<int, int> last = content.entries.back();
+
+    if (content.height == 0)
+    {
+        if (last.first + last.second == start)
+            return writeExtentEntry(node, entries - 1, last.first, last.second + count) == -1 ? -1 : 1;
+
+        if (entries == capacity)
+            return 0;
+
+        if (writeExtentEntry(node, entries, start, count) == -1 || writeExtentHeader(node, entries + 1, 0) == -1)
+            return -1;
+
+        return 1;
+    }
+
+    // Only the last child can take the run, the entries before it cover earlier parts of the file
+    int ret = appendToExtentNode(inode, last.first, start, count, group);
+    if (ret == 1)
+        return writeExtentEntry(node, entries - 1, last.first, last.second + count) == -1 ? -1 : 1;
+
+    if (ret == -1 || entries == capacity)
+        return ret;
+
+    int branch = newExtentBranch(inode, content.height - 1, start, count, group);
+    if (branch == -1 || writeExtentEntry(node, entries, branch, count) == -1 ||
+        writeExtentHeader(node, entries + 1, content.height) == -1)
+        return -1;
+
+    return 1;
+}
+
+int fsDisk::newExtentBranch(fsInode* inode, int height, int start, int count, int group)
+{
+    vector<int> nodes;
+
+    // Bottom up, each node holds the one entry leading to the node below it
+    int first = start;
+    for (int level = 0; level <= height; level++)
+    {
+        int node = allocateBlock(group);
+        if (node == -1 || writeExtentEntry(node, 0, first, count) == -1 || writeExtentHeader(node, 1, level) == -1)
+        {
+            if (node != -1)
+                nodes.push_back(node);
+
+            for (int block : nodes)
+                releaseBlock(block);
+
+            return -1;
+        }
+
+        nodes.push_back(node);
+        first = node;
+    }
+
+    inode->addTreeBlocks(static_cast<int>(nodes.size()));
+    return first;
+}
+
+int fsDisk::readExtentNode(int block, ExtentNode& node)
+{
+    vector<char> data(blockSize);
+    if (block < 0 || block >= freeMap.getBlocksCount() ||
+        readDisk(data.data(), blockSize, static_cast<off_t>(block) * blockSize) == -1)
+        return -1;
+
+    int count = decodePointer(data.data());
+    node.height = decodePointer(data.data() + POINTER_SIZE);
+    if (count < 0 || count > (blockSize - EXTENT_HEADER_SIZE) / EXTENT_SIZE || node.height < 0 || node.height >= EXTENT_MAX_DEPTH)
+        return -1;
+
+    node.entries.resize(count);
+    for (int i = 0; i < count; i++)
+    {
+        const char* entry = data.data() + EXTENT_HEADER_SIZE + i * EXTENT_SIZE;
+        node.entries[i] = {decodePointer(entry), decodePointer(entry + POINTER_SIZE)};
+    }
+
+    return 1;
+}
+
+int fsDisk::writeExtentHeader(int block, int count, int height)
+{
+    off_t location = static_cast<off_t>(block) * blockSize;
+
+    // Through writePointer, so the change is journaled like the pointers of an indirect block
+    if (writePointer(count, location) == -1 || writePointer(height, location + POINTER_SIZE) == -1)
+        return -1;
+
+    return 1;
+}
+
+int fsDisk::writeExtentEntry(int block, int index, int first, int second)
+{
+    off_t location = static_cast<off_t>(block) * blockSize + EXTENT_HEADER_SIZE + static_cast<off_t>(index) * EXTENT_SIZE;
+
+    if (writePointer(first, location) == -1 || writePointer(second, location + POINTER_SIZE) == -1)
+        return -1;
+
+    return 1;
+}
+
+int fsDisk::collectExtents(fsInode* inode, vector<pair<int, int>>& extents, vector<int>* nodes)
+{
+    vector<pair<int, int>> entries(inode->getExtentCount());
+    for (size_t i = 0; i < entries.size(); i++)
+        inode->getExtent(static_cast<int>(i), &entries[i].first, &entries[i].second);
+
+    return collectExtents(entries, inode->getExtentDepth(), extents, nodes);
+}
+
+int fsDisk::collectExtents(const vector<pair<int, int>>& entries, int height, vector<pair<int, int>>& extents, vector<int>* nodes)
+{
+    if (height == 0)
+    {
+        extents.insert(extents.end(), entries.begin(), entries.end());
+        return 1;
+    }
+
+    for (const auto& entry : entries)
+    {
+        ExtentNode node;
+        if (readExtentNode(entry.first, node) == -1 || node.height != height - 1)
+            return -1;
+
+        if (nodes != nullptr)
+            nodes->push_back(entry.first);
+
+        if (collectExtents(node.entries, node.height, extents, nodes) == -1)
+            return -1;
+    }
+
+    return 1;
+}
+
+int fsDisk::mapSegments(fsInode* inode, char* buf, int len, off_t offset, size_t op, vector<BatchSegment>& segments)
+{
+    size_t first = segments.size();
+
+    for (int done = 0; done < len; )
+    {
+        int run;
+        int block = getFileBlock(inode, static_cast<int>(offset / blockSize), &run);
+        if (block == -1)
+        {
+            segments.resize(first);
+            return -1;
+        }
+
+        int inBlock = static_cast<int>(offset % blockSize);
+        int amount = static_cast<int>(min<off_t>(len - done, static_cast<off_t>(run) * blockSize - inBlock));
+        segments.push_back({static_cast<off_t>(block) * blockSize + inBlock, buf + done, amount, op});
+
+        done += amount;
+        offset += amount;
+    }
+
+    return 1;
+}
+
+int fsDisk::prepareWrite(IoRequest& request, size_t op, vector<BatchSegment>& segments)
+{
+    if (!isLegalFD(request.fd) || request.len < 0)
+        return -1;
+
+    fsInode* inode = getDescriptor(request.fd).getInode();
+    off_t offset = (request.offset == IO_APPEND) ? inode->getFileSize() : request.offset;
+    if (offset < 0 || offset > inode->getFileSize()) // No holes
+        return -1;
+
+    // The part inside the file is only mapped, the rest is appended now since it needs new blocks
+    int overwrite = static_cast<int>(min<off_t>(request.len, inode->getFileSize() - offset));
+    if (mapSegments(inode, request.buf, overwrite, offset, op, segments) == -1)
+        return -1;
+
+    request.result = overwrite;
+    if (overwrite < request.len)
+    {
+        off_t sizeBefore = inode->getFileSize();
+        WriteToFile(request.fd, request.buf + overwrite, request.len - overwrite);
+        request.result += static_cast<int>(inode->getFileSize() - sizeBefore);
+    }
+
+    return 1;
+}
+
+int fsDisk::prepareRead(IoRequest& request, size_t op, vector<BatchSegment>& segments)
+{
+    if (!isLegalFD(request.fd) || request.len < 0 || request.offset < 0)
+        return -1;
+
+    fsInode* inode = getDescriptor(request.fd).getInode();
+    int amount = static_cast<int>(max<off_t>(0, min<off_t>(request.len, inode->getFileSize() - request.offset)));
+    if (mapSegments(inode, request.buf, amount, request.offset, op, segments) == -1)
+        return -1;
+
+    request.result = amount;
+    return 1;
+}
+
+void fsDisk::runSegments(vector<BatchSegment>& segments, bool write, vector<IoRequest>& requests)
+{
+    auto byLocation = [](const BatchSegment& a, const BatchSegment& b) { return a.location < b.location; };
+    stable_sort(segments.begin(), segments.end(), byLocation);
+
+    // Disk order would let an earlier write win over a later one covering the same bytes
+    for (size_t i = 1; write && i < segments.size(); i++)
+    {
+        if (segments[i].location < segments[i - 1].location + segments[i - 1].len)
+        {
+            auto byOp = [](const BatchSegment& a, const BatchSegment& b) { return a.op < b.op; };
+            stable_sort(segments.begin(), segments.end(), byOp);
+            break;
+        }
+    }
+
+    vector<char> staging;
+    for (size_t i = 0; i < segments.size(); )
+    {
+        // Merge the segments that follow this one on the disk
+        size_t j = i + 1;
+        off_t end = segments[i].location + segments[i].len;
+        while (j < segments.size() && segments[j].location == end && end + segments[j].len - segments[i].location <= IO_CHUNK_SIZE)
+            end += segments[j++].len;
+
+        int ret;
+        if (j == i + 1)
+            ret = write ? writeDisk(segments[i].buf, segments[i].len, segments[i].location)
+                        : readDisk(segments[i].buf, segments[i].len, segments[i].location);
+        else
+        {
+            staging.resize(end - segments[i].location);
+            if (write)
+            {
+                for (size_t k = i; k < j; k++)
+                    memcpy(&staging[segments[k].location - segments[i].location], segments[k].buf, segments[k].len);
+
+                ret = writeDisk(staging.data(), staging.size(), segments[i].location);
+            }
+            else
+            {
+                ret = readDisk(staging.data(), staging.size(), segments[i].location);
+                for (size_t k = i; k < j && ret != -1; k++)
+                    memcpy(segments[k].buf, &staging[segments[k].location - segments[i].location], segments[k].len);
+            }
+        }
+
+        for (size_t k = i; k < j && ret == -1; k++)
+            requests[segments[k].op].result = -1;
+
+        i = j;
+    }
+}
+
+int fsDisk::reapAsync(int minimum)
+{
+    AsyncEngine* engine;
+    {
+        lock_guard<mutex> guard(asyncLock);
+        engine = asyncEngine;
+    }
+
+    if (engine == nullptr)
+        return 0;
+
+    // Reaping may block, so it runs without the lock and submissions go on meanwhile
+    vector<AsyncOp> ops;
+    int amount = engine->reap(ops, minimum);
+
+    lock_guard<mutex> guard(asyncLock);
+    for (const AsyncOp& op : ops)
+    {
+        AsyncRequest& async = asyncRequests[op.tag];
+        if (op.result == -1)
+            async.request.result = -1;
+
+        if (--async.pending == 0)
+        {
+            finishAsyncBlocks(async);
+            asyncCompleted.push_back(op.tag);
+        }
+    }
+
+    return amount;
+}
+
+int fsDisk::runCompletions()
+{
+    vector<AsyncRequest> done;
+    {
+        lock_guard<mutex> guard(asyncLock);
+        for (unsigned long long ticket : asyncCompleted)
+        {
+            done.push_back(asyncRequests[ticket]);
+            asyncRequests.erase(ticket);
+        }
+
+        asyncCompleted.clear();
+    }
+
+    // Callbacks run without the lock, so they may submit new requests
+    for (AsyncRequest& async : done)
+        if (async.callback)
+            async.callback(async.request);
+
+    return static_cast<int>(done.size());
+}
+
+void fsDisk::drainAsync()
+{
+    reapAsync(INT_MAX);
+}
+
+void fsDisk::waitForAsync(off_t location, size_t len)
+{
+    if (asyncInFlight == 0 || len == 0)
+        return;
+
+    off_t first = location / blockSize;
+    off_t last = (location + static_cast<off_t>(len) - 1) / blockSize;
+
+    while (true)
+    {
+        bool inFlight;
+        {
+            lock_guard<mutex> guard(asyncLock);
+            inFlight = asyncBlocks.overlaps(first, last);
+        }
+
+        if (!inFlight)
+            return;
+
+        reapAsync(1);
+    }
+}
+
+void fsDisk::finishAsyncBlocks(AsyncRequest& async)
+{
+    for (const auto& range : async.blocks)
+        asyncBlocks.remove(range.first, range.second);
+
+    async.blocks.clear();
+    asyncInFlight--;
+}
+
+bool fsDisk::deleteSingleBlock(off_t singleLocation, int blocksAmount)
+{
+    char* pointers = new char[blockSize];
+
+    // Read the singleInDirect pointers once
+    if (readDisk(pointers, blockSize, singleLocation) == -1)
+    {
+        delete[] pointers;
+        return false;
+    }
+
+    // Delete the singleInDirect blocks
+    for (int i = 0 ; i < blocksAmount ; i++ )
+        releaseBlock(decodePointer(pointers + i * POINTER_SIZE));
+
+    delete[] pointers;
+
+
+    releaseBlock(singleLocation / blockSize);
+
+    return true;
+}
+
+
+int fsDisk::deleteBlocks(fsInode* inode)
+{
+    if (inode->getFormat() == INODE_EXTENTS)
+    {
+        vector<pair<int, int>> extents;
+        vector<int> nodes;
+        collectExtents(inode, extents, &nodes);
+
+        for (const auto& extent : extents)
+            for (int i = 0; i < extent.second; i++)
+                releaseBlock(extent.first + i);
+
+        for (int node : nodes)
+            releaseBlock(node);
+
+        changeDiskSize(-inode->getFileSize());
+        inode->addFileSize(-inode->getFileSize());
+        return 1;
+    }
+
+    int blockLocation;
+    int max;
+    int amountOfBlocks = inode->getBlockInUse();
+    // Delete the direct blocks
+    max = AMOUNT_OF_DIRECT < amountOfBlocks ? AMOUNT_OF_DIRECT : amountOfBlocks; // Max loop iterations
+    for (int i = 1; i <= max; i++)
+    {
+        blockLocation = inode->getDirectBlock(i);
+
+        releaseBlock(blockLocation); // Mark the block as free
+    }
+
+    amountOfBlocks -= max;
+
+
+    // Delete single indirect blocks
+    if (inode->getSingleInDirect() != -1)
+    {
+        amountOfBlocks -= inode->getBlocksInSingleInDirect();
+        deleteSingleBlock(static_cast<off_t>(inode->getSingleInDirect()) * blockSize, inode->getBlocksInSingleInDirect());
+    }
+
+
+    // Delete double indirect blocks
+    if (inode->getDoubleInDirect() != -1)
+    {
+        vector<pair<int, int>> singles;
+        collectDoubleSingles(inode, singles);
+
+        for (const auto& single : singles)
+            deleteSingleBlock(static_cast<off_t>(single.first) * blockSize, single.second);
+
+        releaseBlock(inode->getDoubleInDirect()); // Mark the doubleInDirect as free
+    }
+
+
+    // Delete triple indirect blocks
+    if (inode->getTripleInDirect() != -1)
+    {
+        vector<pair<int, int>> singles;
+        vector<int> doubles;
+        collectTripleSingles(inode, singles, &doubles);
+
+        for (const auto& single : singles)
+            deleteSingleBlock(static_cast<off_t>(single.first) * blockSize, single.second);
+
+        for (int doubleIndex : doubles)
+            releaseBlock(doubleIndex);
+
+        releaseBlock(inode->getTripleInDirect()); // Mark the tripleInDirect as free
+    }
+
+
+    changeDiskSize(-inode->getFileSize());
+    inode->addFileSize(-inode->getFileSize());
+    return 1; // Successful block deletion
+}
+
+int fsDisk::countUsedBlocks(fsInode* inode)
+{
+    int requiredBlocks = inode->getBlockInUse();
+
+    if (inode->getFormat() == INODE_EXTENTS)
+        return requiredBlocks + inode->getTreeBlocks();
+
+    if (inode->getSingleInDirect() != -1)
+        requiredBlocks++;
+
+    if (inode->getDoubleInDirect() != -1)
+    {
+        requiredBlocks++; // For the double indirect block
+        requiredBlocks += inode->getSingleBlocksCount();
+    }
+
+    if (inode->getTripleInDirect() != -1)
+    {
+        long long fanout = inode->getFanout();
+        long long blocks = inode->getBlocksInTripleInDirect();
+        requiredBlocks++; // For the triple indirect block
+        requiredBlocks += static_cast<int>((blocks + fanout - 1) / fanout); // Singles
+        requiredBlocks += static_cast<int>((blocks + fanout * fanout - 1) / (fanout * fanout)); // Doubles
+    }
+
+    return requiredBlocks;
+}
+
+bool fsDisk::isEnoughSpaceToCopy(int requiredBlocks, int removeBlocks)
+{
+    return  (getFreeBlocksCount() - requiredBlocks + removeBlocks >= 0);
+}
+
+void fsDisk::init()
+{
+    // Cached blocks belong to the old content, drop them without writing them back
+    cache->reset(0, dataOffset);
+
+    // Never-written blocks read as zeros, so this doesn't depend on the disk size
+    int ret_val = sim_disk->zero();
+    assert(ret_val == 1);
+    currentDiskSize = 0;
+    freeMap.reset(0);
+    metadataStart = 0;
+    metadataEnd = 0;
+    journal->reset(SUPERBLOCK_SIZE, JOURNAL_SIZE, journal->getSequence());
+}
+
+void fsDisk::deleteMap()
+{
+    // Return the resident inodes to the slab
+    for (int id = MainDir.first(); id != -1; id = MainDir.next(id))
+        inodeSlab.release(MainDir.get(id).inode);
+
+    MainDir.clear();
+    residentInodes.clear();
+    rootEntries.clear();
+    rootId = -1;
+}
+
+int fsDisk::makeError(string text)
+{
+    cout << text << endl;
+    return -1;
+}
+
+
+fsDisk::fsDisk(DeviceType deviceType, off_t _diskSize, int cacheBlocks, bool mount) {
+    diskSize = _diskSize;
+    dataOffset = SUPERBLOCK_SIZE + JOURNAL_SIZE;
+    inodeTableOffset = 0;
+    inodeTableSize = 0;
+    metadataStart = 0;
+    metadataEnd = 0;
+    blockSize = 0;
+    inodeFormat = INODE_INDIRECT;
+    b_is_formated = false;
+    b_is_first_format = true;
+    asyncEngine = nullptr;
+    nextTicket = 0;
+    asyncInFlight = 0;
+    freeDescriptor = -1;
+    rootId = -1;
+
+    sim_disk = BlockDevice::create(deviceType, dataOffset + diskSize, mount);
+    assert(sim_disk);
+    cache = new BlockCache(sim_disk, cacheBlocks);
+    journal = new Journal(sim_disk, cache);
+    journal->reset(SUPERBLOCK_SIZE, JOURNAL_SIZE, 0);
+
+    // An image without a filesystem is treated like a new disk
+    if (!mount || loadMetadata() == -1)
+        init();
+}
+
+int fsDisk::writeMetadata()
+{
+    if (!b_is_formated)
+        return 1; // Nothing to save, the superblock stays invalid
+
+    // Blocks freed by closed transactions are free in the saved bitmap
+    vector<int> released;
+    journal->takeFrees(released);
+    for (int block : released)
+        freeMap.clear(block);
+
+    // Metadata describes the data area, so the data and the accesses in flight must reach the image first
+    drainAsync();
+    if (cache->flush() == -1)
+        return -1;
+
+    Superblock sb = {};
+    memcpy(sb.magic, SUPERBLOCK_MAGIC, sizeof(sb.magic));
+    sb.version = SUPERBLOCK_VERSION;
+    sb.blockSize = blockSize;
+    sb.inodeFormat = inodeFormat;
+    sb.diskSize = diskSize;
+    sb.currentDiskSize = currentDiskSize;
+    sb.dataOffset = dataOffset;
+    sb.journalOffset = SUPERBLOCK_SIZE;
+    sb.journalSize = JOURNAL_SIZE;
+    sb.journalSequence = journal->getSequence();
+
+    vector<uint64_t> words;
+    freeMap.getWords(words);
+    sb.bitmapBytes = words.size() * sizeof(uint64_t);
+
+    // Inode table: the records back to back, directory: name length, name, record offset and size, and type per file
+    string inodeTable;
+    string directory;
+    string savedTable; // The previous inode table, read once if an inode isn't in memory
+    for (int id = MainDir.first(); id != -1; id = MainDir.next(id))
+    {
+        DirEntry& dirEntry = MainDir.get(id);
+        const string& name = MainDir.getName(id);
+        uint64_t recordOffset = inodeTable.size();
+        uint32_t nameLength = name.size();
+
+        if (dirEntry.inode != nullptr)
+        {
+            uint32_t recordSize = sizeof(DiskInode);
+            inodeTable.resize(inodeTable.size() + recordSize);
+            dirEntry.inode->serialize(&inodeTable[recordOffset]);
+            dirEntry.recordSize = recordSize;
+        }
+        else
+        {
+            if (savedTable.empty())
+            {
+                savedTable.resize(inodeTableSize);
+                if (sim_disk->read(&savedTable[0], savedTable.size(), inodeTableOffset) == -1)
+                    return -1;
+            }
+
+            inodeTable.append(savedTable, dirEntry.recordOffset, dirEntry.recordSize);
+        }
+
+        uint32_t recordSize = dirEntry.recordSize;
+        uint8_t type = dirEntry.type;
+        directory.append(reinterpret_cast<const char*>(&nameLength), sizeof(nameLength));
+        directory.append(name);
+        directory.append(reinterpret_cast<const char*>(&recordOffset), sizeof(recordOffset));
+        directory.append(reinterpret_cast<const char*>(&recordSize), sizeof(recordSize));
+        directory.append(reinterpret_cast<const char*>(&type), sizeof(type));
+    }
+
+    // Right past the data area, unless that would overwrite the metadata the current superblock points at
+    off_t metadataSize = sb.bitmapBytes + inodeTable.size() + directory.size();
+    sb.bitmapOffset = dataOffset + diskSize;
+    if (metadataEnd > metadataStart && static_cast<off_t>(sb.bitmapOffset) + metadataSize > metadataStart)
+        sb.bitmapOffset = metadataEnd;
+
+    sb.inodeTableOffset = sb.bitmapOffset + sb.bitmapBytes;
+    sb.inodeTableBytes = inodeTable.size();
+    sb.directoryOffset = sb.inodeTableOffset + sb.inodeTableBytes;
+    sb.directoryBytes = directory.size();
+    sb.filesCount = MainDir.size();
+
+    off_t imageSize = sb.directoryOffset + sb.directoryBytes;
+    if (sim_disk->getSize() < imageSize && sim_disk->resize(imageSize) == -1)
+        return -1;
+
+    if (sim_disk->write(reinterpret_cast<const char*>(words.data()), sb.bitmapBytes, sb.bitmapOffset) == -1 ||
+        sim_disk->write(inodeTable.data(), sb.inodeTableBytes, sb.inodeTableOffset) == -1 ||
+        sim_disk->write(directory.data(), sb.directoryBytes, sb.directoryOffset) == -1)
+        return -1;
+
+    // The superblock must not point at metadata that hasn't reached the image yet
+    if (sim_disk->flush() == -1)
+        return -1;
+
+    char header[SUPERBLOCK_SIZE] = {};
+    memcpy(header, &sb, sizeof(sb));
+    if (sim_disk->write(header, SUPERBLOCK_SIZE, 0) == -1 || sim_disk->flush() == -1)
+        return -1;
+
+    // The journal is only overwritten once the superblock no longer needs it
+    journal->reset(sb.journalOffset, sb.journalSize, sb.journalSequence);
+    metadataStart = sb.bitmapOffset;
+    metadataEnd = imageSize;
+
+    // Every inode now matches its new record, except those an open file may still change
+    size_t recordOffset = 0;
+    inodeTableOffset = sb.inodeTableOffset;
+    inodeTableSize = sb.inodeTableBytes;
+    for (int id = MainDir.first(); id != -1; id = MainDir.next(id))
+    {
+        DirEntry& dirEntry = MainDir.get(id);
+        dirEntry.recordOffset = recordOffset;
+        dirEntry.dirty = dirEntry.inode != nullptr && dirEntry.fd != -1;
+        recordOffset += dirEntry.recordSize;
+    }
+
+    return 1;
+}
+
+int fsDisk::loadMetadata()
+{
+    if (sim_disk->getSize() < SUPERBLOCK_SIZE)
+        return -1;
+
+    Superblock sb;
+    if (sim_disk->read(reinterpret_cast<char*>(&sb), sizeof(sb), 0) == -1)
+        return -1;
+
+    if (memcmp(sb.magic, SUPERBLOCK_MAGIC, sizeof(sb.magic)) != 0 || sb.version != SUPERBLOCK_VERSION)
+        return -1;
+
+    off_t blocksCount = (sb.blockSize < MIN_BLOCK_SIZE) ? 0 : sb.diskSize / sb.blockSize;
+    bool validFormat = sb.inodeFormat == INODE_INDIRECT || (sb.inodeFormat == INODE_EXTENTS && sb.blockSize >= MIN_EXTENT_BLOCK_SIZE);
+    if (blocksCount == 0 || blocksCount > INT_MAX || !validFormat ||
+        sb.bitmapBytes != (blocksCount + BITS_IN_WORD - 1) / BITS_IN_WORD * sizeof(uint64_t) ||
+        sb.journalOffset < SUPERBLOCK_SIZE || sb.journalOffset + sb.journalSize > sb.dataOffset ||
+        static_cast<uint64_t>(sim_disk->getSize()) < sb.directoryOffset + sb.directoryBytes)
+        return -1;
+
+    // One read per region, the inode table is left on the image
+    vector<uint64_t> words(sb.bitmapBytes / sizeof(uint64_t));
+    string directory(sb.directoryBytes, '\0');
+    if (sim_disk->read(reinterpret_cast<char*>(words.data()), sb.bitmapBytes, sb.bitmapOffset) == -1 ||
+        sim_disk->read(&directory[0], sb.directoryBytes, sb.directoryOffset) == -1)
+        return -1;
+
+    blockSize = sb.blockSize;
+    inodeFormat = static_cast<InodeFormat>(sb.inodeFormat);
+    diskSize = sb.diskSize;
+    currentDiskSize = sb.currentDiskSize;
+    dataOffset = sb.dataOffset;
+    inodeTableOffset = sb.inodeTableOffset;
+    inodeTableSize = sb.inodeTableBytes;
+    metadataStart = sb.bitmapOffset;
+    metadataEnd = sb.directoryOffset + sb.directoryBytes;
+    journal->reset(sb.journalOffset, sb.journalSize, sb.journalSequence);
+
+    size_t pos = 0;
+    for (uint32_t i = 0; i < sb.filesCount; i++)
+    {
+        uint32_t nameLength;
+        uint64_t recordOffset;
+        uint32_t recordSize;
+        uint8_t type;
+
+        if (pos + sizeof(nameLength) > directory.size())
+            break;
+        memcpy(&nameLength, &directory[pos], sizeof(nameLength));
+        pos += sizeof(nameLength);
+
+        if (pos + nameLength + sizeof(recordOffset) + sizeof(recordSize) + sizeof(type) > directory.size())
+            break;
+        string_view name(&directory[pos], nameLength);
+        pos += nameLength;
+        memcpy(&recordOffset, &directory[pos], sizeof(recordOffset));
+        pos += sizeof(recordOffset);
+        memcpy(&recordSize, &directory[pos], sizeof(recordSize));
+        pos += sizeof(recordSize);
+        memcpy(&type, &directory[pos], sizeof(type));
+        pos += sizeof(type);
+
+        if (recordSize != sizeof(DiskInode) ||
+            recordOffset + recordSize > sb.inodeTableBytes || (type != INODE_FILE && type != INODE_DIRECTORY))
+            break;
+
+        DirEntry& entry = MainDir.get(MainDir.insert(name).first);
+        entry.recordOffset = static_cast<off_t>(recordOffset);
+        entry.recordSize = static_cast<int>(recordSize);
+        entry.type = static_cast<InodeType>(type);
+    }
+
+    if (MainDir.size() != sb.filesCount)
+    {
+        deleteMap();
+        return -1;
+    }
+
+    freeMap.load(words.data(), static_cast<int>(blocksCount));
+    inodeSlab.reset(blockSize, inodeFormat);
+    cache->reset(blockSize, dataOffset);
+    b_is_formated = true;
+    b_is_first_format = false;
+
+    // Redo what was committed after the metadata was saved, then save the result
+    vector<JournalRecord> records;
+    int replayed = journal->replay(records);
+
+    // File data isn't journaled: a pointer written to a block that's freed later in the journal
+    // is stale, and replaying it could overwrite the data the block holds by now
+    unordered_map<int, size_t> lastRelease;
+    for (size_t i = 0; i < records.size(); i++)
+        if (records[i].type == JOURNAL_RELEASE)
+            lastRelease[records[i].block] = i;
+
+    for (size_t i = 0; i < records.size(); i++)
+    {
+        if (records[i].type == JOURNAL_POINTER)
+        {
+            auto it = lastRelease.find(static_cast<int>(records[i].location / blockSize));
+            if (it != lastRelease.end() && it->second > i)
+                continue;
+        }
+
+        applyRecord(records[i]);
+    }
+
+    // Replaying may move entries to other ids, so each entry finds its parent once it's done
+    rootId = MainDir.find("");
+    for (int id = MainDir.first(); id != -1; id = MainDir.next(id))
+    {
+        if (id == rootId)
+            continue;
+
+        MainDir.get(id).parent = MainDir.find(parentPath(MainDir.getName(id)));
+        if (MainDir.getName(id).find('/') == string::npos)
+            rootEntries.insert(id);
+    }
+
+    if (replayed == -1 || rootId == -1 || (replayed > 0 && writeMetadata() == -1))
+    {
+        deleteMap();
+        b_is_formated = false;
+        b_is_first_format = true;
+        return -1;
+    }
+
+    return 1;
+}
+
+
+void fsDisk::listAll() {
+    OperationLock lock(this, true);
+    for (size_t i = 0; i < descriptorSlots.size(); i++)
+    {
+        const FileDescriptor& fd = descriptorSlots[i].descriptor;
+        string name = fd.getFileName();
+        off_t size = fd.GetFileSize();
+
+        // A free slot keeps the name of its last file only, the file may since be renamed, deleted or paged out
+        if (!fd.isInUse())
+        {
+            int id = MainDir.find(name);
+            fsInode* inode = (id == -1) ? nullptr : getInode(id);
+            if (inode == nullptr)
+                name = "";
+            else
+                size = inode->getFileSize();
+        }
+
+        cout << "Index: " << i << "\tFile Name: " << name <<  "\tIs Opened: " << fd.isInUse() << "\tFile Size: " << size << endl;
+    }
+    vector<char> content(min<off_t>(diskSize, IO_CHUNK_SIZE));
+
+    // The image is read directly, so it must hold every cached write
+    int ret_val = cache->flush();
+    assert(ret_val == 1);
+
+    cout << "Disk content: '" ;
+    for (off_t offset = 0; offset < diskSize; offset += content.size())
+    {
+        off_t amount = min<off_t>(diskSize - offset, content.size());
+        ret_val = sim_disk->read(content.data(), amount, dataOffset + offset);
+        assert(ret_val == 1);
+        cout.write(content.data(), amount);
+    }
+    cout << "'" << endl;
+
+
+}
+
+// ------------------------------------------------------------------------
+void fsDisk::fsFormat(int blockSize, off_t _diskSize, InodeFormat format)
+{
+    OperationLock lock(this, true);
+    drainAsync(); // Accesses in flight target the old layout
+
+    if (_diskSize == 0)
+        _diskSize = diskSize;
+
+    // Block indexes are ints, so the disk can't hold more than INT_MAX blocks
+    if (blockSize < MIN_BLOCK_SIZE || blockSize > _diskSize || _diskSize / blockSize > INT_MAX ||
+        (format == INODE_EXTENTS && blockSize < MIN_EXTENT_BLOCK_SIZE))
+    {
+        makeError("ERR");
+        return;
+    }
+
+    if (_diskSize != diskSize)
+    {
+        if (sim_disk->resize(dataOffset + _diskSize) == -1)
+        {
+            makeError("ERR");
+            return;
+        }
+
+        diskSize = _diskSize;
+    }
+
+    this->blockSize = blockSize;
+
+    if (!b_is_first_format)
+    {
+        // Slots keep their generation, so handles from before the format stay stale.
+        // They're released while their entries still exist.
+        for (size_t i = 0; i < descriptorSlots.size(); i++)
+            if (descriptorSlots[i].descriptor.isInUse())
+                releaseDescriptor(static_cast<int>(i));
+
+        deleteMap();
+        init();
+    }
+
+    b_is_first_format = false;
+    b_is_formated = true;
+    this->blockSize = blockSize;
+    inodeFormat = format;
+
+    freeMap.reset(static_cast<int>(diskSize / this->blockSize)); // All blocks start free
+    cache->reset(this->blockSize, dataOffset);
+    inodeSlab.reset(this->blockSize, inodeFormat); // Every inode was released with the directory
+
+    // A new disk holds the root directory only, its path is empty
+    rootId = MainDir.insert("").first;
+    insertInode(rootId, inodeSlab.allocate(INODE_DIRECTORY));
+
+    if (writeMetadata() == -1)
+        makeError("ERR");
+}
+
+// ------------------------------------------------------------------------
+int fsDisk::CreateFile(string_view fileName)
+{
+    OperationLock lock(this, true);
+
+    if (!b_is_formated)
+        return makeError("ERR");
+
+    // The file must not exist, and the directory it goes into must
+    string_view path = canonicalPath(fileName);
+    int parent;
+    if (lookupPath(path, &parent) != -1 || parent == -1)
+        return makeError("ERR");
+
+    TransactionScope transaction(this);
+
+    int id = createEntry(path, parent, INODE_FILE);
+    if (id == -1)
+        return makeError("ERR");
+
+    int fd = allocateDescriptor(id);
+    if (fd == -1)
+        return makeError("ERR");
+
+    return fd;
+}
+
+// ------------------------------------------------------------------------
+int fsDisk::OpenFile(string_view FileName)
+{
+    OperationLock lock(this, true);
+
+    // Check if the file exists
+    int parent;
+    int id = b_is_formated ? lookupPath(canonicalPath(FileName), &parent) : -1;
+    if (id == -1) // File was never created or disk wasn't formatted
+        return makeError("ERR");
+
+    if (MainDir.get(id).fd != -1) // File is already open
+        return makeError("ERR");
+
+    // Load the file into a descriptor, directories are read with ReadDir
+    fsInode* inode = getInode(id);
+    if (inode == nullptr || inode->getType() == INODE_DIRECTORY)
+        return makeError("ERR");
+
+    MainDir.get(id).dirty = true; // Written through the descriptor from now on
+    int fd = allocateDescriptor(id);
+    if (fd == -1)
+        return makeError("ERR");
+
+    return fd;
+}
+
+
+// ------------------------------------------------------------------------
+string fsDisk::CloseFile(int fd)
+{
+    OperationLock lock(this, true);
+
+    if (!b_is_formated) // Disk wasn't formatted
+    {
+        makeError("ERR");
+        return "-1";
+    }
+
+    if (!isLegalFD(fd)) // FD is illegal, already closed or stale
+    {
+        makeError("ERR");
+        return "-1";
+    }
+
+    string name = getDescriptor(fd).getFileName();
+    releaseDescriptor(fd);
+    return name;
+}
+
+
+// ------------------------------------------------------------------------
+int fsDisk::WriteToFile(int fd, const char *buf, int len)
+{
+    if (len < 0)
+        return makeError("ERR");
+
+    iovec iov = {const_cast<char*>(buf), static_cast<size_t>(len)};
+    return (WriteToFileV(fd, &iov, 1) == -1) ? -1 : 1;
+}
+
+// ------------------------------------------------------------------------
+int fsDisk::WriteToFileV(int fd, const iovec* iov, int iovcnt)
+{
+    OperationLock lock(this, false);
+
+    if (!b_is_formated || !isLegalFD(fd) || iovcnt < 0)
+        return makeError("ERR");
+
+    // The buffers together are at most as long as a single write can be
+    long long len = 0;
+    for (int i = 0; i < iovcnt; i++)
+    {
+        if (iov[i].iov_len > static_cast<size_t>(INT_MAX - len))
+            return makeError("ERR");
+
+        len += iov[i].iov_len;
+    }
+
+    fsInode* inode = getDescriptor(fd).getInode();
+    lock.lockInode(inode, true);
+
+    int written = appendToInode(getDescriptor(fd).getFileName(), inode, iov, static_cast<int>(len));
+    if (written == -1)
+        return makeError("ERR");
+
+    return written;
+}
+
+// ------------------------------------------------------------------------
+int fsDisk::appendToInode(const string& name, fsInode* inode, const iovec* iov, int len)
+{
+    TransactionScope transaction(this);
+    touchFile(name);
+
+    if (inode->isSpace()) // No space to write into the specific file
+        return -1;
+
+    if (inode->getInternalFragAmount(1) == 0 && inode->getInternalFragAmount(2) == 0 && inode->getInternalFragAmount(3) == 0
+        && inode->getInternalFragAmount(4) == 0 && getFreeDiskSpace() == -1)
+        return -1;
+
+    // Exactly 'len' bytes are written from the caller's buffers, zeros included
+    WriteCursor cursor = {iov, 0, len, getHomeGroup(inode)};
+    off_t sizeBefore = inode->getFileSize();
+
+    if (inode->getFormat() == INODE_EXTENTS)
+    {
+        if (writeExtents(cursor, inode) == -1)
+            return -1;
+    }
+    else
+    {
+        // Write data using different write strategies, stopping at the first error
+        int ret;
+        while ((ret = writeDirect(cursor, inode)) == 2);
+        while (ret != -1 && (ret = writeSingleInDirect(cursor, inode)) == 2);
+        while (ret != -1 && (ret = writeDoubleInDirect(cursor, inode)) == 2);
+        while (ret != -1 && (ret = writeTripleInDirect(cursor, inode)) == 2);
+    }
+
+    return static_cast<int>(inode->getFileSize() - sizeBefore);
+}
+
+
+// ------------------------------------------------------------------------
+int fsDisk::ReadFromFile(int fd, char *buf, int len)
+{
+    OperationLock lock(this, false);
+
+    buf[0] = '\0';
+    if (!b_is_formated || !isLegalFD(fd) || len < 0)
+        return makeError("ERR");
+
+    fsInode* inode = getDescriptor(fd).getInode();
+    lock.lockInode(inode, false);
+
+    if (!getDescriptor(fd).isInUse()) // File is closed
+        return makeError("ERR");
+
+    int blocksToRead = ceil(static_cast<double>(len) / blockSize);
+
+    if (len > inode->getFileSize())
+        len = inode->getFileSize();
+
+    if (len <= 0) // Nothing to read from the file - finish
+        return 1;
+
+    int index;
+    off_t file_offset;
+    int buf_index = 0;
+    int readBytes;
+
+    if (inode->getFormat() == INODE_EXTENTS)
+    {
+        vector<pair<int, int>> extents;
+        if (collectExtents(inode, extents, nullptr) == -1)
+            return makeError("ERR");
+
+        // One read per extent, a contiguous file is a single read
+        for (size_t i = 0; i < extents.size() && len > 0; i++)
+        {
+            readBytes = static_cast<int>(min<off_t>(len, static_cast<off_t>(extents[i].second) * blockSize));
+            if (readDisk(buf + buf_index, readBytes, static_cast<off_t>(extents[i].first) * blockSize) == -1)
+                return makeError("ERR");
+
+            buf_index += readBytes;
+            len -= readBytes;
+        }
+
+        buf[buf_index] = '\0';
+        return 1;
+    }
+
+    // Read from direct blocks
+    for (int i = 1; i <= 3 && i <= blocksToRead; i++)
+    {
+        index = inode->getDirectBlock(i);
+        file_offset = static_cast<off_t>(index) * blockSize;
+
+        // Update len to the remaining length of data to be read
+        readBytes = makeRead(len, buf, buf_index, file_offset);
+        if (readBytes == -1)
+            return makeError("ERR");
+        buf_index += readBytes;
+        len -= readBytes;
+    }
+
+    // Read from singleInDirect
+    blocksToRead -= AMOUNT_OF_DIRECT;
+
+    if (blocksToRead > 0)
+    {
+        int blocksAmount = inode->getBlocksInSingleInDirect();
+        if (blocksAmount > blocksToRead)
+            blocksAmount = blocksToRead;
+
+        readSingleInDirect(&len, buf, &buf_index, inode->getSingleInDirect(), blocksAmount, true);
+    }
+
+    blocksToRead -= inode->getFanout();
+
+    // Read from doubleInDirect
+    if (blocksToRead > 0)
+    {
+        vector<pair<int, int>> singles;
+        if (collectDoubleSingles(inode, singles) == -1)
+            return makeError("ERR");
+
+        for (size_t i = 0; i < singles.size() && len > 0; i++)
+            readSingleInDirect(&len, buf, &buf_index, singles[i].first, singles[i].second, true);
+    }
+
+    // Read from tripleInDirect
+    if (len > 0)
+    {
+        vector<pair<int, int>> singles;
+        if (collectTripleSingles(inode, singles, nullptr) == -1)
+            return makeError("ERR");
+
+        for (size_t i = 0; i < singles.size() && len > 0; i++)
+            readSingleInDirect(&len, buf, &buf_index, singles[i].first, singles[i].second, true);
+    }
+
+    buf[buf_index] = '\0';
+
+    return 1;
+}
+
+
+// ------------------------------------------------------------------------
+int fsDisk::ReadFromFileV(int fd, const iovec* iov, int iovcnt)
+{
+    OperationLock lock(this, false);
+
+    if (!b_is_formated || !isLegalFD(fd) || iovcnt < 0)
+        return makeError("ERR");
+
+    long long len = 0;
+    for (int i = 0; i < iovcnt; i++)
+    {
+        if (iov[i].iov_len > static_cast<size_t>(INT_MAX - len))
+            return makeError("ERR");
+
+        len += iov[i].iov_len;
+    }
+
+    lock.lockInode(getDescriptor(fd).getInode(), false);
+
+    int readBytes = 0;
+    for (int i = 0; i < iovcnt; i++)
+    {
+        int amount = ReadAt(fd, static_cast<char*>(iov[i].iov_base), static_cast<int>(iov[i].iov_len), readBytes);
+        if (amount == -1)
+            return -1;
+
+        readBytes += amount;
+        if (amount < static_cast<int>(iov[i].iov_len)) // End of the file
+            break;
+    }
+
+    return readBytes;
+}
+
+// ------------------------------------------------------------------------
+int fsDisk::SubmitBatch(vector<IoRequest>& requests)
+{
+    // The batch runs alone, so no file changes between mapping an operation and doing its I/O
+    OperationLock lock(this, true);
+
+    if (!b_is_formated)
+        return makeError("ERR");
+
+    TransactionScope transaction(this);
+
+    vector<BatchSegment> writes;
+    vector<BatchSegment> reads;
+
+    for (size_t i = 0; i < requests.size(); i++)
+    {
+        requests[i].result = -1;
+        if (requests[i].opcode == IO_WRITE)
+            prepareWrite(requests[i], i, writes);
+    }
+
+    // Files keep their size from here on, so reads are mapped against the final sizes
+    for (size_t i = 0; i < requests.size(); i++)
+        if (requests[i].opcode == IO_READ)
+            prepareRead(requests[i], i, reads);
+
+    runSegments(writes, true, requests);
+    runSegments(reads, false, requests);
+
+    return 1;
+}
+
+// ------------------------------------------------------------------------
+long long fsDisk::SubmitAsync(const IoRequest& request, IoCallback callback)
+{
+    AsyncRequest async = {request, callback, 0, {}};
+    vector<BatchSegment> segments;
+    unsigned long long ticket;
+
+    {
+        // Mapped alone like a batch, the disk accesses run once the locks are released
+        OperationLock lock(this, true);
+
+        if (!b_is_formated || (request.opcode != IO_READ && request.opcode != IO_WRITE))
+            return makeError("ERR");
+
+        TransactionScope transaction(this);
+
+        {
+            lock_guard<mutex> guard(asyncLock);
+            ticket = nextTicket++;
+        }
+
+        async.request.result = -1;
+        int ret = (request.opcode == IO_WRITE) ? prepareWrite(async.request, ticket, segments)
+                                               : prepareRead(async.request, ticket, segments);
+        if (ret == -1)
+            return makeError("ERR");
+
+        // The engine goes straight to the device, so the cache must not keep its own copy of the bytes
+        for (const BatchSegment& segment : segments)
+        {
+            if (cache->evictRange(segment.location, segment.len) == -1)
+                return makeError("ERR");
+
+            if (segment.len > 0)
+                async.blocks.push_back({segment.location / blockSize, (segment.location + segment.len - 1) / blockSize});
+        }
+
+        // The blocks are in flight before the lock is released, so no cached access loads them meanwhile
+        lock_guard<mutex> guard(asyncLock);
+        async.pending = static_cast<int>(segments.size());
+        asyncRequests[ticket] = async;
+        if (async.pending > 0)
+        {
+            for (const auto& range : async.blocks)
+                asyncBlocks.add(range.first, range.second);
+
+            asyncInFlight++;
+        }
+    }
+
+    lock_guard<mutex> guard(asyncLock);
+    if (asyncEngine == nullptr)
+        asyncEngine = AsyncEngine::create(sim_disk, ASYNC_QUEUE_DEPTH);
+
+    AsyncRequest& submitted = asyncRequests[ticket];
+    bool inFlight = submitted.pending > 0;
+
+    for (const BatchSegment& segment : segments)
+    {
+        AsyncOp op = {request.opcode == IO_WRITE, segment.buf, static_cast<size_t>(segment.len),
+                      dataOffset + segment.location, ticket, -1};
+        if (asyncEngine->submit(op) == -1)
+        {
+            submitted.request.result = -1;
+            submitted.pending--;
+        }
+    }
+
+    // Nothing left to wait for: a read at the end of the file, an append, or no access accepted
+    if (submitted.pending == 0)
     {
-        requiredBlocks++; // For the double indirect block
-        requiredBlocks += inode->getSingleBlocksCount();
+        if (inFlight)
+            finishAsyncBlocks(submitted);
+
+        asyncCompleted.push_back(ticket);
     }
 
-    return requiredBlocks;
+    return static_cast<long long>(ticket);
 }
 
-bool fsDisk::isEnoughSpaceToCopy(int requiredBlocks, int removeBlocks) const
+// ------------------------------------------------------------------------
+int fsDisk::PollCompletions()
 {
-    return  (BitVectorSize - blocksUsed - requiredBlocks + removeBlocks >= 0);
+    reapAsync(0);
+    return runCompletions();
 }
 
-void fsDisk::init()
+// ------------------------------------------------------------------------
+int fsDisk::WaitCompletions(int minimum)
 {
-    for (int i=0; i < DISK_SIZE ; i++)
-    {
-        int ret_val = fseek ( sim_disk_fd , i , SEEK_SET );
-        ret_val = fwrite( "\0" ,  1 , 1, sim_disk_fd );
-        assert(ret_val == 1);
-    }
-    fflush(sim_disk_fd);
-    currentDiskSize = 0;
-    blocksUsed = 0;
-    BitVectorSize = 0;
-    BitVector = nullptr;
-}
+    if (minimum < 0)
+        return makeError("ERR");
 
-void fsDisk::deleteMap()
-{
-    while (!MainDir.empty())
+    int ran = 0;
+    while (true)
     {
-        auto it = MainDir.begin();
+        ran += runCompletions();
+        if (ran >= minimum)
+            break;
 
-        // Delete the dynamically allocated fsInode object
-        delete it->second;
+        {
+            lock_guard<mutex> guard(asyncLock);
+            if (asyncRequests.size() == asyncCompleted.size())
+                break; // Nothing in flight to wait for
+        }
 
-        // Erase the map element
-        MainDir.erase(it);
+        if (reapAsync(1) == 0)
+            break; // The engine failed to wait
     }
+
+    return ran;
 }
 
-int fsDisk::makeError(string text)
+// ------------------------------------------------------------------------
+int fsDisk::ReadAt(int fd, char *buf, int len, off_t offset)
 {
-    cout << text << endl;
-    return -1;
-}
+    OperationLock lock(this, false);
+
+    if (!b_is_formated || !isLegalFD(fd) || len < 0 || offset < 0)
+        return makeError("ERR");
 
+    fsInode* inode = getDescriptor(fd).getInode();
+    lock.lockInode(inode, false);
 
-fsDisk::fsDisk() {
-    sim_disk_fd = fopen( DISK_SIM_FILE , "w+" );
-    assert(sim_disk_fd);
-    init();
-    b_is_first_format = true;
+    int readBytes = readFromInode(inode, buf, len, offset);
+    if (readBytes == -1)
+        return makeError("ERR");
+
+    return readBytes;
 }
 
+// ------------------------------------------------------------------------
+int fsDisk::readFromInode(fsInode* inode, char *buf, int len, off_t offset)
+{
+    if (offset >= inode->getFileSize())
+        return 0;
 
-void fsDisk::listAll() {
-    int i = 0;
-    for (auto it = begin (openFileDescriptors); it != end (openFileDescriptors); ++it)
+    if (len > inode->getFileSize() - offset)
+        len = inode->getFileSize() - offset;
+
+    int readBytes = 0;
+    while (readBytes < len)
     {
-        cout << "Index: " << i << "\tFile Name: " << it->getFileName() <<  "\tIs Opened: " << it->isInUse() << "\tFile Size: " << it->GetFileSize() << endl;
-        i++;
-    }
-    char bufy;
-    cout << "Disk content: '" ;
-    for (i=0; i < DISK_SIZE ; i++) {
-        int ret_val = fseek ( sim_disk_fd , i , SEEK_SET );
-        ret_val = fread(  &bufy , 1 , 1, sim_disk_fd );
-        cout << bufy;
-    }
-    cout << "'" << endl;
+        // Blocks that follow each other on the disk are read together
+        int run;
+        int block = getFileBlock(inode, static_cast<int>(offset / blockSize), &run);
+        int inBlock = static_cast<int>(offset % blockSize);
+        int amount = static_cast<int>(min<off_t>(len - readBytes, static_cast<off_t>(run) * blockSize - inBlock));
+
+        if (block == -1 || readDisk(buf + readBytes, amount, static_cast<off_t>(block) * blockSize + inBlock) == -1)
+            return -1;
 
+        readBytes += amount;
+        offset += amount;
+    }
 
+    return readBytes;
 }
 
 // ------------------------------------------------------------------------
-void fsDisk::fsFormat(int blockSize)
+int fsDisk::WriteAt(int fd, const char *buf, int len, off_t offset)
 {
-    if (blockSize < MIN_BLOCK_SIZE || blockSize > DISK_SIZE)
-    {
-        makeError("ERR");
-        return;
-    }
+    OperationLock lock(this, false);
 
-    this->blockSize = blockSize;
+    if (!b_is_formated || !isLegalFD(fd) || len < 0 || offset < 0)
+        return makeError("ERR");
 
-    if (!b_is_first_format)
+    fsInode* inode = getDescriptor(fd).getInode();
+    lock.lockInode(inode, true);
+
+    if (offset > inode->getFileSize()) // No holes
+        return makeError("ERR");
+
+    // Overwrite the part that is already inside the file
+    int written = overwriteInode(inode, buf, len, offset);
+    if (written == -1)
+        return makeError("ERR");
+
+    // Append the rest
+    if (written < len)
     {
-        deleteMap();
-        delete[] BitVector;
-        init();
-        MainDir.clear();
-        openFileDescriptors.clear();
-    }
+        off_t sizeBefore = inode->getFileSize();
 
-    b_is_first_format = false;
-    b_is_formated = true;
-    this->blockSize = blockSize;
+        if (WriteToFile(fd, buf + written, len - written) == -1)
+            return -1;
 
-    BitVectorSize = DISK_SIZE / this->blockSize;
-    BitVector = new int[BitVectorSize];
-    assert(BitVector);
+        written += static_cast<int>(inode->getFileSize() - sizeBefore);
+    }
 
-    for (int i = 0; i < BitVectorSize; ++i)
-        BitVector[i] = 0; // Initialize to 0 to indicate free blocks
+    return written;
 }
 
 // ------------------------------------------------------------------------
-int fsDisk::CreateFile(string fileName)
+int fsDisk::overwriteInode(fsInode* inode, const char *buf, int len, off_t offset)
 {
-    if (!b_is_formated || isInMap(fileName))
-        return makeError("ERR");
+    int written = 0;
+    while (written < len && offset < inode->getFileSize())
+    {
+        int run;
+        int block = getFileBlock(inode, static_cast<int>(offset / blockSize), &run);
+        int inBlock = static_cast<int>(offset % blockSize);
+        int amount = min<off_t>(min<off_t>(len - written, static_cast<off_t>(run) * blockSize - inBlock),
+                                inode->getFileSize() - offset);
 
-    auto* new_file = new fsInode(blockSize);
-    MainDir[fileName] = new_file;
+        if (block == -1 || writeDisk(buf + written, amount, static_cast<off_t>(block) * blockSize + inBlock) == -1)
+            return -1;
 
-    FileDescriptor new_fd(fileName, new_file);
+        written += amount;
+        offset += amount;
+    }
 
-    return insertIntoVector(new_fd);
+    return written;
 }
 
 // ------------------------------------------------------------------------
-int fsDisk::OpenFile(string FileName)
+int fsDisk::Read(int fd, char *buf, int len)
 {
+    OperationLock lock(this, false);
 
-    // Check if the file exists
-    if (!b_is_formated || !isInMap(FileName)) // File was never created or disk wasn't formatted
+    if (!isLegalFD(fd))
         return makeError("ERR");
 
-    // Check if the file is in the vector already
-    int index = getFileDescriptor(FileName);
+    // The position is shared by every reader of the descriptor, so it's moved under the exclusive lock
+    lock.lockInode(getDescriptor(fd).getInode(), true);
 
-    if (index != -1)
-    {  // File is already inside the vector
-        if (openFileDescriptors[index].isInUse()) // File is already open
-            return makeError("ERR");
-    }
+    int readBytes = ReadAt(fd, buf, len, getDescriptor(fd).getOffset());
+    if (readBytes > 0)
+        getDescriptor(fd).setOffset(getDescriptor(fd).getOffset() + readBytes);
 
-    // Load the file into the vector
-    map<std::string, fsInode*>::iterator it = MainDir.find(FileName);
-    FileDescriptor fd(it->first, it->second);
-    return insertIntoVector(fd);
+    return readBytes;
 }
 
-
 // ------------------------------------------------------------------------
-string fsDisk::CloseFile(int fd)
+int fsDisk::Write(int fd, const char *buf, int len)
 {
-    if (!b_is_formated) // Disk wasn't formatted
-    {
-        makeError("ERR");
-        return "-1";
-    }
+    OperationLock lock(this, false);
 
-    if (fd < 0 || fd >= openFileDescriptors.size()) // FD index is illegal
-    {
-        makeError("ERR");
-        return "-1";
-    }
+    if (!isLegalFD(fd))
+        return makeError("ERR");
 
-    if (!openFileDescriptors[fd].isInUse()) // FD is already closed
-    {
-        makeError("ERR");
-        return "-1";
-    }
+    lock.lockInode(getDescriptor(fd).getInode(), true);
 
-    openFileDescriptors[fd].setInUse(false);
-    return openFileDescriptors[fd].getFileName();
-}
+    int written = WriteAt(fd, buf, len, getDescriptor(fd).getOffset());
+    if (written > 0)
+        getDescriptor(fd).setOffset(getDescriptor(fd).getOffset() + written);
 
+    return written;
+}
 
 // ------------------------------------------------------------------------
-int fsDisk::WriteToFile(int fd, char *buf, int len)
+off_t fsDisk::Lseek(int fd, off_t offset, int whence)
 {
+    OperationLock lock(this, false);
+
     if (!b_is_formated || !isLegalFD(fd))
         return makeError("ERR");
 
-    fsInode* inode = openFileDescriptors[fd].getInode();
-
-    if (inode->isSpace()) // No space to write into the specific file
-        return makeError("ERR");
+    lock.lockInode(getDescriptor(fd).getInode(), true);
 
-    if (inode->getInternalFragAmount(1) == 0 && inode->getInternalFragAmount(2) == 0 && inode->getInternalFragAmount(3) == 0
-        && getFreeDiskSpace() == -1)
-        return makeError("ERR");
+    off_t base;
+    if (whence == SEEK_SET)
+        base = 0;
 
-    // Create a dynamically allocated character array for the truncated data
-    char* truncatedData = new char[len + 1]; // Add 1 for the null terminator
+    else if (whence == SEEK_CUR)
+        base = getDescriptor(fd).getOffset();
 
-    size_t originalLength = strlen(buf);
+    else if (whence == SEEK_END)
+        base = getDescriptor(fd).GetFileSize();
 
-    if (len <= originalLength)
-    {
-        // Copy the truncated portion of buf into the dynamically allocated variable
-        strncpy(truncatedData, buf, len);
-        truncatedData[len] = '\0'; // Null-terminate the copied portion
-    }
     else
-    {
-        // Copy the entire original buf into the dynamically allocated variable
-        strncpy(truncatedData, buf, originalLength);
-        truncatedData[originalLength] = '\0'; // Null-terminate the copied portion
-    }
-
-    // Store a separate pointer to the truncated data for writing
-    char* writePtr = truncatedData;
-
-    // Write data using different write strategies
-    while (writeDirect(writePtr, inode) == 2);
-    while (writeSingleInDirect(writePtr, inode) == 2);
-    while (writeDoubleInDirect(writePtr, inode) == 2);
+        return makeError("ERR");
 
-    // Clean up: delete the dynamically allocated buffer
-    delete[] truncatedData;
+    off_t position = base + offset;
+    if (position < 0 || position > getDescriptor(fd).GetFileSize())
+        return makeError("ERR");
 
-    return 1;
+    getDescriptor(fd).setOffset(position);
+    return position;
 }
 
-
 // ------------------------------------------------------------------------
-int fsDisk::ReadFromFile(int fd, char *buf, int len)
+int fsDisk::MapFromFile(int fd, vector<iovec>& spans, int len)
 {
-    buf[0] = '\0';
-    if (!b_is_formated || !isLegalFD(fd) || len < 0)
-        return makeError("ERR");
+    OperationLock lock(this, false);
 
-    fsInode* inode = openFileDescriptors[fd].getInode();
-
-    if (!openFileDescriptors[fd].isInUse()) // File is closed
+    spans.clear();
+    if (!b_is_formated || !isLegalFD(fd) || len < 0)
         return makeError("ERR");
 
-    int blocksToRead = ceil(static_cast<double>(len) / blockSize);
+    fsInode* inode = getDescriptor(fd).getInode();
+    lock.lockInode(inode, false);
 
     if (len > inode->getFileSize())
         len = inode->getFileSize();
 
-    if (len <= 0) // Nothing to read from the file - finish
-        return 1;
+    vector<int> blocks;
+    if (collectBlocks(inode, ceil(static_cast<double>(len) / blockSize), blocks) == -1)
+        return makeError("ERR");
 
-    int index;
-    int file_offset;
-    int buf_index = 0;
-    int readBytes;
+    // The spans point into the image, so it must hold every cached write
+    if (cache->flush() == -1)
+        return makeError("ERR");
 
-    // Read from direct blocks
-    for (int i = 1; i <= 3 && i <= blocksToRead; i++)
+    for (int block : blocks)
     {
-        index = inode->getDirectBlock(i);
-        file_offset = index * blockSize;
+        int amount = (len > blockSize) ? blockSize : len;
+        off_t location = static_cast<off_t>(block) * blockSize;
 
-        if (fseek(sim_disk_fd, file_offset, SEEK_SET) != 0)
+        const char* data = sim_disk->view(dataOffset + location, amount);
+        if (data == nullptr) // The backend keeps no addressable image
             return makeError("ERR");
 
-        // Update len to the remaining length of data to be read
-        readBytes = makeRead(len, buf, buf_index);
-        buf_index += readBytes;
-        len -= readBytes;
-    }
-
-    // Read from singleInDirect
-    blocksToRead -= AMOUNT_OF_DIRECT;
-
-    if (blocksToRead > 0)
-    {
-        int blocksAmount = inode->getBlocksInSingleInDirect();
-        if (blocksAmount > blocksToRead)
-            blocksAmount = blocksToRead;
-
-        readSingleInDirect(&len, buf, &buf_index, inode->getSingleInDirect(), blocksAmount, true);
-    }
-
-    blocksToRead -= blockSize;
+        // Extend the previous span when this block follows it on the disk
+        if (!spans.empty() && static_cast<char*>(spans.back().iov_base) + spans.back().iov_len == data)
+            spans.back().iov_len += amount;
+        else
+            spans.push_back({const_cast<char*>(data), static_cast<size_t>(amount)});
 
-    // Read from doubleInDirect
-    if (blocksToRead > 0)
-    {
-        int blocksAmount = inode->getSingleBlocksCount();
-        if (blocksAmount > blocksToRead)
-            blocksAmount = blocksToRead;
-
-        for (int i = 0; i < blocksAmount; i++)
-        {
-            readSingleInDirect(&len, buf, &buf_index, inode->getSingleBlockLocation(i),
-                               inode->getBlocksInEachSingle(i), false);
-        }
+        len -= amount;
     }
 
-    buf[buf_index] = '\0';
-
     return 1;
 }
 
-
 // ------------------------------------------------------------------------
-int fsDisk::DelFile(string FileName)
+int fsDisk::DelFile(string_view FileName)
 {
-    if (!b_is_formated || !isInMap(FileName)) // File doesn't exist
+    OperationLock lock(this, true);
+
+    int parent;
+    int id = b_is_formated ? lookupPath(canonicalPath(FileName), &parent) : -1;
+    if (id == -1 || parent == -1) // File doesn't exist
         return makeError("ERR");
 
-    int index = getFileDescriptor(FileName);
-    if (index > -1 && openFileDescriptors[index].isInUse()) // File is opened
+    if (MainDir.get(id).fd != -1 || isDirectory(id)) // File is opened, or is a directory
         return makeError("ERR");
 
-    /* The key exists in the map and is closed, delete the fsInode and erase the key-value pair. */
-    auto it = MainDir.find(FileName);
-    deleteBlocks(it->second);
-    deleteFromMainDir(FileName, true);
+    TransactionScope transaction(this);
+
+    // Take the name out of its directory first, that may page other inodes in
+    if (detachEntry(id) == -1)
+        return makeError("ERR");
+
+    /* The file exists and is closed, delete the fsInode and erase the entry. */
+    fsInode* inode = getInode(id);
+    if (inode == nullptr)
+        return makeError("ERR");
 
-    if (index > -1)
-        openFileDescriptors[index].setName("");
+    deleteBlocks(inode);
+    deleteFromMainDir(id, true);
 
-    return 1; // 1 to indicate success. Can return index but what if it's closed and not in the vector (meaning index is -1)
+    return 1; // 1 to indicate success
 }
 
 
 // ------------------------------------------------------------------------
-int fsDisk::CopyFile(string srcFileName, string destFileName)
+int fsDisk::CopyFile(string_view srcFileName, string_view destFileName)
 {
+    OperationLock lock(this, true);
+
     if (!b_is_formated)
         return makeError("ERR");
 
-    int fd = getFileDescriptor(srcFileName);
-    if (!isInMap(srcFileName) || srcFileName == destFileName || (fd != -1 && openFileDescriptors[fd].isInUse()))
+    string_view srcPath = canonicalPath(srcFileName);
+    string_view destPath = canonicalPath(destFileName);
+    int srcParent;
+    int destParent;
+    int srcId = lookupPath(srcPath, &srcParent);
+    if (srcId == -1 || srcPath == destPath || MainDir.get(srcId).fd != -1)
+        return makeError("ERR");
+
+    fsInode* srcInode = getInode(srcId);
+    if (srcInode == nullptr || srcInode->getType() == INODE_DIRECTORY)
         return makeError("ERR");
 
-    auto it = MainDir.find(srcFileName);
+    int requiredBlocks = countUsedBlocks(srcInode);
+    int destId = lookupPath(destPath, &destParent);
+    bool isOverRide = destId != -1;
+
+    if (destParent == -1 || (isOverRide && isDirectory(destId))) // No such directory, or the destination is one
+        return makeError("ERR");
 
-    int requiredBlocks = countUsedBlocks(it->second);
-    bool isOverRide = isInMap(destFileName);
+    // Blocks freed by a transaction are only reusable once it's committed. When the disk can hold both
+    // files the copy is one transaction, otherwise destFileName is deleted in a transaction of its own first.
+    bool isAtomic = isEnoughSpaceToCopy(requiredBlocks, 0);
 
     // Check if destFileName already exists
     if (isOverRide)
     {
-        auto destIt = MainDir.find(destFileName);
+        fsInode* destInode = getInode(destId);
+        if (destInode == nullptr)
+            return makeError("ERR");
 
-        if (!isEnoughSpaceToCopy(requiredBlocks, countUsedBlocks(destIt->second)))
+        if (!isEnoughSpaceToCopy(requiredBlocks, countUsedBlocks(destInode)))
             return makeError("ERR"); // Not enough space
 
-        int index = getFileDescriptor(destFileName);
-        if (index > -1 && openFileDescriptors[index].isInUse()) // File is opened
+        if (MainDir.get(destId).fd != -1) // File is opened
             return makeError("ERR");
 
-        DelFile(destFileName);
+        if (!isAtomic)
+            DelFile(destPath);
     }
-    else if (!isEnoughSpaceToCopy(requiredBlocks, 0))
+    else if (!isAtomic)
         return makeError("ERR"); // Not enough space
 
+    TransactionScope transaction(this);
+
+    if (isOverRide && isAtomic)
+        DelFile(destPath);
+
     // Open the given file
-    int index = OpenFile(srcFileName);
+    int index = OpenFile(srcPath);
     if (index == -1)
         return makeError("ERR");
 
-    // Create a copy of the fsInode object
-    fsInode* copiedInode = new fsInode(it->second->getBlockSize());
-    int newFileFD;
+    // Paging the destination in may have dropped the source inode, use the one the descriptor holds
+    srcInode = getDescriptor(index).getInode();
 
-    // Insert the copied object with the new key
-    MainDir[destFileName] = copiedInode;
-
-    if (isOverRide)
-    {
-        FileDescriptor fd(destFileName, copiedInode);
-        newFileFD = insertIntoVector(fd);
-        if (newFileFD == -1)
-            return makeError("ERR");
-    }
-    else
-        newFileFD = OpenFile(destFileName);
-
-    char data[DISK_SIZE];
-    if (ReadFromFile(index, data, it->second->getFileSize()) == -1)
+    // Create the copy under the new name, the old destination is gone by now
+    destId = createEntry(destPath, destParent, INODE_FILE);
+    if (destId == -1)
     {
-        deleteFromMainDir(destFileName, false);
         CloseFile(index);
-        return -1;
+        return makeError("ERR");
     }
 
-    if (WriteToFile(newFileFD, data, it->second->getFileSize()) == -1)
+    int newFileFD = allocateDescriptor(destId);
+    if (newFileFD == -1)
+        return makeError("ERR");
+
+    // A chunk at a time, the file may be larger than any buffer
+    vector<char> data(IO_CHUNK_SIZE);
+    for (off_t offset = 0; offset < srcInode->getFileSize(); offset += IO_CHUNK_SIZE)
     {
-        CloseFile(newFileFD);
-        deleteFromMainDir(destFileName, false);
-        CloseFile(index);
-        return -1;
+        int amount = ReadAt(index, data.data(), IO_CHUNK_SIZE, offset);
+        if (amount == -1 || WriteToFile(newFileFD, data.data(), amount) == -1)
+        {
+            CloseFile(newFileFD);
+            detachEntry(destId);
+            deleteFromMainDir(destId, false);
+            CloseFile(index);
+            return -1;
+        }
     }
 
     CloseFile(newFileFD);
@@ -935,50 +3152,208 @@ int fsDisk::CopyFile(string srcFileName, string destFileName)
 }
 
 // ------------------------------------------------------------------------
-int fsDisk::RenameFile(string oldFileName, string newFileName)
+int fsDisk::RenameFile(string_view oldFileName, string_view newFileName)
 {
-    if (!b_is_formated || !isInMap(oldFileName) || isInMap(newFileName) || oldFileName == newFileName)
+    OperationLock lock(this, true);
+
+    string_view oldPath = canonicalPath(oldFileName);
+    string_view newPath = canonicalPath(newFileName);
+    int oldParent;
+    int newParent;
+    int id = b_is_formated ? lookupPath(oldPath, &oldParent) : -1;
+    if (id == -1 || oldParent == -1 || MainDir.get(id).fd != -1)
         return makeError("ERR");
 
-    int index = getFileDescriptor(oldFileName);
-    if (index != -1 &&  openFileDescriptors[index].isInUse())
+    // The new name must be free, in a directory that exists
+    if (lookupPath(newPath, &newParent) != -1 || newParent == -1)
         return makeError("ERR");
 
+    // A directory can't move under itself, and takes every entry under it along, none of which may be open
+    vector<int> subtree;
+    if (isDirectory(id))
+    {
+        if (newPath.size() > oldPath.size() && newPath.substr(0, oldPath.size()) == oldPath && newPath[oldPath.size()] == '/')
+            return makeError("ERR");
+
+        if (collectSubtree(id, subtree) == -1)
+            return makeError("ERR");
 
-    auto it = MainDir.find(oldFileName);
+        for (int child : subtree)
+            if (MainDir.get(child).fd != -1)
+                return makeError("ERR");
+    }
+
+    TransactionScope transaction(this);
 
-    // Retrieve the corresponding fsInode pointer.
-    fsInode* inode = it->second;
+    // The new name is added first, so a full disk leaves the old one in place
+    string oldName(oldPath);
+    if (linkEntry(newParent, leafName(newPath)) == -1 || unlinkEntry(oldParent, leafName(oldPath)) == -1)
+        return makeError("ERR");
 
-    // Insert a new entry with the new filename and the same fsInode pointer.
-    MainDir[newFileName] = inode;
+    rootEntries.erase(id);
+    if (newParent == rootId)
+        rootEntries.insert(id);
 
-    // Erase the old entry.
-    MainDir.erase(it);
+    // The entry is moved in the table in place, it keeps its id
+    MainDir.rename(id, newPath);
+    MainDir.get(id).parent = newParent;
+    journal->logRename(oldName, MainDir.getName(id));
 
-    if (index != -1)
-        openFileDescriptors[index].setName(newFileName);
+    // Entries are named by their path, so those under a directory are renamed with it. They keep their
+    // ids and parents, and the one journal record stands for them all
+    for (int child : subtree)
+        MainDir.rename(child, string(newPath).append(MainDir.getName(child), oldName.size()));
 
     // Return 1 to indicate success.
     return 1;
 }
 
+// ------------------------------------------------------------------------
+int fsDisk::MakeDir(string_view dirName)
+{
+    OperationLock lock(this, true);
+
+    if (!b_is_formated)
+        return makeError("ERR");
+
+    string_view path = canonicalPath(dirName);
+    int parent;
+    if (lookupPath(path, &parent) != -1 || parent == -1)
+        return makeError("ERR");
+
+    TransactionScope transaction(this);
+
+    if (createEntry(path, parent, INODE_DIRECTORY) == -1)
+        return makeError("ERR");
+
+    return 1;
+}
+
+// ------------------------------------------------------------------------
+int fsDisk::RemoveDir(string_view dirName)
+{
+    OperationLock lock(this, true);
+
+    // The root can't be removed, it has no parent
+    int parent;
+    int id = b_is_formated ? lookupPath(canonicalPath(dirName), &parent) : -1;
+    if (id == -1 || parent == -1 || !isDirectory(id))
+        return makeError("ERR");
+
+    vector<int> entries;
+    if (listDirectory(id, entries) == -1 || !entries.empty())
+        return makeError("ERR");
+
+    TransactionScope transaction(this);
+
+    if (detachEntry(id) == -1)
+        return makeError("ERR");
+
+    // The directory may still hold removed records
+    fsInode* inode = getInode(id);
+    if (inode == nullptr)
+        return makeError("ERR");
+
+    deleteBlocks(inode);
+    deleteFromMainDir(id, true);
+
+    return 1;
+}
+
+// ------------------------------------------------------------------------
+int fsDisk::ReadDir(string_view dirName, vector<string>& names)
+{
+    OperationLock lock(this, true);
+
+    int parent;
+    int id = b_is_formated ? lookupPath(canonicalPath(dirName), &parent) : -1;
+    if (id == -1 || !isDirectory(id))
+        return makeError("ERR");
+
+    // Only the directory's own file is read, the names come from its records
+    vector<int> entries;
+    if (listDirectory(id, entries) == -1)
+        return makeError("ERR");
+
+    for (int child : entries)
+        names.emplace_back(leafName(MainDir.getName(child)));
+
+    return static_cast<int>(entries.size());
+}
+
+// ------------------------------------------------------------------------
+int fsDisk::SyncDisk()
+{
+    // Alone, so a full journal can be started over right away
+    OperationLock lock(this, true);
+    drainAsync(); // Completed asynchronous writes are part of what's synced
+
+    if (commitJournal() == -1)
+        return makeError("ERR");
+
+    return 1;
+}
+
+// ------------------------------------------------------------------------
+off_t fsDisk::getDiskSize() const
+{
+    return diskSize;
+}
+
+// ------------------------------------------------------------------------
+long long fsDisk::getCacheHits() const
+{
+    return cache->getHits();
+}
+
+// ------------------------------------------------------------------------
+long long fsDisk::getCacheMisses() const
+{
+    return cache->getMisses();
+}
+
+// ------------------------------------------------------------------------
+size_t fsDisk::getInodeFootprint() const
+{
+    return inodeSlab.getFootprint();
+}
+
+// ------------------------------------------------------------------------
+size_t fsDisk::getResidentInodes() const
+{
+    return inodeSlab.getInUse();
+}
+
 // Destructor
 fsDisk::~fsDisk()
 {
-    fclose(sim_disk_fd);
-    delete[] BitVector;
-
-    // Delete all fsInode objects in the MainDir map
-    for (auto &pair: MainDir)
-        delete pair.second;
+    // Callbacks that haven't run are dropped, but the accesses in flight finish first
+    drainAsync();
+    delete asyncEngine;
+    asyncEngine = nullptr;
+
+    writeMetadata();
+    delete journal;
+    delete cache;
+    delete sim_disk; // Flushes and releases the image
+
+    // Return the inodes in the main directory to the slab, which frees their storage
+    for (int id = MainDir.first(); id != -1; id = MainDir.next(id))
+        inodeSlab.release(MainDir.get(id).inode);
+}
 
-    // Iterate through the vector and delete each pointer
-    for (std::vector<fsInode*>::iterator it = deletedFiles.begin(); it != deletedFiles.end(); ++it)
-        delete *it; // Delete the pointed object
+void fsDisk::encodePointer(int block, char* dest) {
+    uint32_t value = static_cast<uint32_t>(block);
 
+    for (int i = 0; i < POINTER_SIZE; i++)
+        dest[i] = static_cast<char>((value >> (8 * i)) & 0xFF);
 }
 
-char fsDisk::decToBinaryChar(int n) {
-    return static_cast<char>(n);
+int fsDisk::decodePointer(const char* src) {
+    uint32_t value = 0;
+
+    for (int i = 0; i < POINTER_SIZE; i++)
+        value |= static_cast<uint32_t>(static_cast<unsigned char>(src[i])) << (8 * i);
+
+    return static_cast<int>(value);
 }
\ No newline at end of file
@@ -2,186 +2,699 @@
 #define DISK_SIMULATOR_FSDISK_H
 
 
+#include <algorithm>
+#include <atomic>
 #include <iostream>
-#include <map>
+#include <mutex>
+#include <shared_mutex>
+#include <unordered_map>
+#include <list>
+#include <set>
 #include <vector>
 #include <cassert>
 #include <cmath>
+#include <functional>
 #include <string.h>
+#include <climits>
+#include <sys/uio.h>
+#include "AsyncEngine.h"
+#include "BlockDevice.h"
+#include "BlockCache.h"
+#include "BlockRangeSet.h"
+#include "Directory.h"
 #include "FileDescriptor.h"
+#include "FreeBlockMap.h"
+#include "Journal.h"
 #include "fsInode.h"
+#include "InodeSlab.h"
+#include "Superblock.h"
 
 using namespace std;
 
-#define DISK_SIM_FILE "DISK_SIM_FILE.txt"
-#define DISK_SIZE 512
-#define MIN_BLOCK_SIZE 2
+#define DEFAULT_DISK_SIZE 512
+#define IO_CHUNK_SIZE 65536
+#define MIN_BLOCK_SIZE POINTER_SIZE // An indirect block must hold at least one pointer
 #define AMOUNT_OF_DIRECT 3
+#define MAX_RESIDENT_INODES 1024 // Inodes kept in memory before unused ones are dropped, they are reread on demand
+#define EXTENT_SIZE 8 // On-disk extent tree entry: two int32 values
+#define EXTENT_HEADER_SIZE 8 // Entry count and height at the start of an extent tree node
+#define MIN_EXTENT_BLOCK_SIZE (EXTENT_HEADER_SIZE + INLINE_EXTENTS * EXTENT_SIZE) // A node must take the inline entries
+#define EXTENT_MAX_DEPTH 4 // Levels of extent tree nodes under an inode
+#define FD_INDEX_BITS 20 // Low bits of a file descriptor hold its slot, the bits above the slot's generation
+#define FD_SLOTS (1 << FD_INDEX_BITS) // Maximum number of file descriptors open at once
+#define FD_GENERATIONS (1u << (31 - FD_INDEX_BITS)) // Generations of a slot before they repeat, descriptors stay positive
+#define IO_APPEND -1 // Offset of a batched write that goes to the end of the file
+#define DIRENT_HEADER_SIZE 4 // Header of a record in a directory's file: the name length, before the name
+#define DIRENT_DELETED 0x80000000u // Set in the header of a record whose entry was removed
+
+/**
+ * Kind of operation in a batch given to fsDisk::SubmitBatch.
+ */
+enum IoOpcode {
+    IO_READ,
+    IO_WRITE
+};
+
+/**
+ * One operation of a batch given to fsDisk::SubmitBatch.
+ */
+struct IoRequest {
+    IoOpcode opcode;    // IO_READ or IO_WRITE
+    int fd;             // The file descriptor to read from or write to
+    char* buf;          // The buffer to read into, or holding the data to write
+    int len;            // The amount of bytes to read or write
+    off_t offset;       // The offset in the file, or IO_APPEND for a write to the end of the file
+    int result;         // Set by SubmitBatch: the amount of bytes read or written, or -1 on error
+};
+
+/**
+ * Called with a request given to fsDisk::SubmitAsync once it completed, its result set.
+ */
+typedef function<void(const IoRequest&)> IoCallback;
 
 /**
  * fsDisk class represents the disk management system for a filesystem.
  * It manages the disk structure, block allocation, directories, and file descriptors.
+ *
+ * A disk can be shared between threads. Operations that change the directory or the descriptor
+ * table run alone, reads and writes hold the directory lock shared plus the lock of their file,
+ * so different files are read and written in parallel. Blocks are claimed without a lock.
  */
 class fsDisk {
 private:
-    FILE* sim_disk_fd; // File for the simulated disk file
+
+    /**
+     * Position in the caller's buffers during a write: the next byte to write and how many are left.
+     * Writes are driven by this length only, so the data may hold any byte, including zeros.
+     */
+    struct WriteCursor {
+        const iovec* iov;   // The buffers left to write, the first one holds the next byte
+        size_t iovOffset;   // Offset of the next byte in the first buffer
+        int remaining;
+        int group; // Allocation group new blocks are taken from
+    };
+
+    /**
+     * Part of a batched operation that maps to adjacent bytes on the disk.
+     */
+    struct BatchSegment {
+        off_t location; // Absolute offset on the disk
+        char* buf;      // The operation's buffer at this part
+        int len;        // The amount of bytes
+        size_t op;      // Index of the operation in the batch, or the ticket of an asynchronous request
+    };
+
+    /**
+     * Entry of the descriptor table. A free slot links to the next free one, and its generation
+     * is bumped whenever it's freed, so descriptors to its earlier files are rejected.
+     */
+    struct DescriptorSlot {
+        FileDescriptor descriptor;
+        unsigned generation;
+        int nextFree; // Next free slot, -1 at the end of the free list or while in use
+    };
+
+    /**
+     * Asynchronous request whose callback hasn't run yet, with the amount of its disk accesses in flight.
+     */
+    struct AsyncRequest {
+        IoRequest request;
+        IoCallback callback;
+        int pending;
+        vector<pair<off_t, off_t>> blocks; // First and last block of each access, emptied once none is in flight
+    };
+
+    /**
+     * Extent tree node read from the disk. A leaf (height 0) holds extents as (first block, blocks),
+     * an index node holds (node block, file blocks under it), in file order.
+     */
+    struct ExtentNode {
+        int height;
+        vector<pair<int, int>> entries;
+    };
+
+    /**
+     * Journal transaction covering the scope it lives in: opened on construction, closed on destruction.
+     * Nested scopes join the outermost transaction.
+     */
+    struct TransactionScope {
+        fsDisk* disk;
+
+        explicit TransactionScope(fsDisk* _disk) : disk(_disk) { disk->beginTransaction(); }
+        ~TransactionScope() { disk->endTransaction(); }
+    };
+
+    /**
+     * Locks held by a public operation for its whole duration: the directory lock, shared or exclusive,
+     * then optionally the lock of the file it works on. An operation called from another one on the
+     * same thread is covered by the outer operation's locks and takes none. A journal left full by an
+     * earlier operation is saved first, since that needs the directory to itself.
+     * Must be declared before the operation's TransactionScope, so the transaction closes first.
+     */
+    class OperationLock {
+        fsDisk* disk;
+        bool owner;             // This lock took the locks, false when nested in another operation
+        bool exclusive;         // The directory lock is held exclusively
+        fsInode* inode;         // The file locked by lockInode, nullptr if none
+        bool inodeExclusive;    // The file's lock is held exclusively
+
+    public:
+        OperationLock(fsDisk* _disk, bool _exclusive);
+        void lockInode(fsInode* _inode, bool _exclusive);
+        ~OperationLock();
+    };
+
+    BlockDevice* sim_disk; // Storage backend holding the simulated disk image
+    BlockCache* cache; // Write-back cache every block access goes through
+    Journal* journal; // Write-ahead log of metadata changes since the last saved metadata
 
     bool b_is_formated; // Indicates whether the disk is formatted
     bool b_is_first_format; // Indicates whether it's the first format
     int blockSize; // Size of each block in bytes
-    int currentDiskSize; // Current size of the disk in blocks
-    int blocksUsed; // Number of blocks currently in use
+    off_t diskSize; // Size of the disk in bytes
+    atomic<off_t> currentDiskSize; // Amount of file data currently stored on the disk in bytes
+    off_t dataOffset; // Offset of block 0 in the disk image, past the superblock
+    off_t inodeTableOffset; // Offset of the saved inode table in the disk image
+    off_t inodeTableSize; // Size of the saved inode table in bytes
+    off_t metadataStart; // Offset of the saved metadata regions in the disk image
+    off_t metadataEnd; // Offset past the end of the saved metadata regions
+    InodeFormat inodeFormat; // How the inodes of the disk map their blocks, chosen when formatting
+
+    FreeBlockMap freeMap; // Bitmap of block occupancy, also counts the blocks in use, claimed without a lock
+
+    Directory MainDir; // Every file and directory by its path, the root directory's path is empty
+    int rootId; // Entry id of the root directory, -1 before the disk is formatted
+    set<int> rootEntries; // Entry ids in the root directory, which is kept in memory instead of in a file
+    list<int> residentInodes; // Directory entries of the files whose inode is in memory, most recently used first
+    InodeSlab inodeSlab; // Storage of the inodes in memory, slots of deleted and dropped inodes are reused
 
-    int BitVectorSize; // Size of the BitVector array
-    int* BitVector; // Array indicating block occupancy
+    vector<DescriptorSlot> descriptorSlots; // Descriptor table, indexed by the low bits of a file descriptor
+    int freeDescriptor; // First free slot of the descriptor table, -1 if none
 
-    map<string, fsInode*> MainDir; // Main directory mapping file names to inodes
+    shared_mutex dirLock; // Guards the directory and the file descriptors, exclusive while they change
+    static thread_local fsDisk* lockingDisk; // Disk whose operation the current thread runs, nullptr if none
+    static thread_local bool lockingExclusive; // That operation holds the directory lock exclusively
 
-    vector<FileDescriptor> openFileDescriptors; // List of open file descriptors
-    vector<fsInode*> deletedFiles; // List of deleted fsInodes
+    AsyncEngine* asyncEngine; // Runs the disk accesses of asynchronous requests, created on the first one
+    unordered_map<unsigned long long, AsyncRequest> asyncRequests; // Requests whose callback hasn't run, by ticket
+    vector<unsigned long long> asyncCompleted; // Tickets of the requests with no access left in flight
+    unsigned long long nextTicket; // Ticket of the next asynchronous request
+    BlockRangeSet asyncBlocks; // Blocks the accesses in flight go to, so a cached access finds its overlap in one search
+    atomic<int> asyncInFlight; // Requests with disk accesses in flight, so cached accesses skip the check when 0
+    mutex asyncLock; // Guards the asynchronous requests, never held while waiting for the engine
 
     // Private member functions
 
     /**
-     * Get the index of the first free block on the disk.
+     * Get the index of the first free block on the disk, without claiming it.
      *
      * @return The index of the first free block, or -1 if no free blocks are available.
      */
     int getFreeDiskSpace();
 
     /**
-     * Get the index of the first free location in the list of open file descriptors.
+     * Claim a free block and log it in the open transaction. The block's bit is claimed atomically,
+     * so two threads never get the same block.
      *
-     * @return The index of the first free location, or the size of the list if all locations are in use.
+     * @param group: The allocation group to take the block from, other groups are used once it's full.
+     * @return The index of the block, or -1 if no free blocks are available.
      */
-    int getFreeLocation();
+    int allocateBlock(int group);
 
     /**
-     * Get the index of the file descriptor associated with a given file name.
+     * Claim a run of adjacent free blocks and log them in the open transaction.
      *
-     * @param name: The name of the file to find the descriptor for.
-     * @return The index of the file descriptor, or -1 if not found.
+     * @param goal: The block the run should start at, -1 for none.
+     * @param maxCount: The maximum length of the run.
+     * @param group: The allocation group to take the blocks from when the goal block isn't free.
+     * @param count: Pointer to store the length of the claimed run.
+     * @return The index of the first block of the run, or -1 if no free blocks are available.
      */
-    int getFileDescriptor(string name);
+    int allocateRun(int goal, int maxCount, int group, int* count);
 
     /**
-  * Insert a FileDescriptor into the vector of open file descriptors.
-  *
-  * @param fd: The FileDescriptor to be inserted.
-  * @return The index where the FileDescriptor is inserted.
-  */
-    int insertIntoVector(FileDescriptor fd);
+     * Get the allocation group a file's new blocks are taken from, so its blocks stay together.
+     *
+     * @param inode: Pointer to the inode of the file.
+     * @return The group of the file's first block, or the calling thread's group if it has none.
+     */
+    int getHomeGroup(fsInode* inode);
+
+    /**
+     * Get the number of blocks that can be allocated, including those waiting for a journal commit.
+     *
+     * @return The number of free blocks.
+     */
+    int getFreeBlocksCount();
+
+    /**
+     * Free a block. It's only reusable once the transaction that freed it is committed,
+     * so a crash can't leave a saved file pointing at a block that was already reused.
+     *
+     * @param block: The index of the block.
+     */
+    void releaseBlock(int block);
+
+    /**
+     * Open a journal transaction, or nest into the open one.
+     */
+    void beginTransaction();
+
+    /**
+     * Close the journal transaction. The outermost one logs the inodes of the files it changed,
+     * and commits the batch once it holds JOURNAL_GROUP_SIZE transactions or JOURNAL_BATCH_BYTES.
+     */
+    void endTransaction();
+
+    /**
+     * Mark a file's inode as changed by the open transaction.
+     *
+     * @param name: The name of the file.
+     */
+    void touchFile(const string& name);
+
+    /**
+     * Change the amount of file data stored on the disk, and log the change in the open transaction.
+     *
+     * @param change: The change in bytes.
+     */
+    void changeDiskSize(off_t change);
+
+    /**
+     * Commit the closed transactions with one device flush, after writing back the block cache,
+     * then make the blocks they freed reusable. A full journal is started over by saving the metadata,
+     * which needs the directory lock exclusively; otherwise it's left to the next operation.
+     *
+     * @return 1 if successful, -1 if there's an error.
+     */
+    int commitJournal();
 
     /**
-     * Check if a file with a given name exists in the MainDir map.
+     * Apply a journal record to the loaded metadata, while mounting.
      *
-     * @param name: The name of the file to check.
-     * @return True if the file exists in the map, false otherwise.
+     * @param record: The record to apply.
      */
-    bool isInMap(string name);
+    void applyRecord(const JournalRecord& record);
 
     /**
-     * Check if a given file descriptor is valid and corresponds to an open file.
+     * Open a file descriptor in a free slot of the table, or in a new slot if none is free.
+     * The file's inode must be in memory.
+     *
+     * @param id: The id of the file's directory entry.
+     * @return The file descriptor: the slot in the low FD_INDEX_BITS bits and the slot's generation above them,
+     *         or -1 if FD_SLOTS descriptors are open.
+     */
+    int allocateDescriptor(int id);
+
+    /**
+     * Close a legal file descriptor and put its slot at the head of the free list.
+     *
+     * @param fd: The file descriptor.
+     */
+    void releaseDescriptor(int fd);
+
+    /**
+     * Get the descriptor of a legal file descriptor.
+     *
+     * @param fd: The file descriptor.
+     * @return Reference to the descriptor in its slot.
+     */
+    FileDescriptor& getDescriptor(int fd);
+
+    /**
+     * Get the inode of a file, reading it from the inode table on the image if it isn't in memory.
+     * Marks it as the most recently used, and drops the least recently used inodes past MAX_RESIDENT_INODES.
+     *
+     * @param id: The id of the file's directory entry.
+     * @return Pointer to the inode, or nullptr if it can't be read.
+     */
+    fsInode* getInode(int id);
+
+    /**
+     * Give a directory entry a new, unsaved inode.
+     *
+     * @param id: The id of the file's directory entry.
+     * @param inode: Pointer to the file's inode.
+     */
+    void insertInode(int id, fsInode* inode);
+
+    /**
+     * Drop least recently used inodes until at most MAX_RESIDENT_INODES are in memory.
+     * Only inodes of files that are saved, unchanged since and not open are dropped.
+     */
+    void evictInodes();
+
+    /**
+     * Check if a given file descriptor is valid and corresponds to an open file, in O(1).
      *
      * @param fd: The file descriptor to check.
-     * @return True if the file descriptor is valid and in use, false otherwise.
+     * @return True if the slot is in use by the descriptor's generation, false otherwise (also for a stale descriptor).
      */
     bool isLegalFD(int fd);
 
     /**
-     * Write a character to the specified location on the simulated disk.
+     * Read bytes from the disk through the block cache.
+     *
+     * @param buf: Pointer to the buffer to store the read data.
+     * @param len: The amount of bytes to read.
+     * @param location: The absolute offset on the disk to read from.
+     * @return 1 if successful, -1 if there's an error.
+     */
+    int readDisk(char* buf, size_t len, off_t location);
+
+    /**
+     * Write bytes to the disk through the block cache.
+     *
+     * @param buf: Pointer to the buffer containing data to write.
+     * @param len: The amount of bytes to write.
+     * @param location: The absolute offset on the disk to write to.
+     * @return 1 if successful, -1 if there's an error.
+     */
+    int writeDisk(const char* buf, size_t len, off_t location);
+
+    /**
+     * Write a block pointer to the specified location on the simulated disk.
      *
-     * @param charToWrite: The character to be written.
+     * @param block: The block index to be written.
      * @param location: The location on the disk to write to.
      * @return 1 if the write is successful, -1 if there's an error.
      */
-    int writeLocation(char charToWrite, int location);
+    int writePointer(int block, off_t location);
+
+    /**
+     * Read a block pointer from the specified location on the simulated disk.
+     *
+     * @param location: The location on the disk to read from.
+     * @return The block index stored at the location, or -1 if there's an error.
+     */
+    int readPointer(off_t location);
+
+    /**
+     * Write bytes from a write cursor to the disk, one disk write per buffer they come from,
+     * and advance the cursor past them.
+     *
+     * @param cursor: The data left to write.
+     * @param amount: The amount of bytes to write, at most the bytes left.
+     * @param location: The absolute offset on the disk to write to.
+     * @return 1 if successful, -1 if there's an error.
+     */
+    int writeFromCursor(WriteCursor& cursor, int amount, off_t location);
 
     /**
     * Write a block of data to the specified location on the simulated disk.
     *
     * @param writtenAmount: Pointer to store the amount of data written.
-    * @param buf: Pointer to the buffer containing data to write.
-    * @param amount: The amount of data to write.
+    * @param cursor: The data left to write, advanced past the written bytes.
+    * @param amount: The maximum amount of data to write.
     * @param location: The location on the disk to write to, or -1 to allocate a new block.
     * @return The index of the block where data is written, or -1 if there's an error.
     */
-    int writeBlock(int* writtenAmount, char*& buf, int amount, int location);
+    int writeBlock(int* writtenAmount, WriteCursor& cursor, int amount, off_t location);
 
 
     /**
      * Write data directly to the disk blocks associated with the given inode.
      *
-     * @param buf: Pointer to the buffer containing data to write.
+     * @param cursor: The data left to write, advanced past the written bytes.
      * @param inode: Pointer to the inode associated with the file.
      * @return 0 if no direct blocks are available, 1 if no space left, 2 if write finished, -1 if an error occurred.
      */
-    int writeDirect(char*& buf, fsInode* inode);
+    int writeDirect(WriteCursor& cursor, fsInode* inode);
 
     /**
     * Write data directly to the single indirect block associated with the given inode.
     *
-    * @param buf: Pointer to the buffer containing data to write.
+    * @param cursor: The data left to write, advanced past the written bytes.
     * @param inode: Pointer to the inode associated with the file.
-    * @param indexSingleBlock: The index of the single indirect block.
     * @return The index of the new block written, -1 if an error occurred.
     */
-    int writeSingle(char*& buf, fsInode* inode, int indexSingleBlock);
+    int writeSingle(WriteCursor& cursor, fsInode* inode);
 
     /**
      * Get the location of the last block in the single indirect block associated with the given inode.
      *
      * @param inode: Pointer to the inode associated with the file.
-     * @return The location of the last block in the single indirect block.
+     * @return The absolute offset of the last block in the single indirect block.
      */
-    int getLastBlockInSingle(fsInode* inode);
+    off_t getLastBlockInSingle(fsInode* inode);
 
     /**
      * Get the location of the last block in a single indirect block at the specified location.
      *
-     * @param location: The location of the single indirect block.
+     * @param location: The absolute offset of the single indirect block.
      * @param blocksAmount: The number of blocks in the single indirect block.
-     * @return The location of the last block in the single indirect block.
+     * @return The absolute offset of the last block in the single indirect block, or -1 if there's an error.
      */
-    int getLastBlockInSingle(int location, int blocksAmount);
+    off_t getLastBlockInSingle(off_t location, int blocksAmount);
 
     /**
      * Write data to the single indirect block associated with the given inode.
      *
-     * @param buf: Pointer to the buffer containing data to write.
+     * @param cursor: The data left to write, advanced past the written bytes.
      * @param inode: Pointer to the inode associated with the file.
      * @return 0 if no space in single indirect block, 1 if no space left on disk, 2 if write finished, -1 if an error occurred.
      */
-    int writeSingleInDirect(char*& buf, fsInode* inode);
+    int writeSingleInDirect(WriteCursor& cursor, fsInode* inode);
 
     /**
     * Write data to the double indirect block associated with the given inode.
     *
-    * @param buf: Pointer to the buffer containing data to write.
+    * @param cursor: The data left to write, advanced past the written bytes.
     * @param inode: Pointer to the inode associated with the file.
     * @return 0 if no space in double indirect block, 1 if no space left on disk,
     *         2 if write finished, -1 if an error occurred.
     */
-    int writeDoubleInDirect(char*& buf, fsInode* inode);
+    int writeDoubleInDirect(WriteCursor& cursor, fsInode* inode);
+
+    /**
+    * Write data to the triple indirect block associated with the given inode. The position of the new block
+    * under it follows from the number of blocks in use, the double and single blocks on the way are created
+    * when the new block is the first under them.
+    *
+    * @param cursor: The data left to write, advanced past the written bytes.
+    * @param inode: Pointer to the inode associated with the file.
+    * @return 1 if no space left or nothing left to write, 2 if a block was written, -1 if an error occurred.
+    */
+    int writeTripleInDirect(WriteCursor& cursor, fsInode* inode);
+
+    /**
+     * Get the last single indirect block under the double indirect block of an inode, read from the double.
+     *
+     * @param inode: Pointer to the inode associated with the file.
+     * @return The block index of the single, or -1 if there's an error.
+     */
+    int getLastSingleInDouble(fsInode* inode);
 
     /**
-     * Delete a file from the MainDir map and optionally reduce disk size.
+     * Collect the single indirect blocks under the double indirect block of an inode, in file order.
+     * The double is read once; how many blocks are under each single follows from the inode's block count.
      *
-     * @param name: The name of the file to delete.
+     * @param inode: Pointer to the inode associated with the file.
+     * @param singles: Vector to append the singles to, as (block index, number of blocks under it).
+     * @return 1 if successful, -1 if an error occurred.
+     */
+    int collectDoubleSingles(fsInode* inode, vector<pair<int, int>>& singles);
+
+    /**
+     * Collect the single indirect blocks under the triple indirect block of an inode, in file order.
+     *
+     * @param inode: Pointer to the inode associated with the file.
+     * @param singles: Vector to append the singles to, as (block index, number of blocks under it).
+     * @param doubles: Vector to append the double indirect blocks to, may be nullptr.
+     * @return 1 if successful, -1 if an error occurred.
+     */
+    int collectTripleSingles(fsInode* inode, vector<pair<int, int>>& singles, vector<int>* doubles);
+
+    /**
+     * Delete a file from the main directory and optionally reduce disk size.
+     *
+     * @param id: The id of the file's directory entry.
      * @param reduceDiskSize: Flag indicating whether to reduce disk size.
-     * @return true if successful, false if the file is not found.
+     * @return true if successful, false if the file's inode can't be read.
      */
-    bool deleteFromMainDir(const std::string& name, bool reduceDiskSize);
+    bool deleteFromMainDir(int id, bool reduceDiskSize);
 
     /**
-    * Read data from the disk into the buffer.
+     * Strip the optional leading slash of a path. Paths name a file by the directories leading to it,
+     * separated by slashes, starting at the root; they are the names MainDir and the journal use.
+     *
+     * @param path: The path as given by the caller.
+     * @return The path without a leading slash.
+     */
+    static string_view canonicalPath(string_view path);
+
+    /**
+     * Get the path of the directory holding an entry.
+     *
+     * @param path: The canonical path of the entry.
+     * @return The path of its directory, empty for the root.
+     */
+    static string_view parentPath(string_view path);
+
+    /**
+     * Get the last component of a path.
+     *
+     * @param path: The canonical path of the entry.
+     * @return The name of the entry inside its directory.
+     */
+    static string_view leafName(string_view path);
+
+    /**
+     * Resolve a path with a single probe of MainDir, whatever its depth. The directories above an entry
+     * exist as long as it does, so only a path that doesn't exist costs a second probe, for its parent.
+     *
+     * @param path: The canonical path.
+     * @param parent: Pointer to store the entry id of the directory the last component belongs in,
+     *                -1 if a directory leading to it doesn't exist, the path is malformed or names the root.
+     * @return The entry id the path resolves to, or -1 if it doesn't exist.
+     */
+    int lookupPath(string_view path, int* parent);
+
+    /**
+     * Check if an entry is a directory.
+     *
+     * @param id: The id of the entry.
+     * @return True if it's a directory, false if it's a file. The inode isn't read.
+     */
+    bool isDirectory(int id);
+
+    /**
+     * Create an entry with an empty inode and add its name to its directory, in the open transaction.
+     *
+     * @param path: The canonical path of the entry, which must not exist.
+     * @param parent: The entry id of the directory it goes into.
+     * @param type: Whether the entry is a file or a directory.
+     * @return The id of the new entry, or -1 if its name doesn't fit on the disk.
+     */
+    int createEntry(string_view path, int parent, InodeType type);
+
+    /**
+     * Remove an entry's name from its directory and remember that it's gone. The entry itself stays.
+     *
+     * @param id: The id of the entry.
+     * @return 1 if successful, -1 if there's an error.
+     */
+    int detachEntry(int id);
+
+    /**
+     * Decode a record of a directory's file: DIRENT_HEADER_SIZE bytes with the name length,
+     * and DIRENT_DELETED once the entry is removed, followed by the name.
+     *
+     * @param data: The contents of the directory's file.
+     * @param pos: Pointer to the offset of the record, moved past it.
+     * @param name: Pointer to store the name the record holds, viewing data.
+     * @return 1 for a record of an entry, 0 for a removed one, -1 past the last record.
+     */
+    static int decodeRecord(const string& data, size_t* pos, string_view* name);
+
+    /**
+     * Check if a directory record surely fits on the disk, with any indirect blocks it may need.
+     *
+     * @param len: The length of the record in bytes.
+     * @return True if it fits, false otherwise.
+     */
+    bool hasRoomFor(int len);
+
+    /**
+     * Read the whole file of a directory.
+     *
+     * @param dir: The entry id of the directory.
+     * @param data: String to store the contents in.
+     * @return 1 if successful, -1 if there's an error.
+     */
+    int readDirectory(int dir, string& data);
+
+    /**
+     * Get the entries of a directory from its file, in the order they were added.
+     * The root's entries come from rootEntries, in id order.
+     *
+     * @param dir: The entry id of the directory.
+     * @param ids: Vector to append the entry ids to.
+     * @return 1 if successful, -1 if there's an error.
+     */
+    int listDirectory(int dir, vector<int>& ids);
+
+    /**
+     * Get every entry under a directory, at any depth, parents before their entries.
+     *
+     * @param dir: The entry id of the directory.
+     * @param ids: Vector to append the entry ids to.
+     * @return 1 if successful, -1 if there's an error.
+     */
+    int collectSubtree(int dir, vector<int>& ids);
+
+    /**
+     * Append a name's record to a directory's file. Does nothing for the root.
+     *
+     * @param dir: The entry id of the directory.
+     * @param name: The name of the new entry.
+     * @return 1 if successful, -1 if the record doesn't fit or there's an error.
+     */
+    int linkEntry(int dir, string_view name);
+
+    /**
+     * Remove a name's record from a directory's file, nothing for the root. The record is marked as removed in place,
+     * unless removed records would take most of the file, then the file is written again without them.
+     *
+     * @param dir: The entry id of the directory.
+     * @param name: The name of the removed entry.
+     * @return 1 if successful, -1 if there's an error.
+     */
+    int unlinkEntry(int dir, string_view name);
+
+    /**
+     * Free a directory's blocks and write its live records into a new empty inode.
+     *
+     * @param dir: The entry id of the directory.
+     * @param data: The contents of the directory's file.
+     * @param skip: The offset of a live record to leave out.
+     * @return 1 if successful, -1 if there's an error.
+     */
+    int rewriteDirectory(int dir, const string& data, size_t skip);
+
+    /**
+     * Append data to the end of a file through its inode, in a transaction of its own or the open one.
+     *
+     * @param name: The name of the file, whose inode the transaction records.
+     * @param inode: Pointer to the inode of the file.
+     * @param iov: The buffers holding the data.
+     * @param len: The total length of the buffers.
+     * @return The amount of bytes written (less when the disk or the file is full), or -1 if there's an error.
+     */
+    int appendToInode(const string& name, fsInode* inode, const iovec* iov, int len);
+
+    /**
+     * Read data from a file through its inode.
+     *
+     * @param inode: Pointer to the inode of the file.
+     * @param buf: The buffer to store the read data.
+     * @param len: The maximum length of data to read.
+     * @param offset: The offset in the file to read from.
+     * @return The amount of bytes read (0 at the end of the file), or -1 if there's an error.
+     */
+    int readFromInode(fsInode* inode, char *buf, int len, off_t offset);
+
+    /**
+     * Overwrite data inside a file through its inode, stopping at the end of the file.
+     *
+     * @param inode: Pointer to the inode of the file.
+     * @param buf: The buffer containing data to be written.
+     * @param len: The length of data to write.
+     * @param offset: The offset in the file to write to.
+     * @return The amount of bytes overwritten, or -1 if there's an error.
+     */
+    int overwriteInode(fsInode* inode, const char *buf, int len, off_t offset);
+
+    /**
+    * Read up to one block of data from the disk into the buffer.
     *
     * @param len: The total amount of data to read.
     * @param buf: Pointer to the buffer to store the read data.
     * @param buf_index: The current index in the buffer.
-    * @return The amount of data read.
+    * @param location: The absolute offset on the disk to read from.
+    * @return The amount of data read, or -1 if there's an error.
     */
-    int makeRead(int len, char*& buf, int buf_index);
+    int makeRead(int len, char*& buf, int buf_index, off_t location);
 
     /**
      * Read data from single indirect blocks associated with an inode.
@@ -194,16 +707,218 @@ private:
      * @param isIndex: Flag indicating whether 'singleAddress' is an index or an absolute address.
      * @return 1 if successful, -1 if an error occurred.
      */
-    int readSingleInDirect(int *len, char*& buf, int *buf_index, int singleAddress, int blocksAmount, bool isIndex);
+    int readSingleInDirect(int *len, char*& buf, int *buf_index, off_t singleAddress, int blocksAmount, bool isIndex);
+
+    /**
+     * Collect the locations of the first blocks of a file, in file order.
+     * Resolves the direct, singleInDirect, doubleInDirect and tripleInDirect pointers of the inode.
+     *
+     * @param inode: Pointer to the inode associated with the file.
+     * @param blocksToRead: The maximum number of blocks to collect.
+     * @param blocks: Vector to append the block indexes to.
+     * @return 1 if successful, -1 if an error occurred.
+     */
+    int collectBlocks(fsInode* inode, int blocksToRead, vector<int>& blocks);
+
+    /**
+     * Get the location of a block of a file by its index in the file.
+     * Costs one pointer read per indirect level above the block, or one node read per extent tree level.
+     *
+     * @param inode: Pointer to the inode associated with the file.
+     * @param index: The index of the block in the file (0 is the first direct block).
+     * @param run: Pointer to store how many blocks from this one on follow each other on the disk, may be nullptr.
+     * @return The block index on the disk, or -1 if the file has no such block.
+     */
+    int getFileBlock(fsInode* inode, int index, int* run = nullptr);
+
+    /**
+     * Write data to a file of the extent format: the unused tail of its last block, then runs of
+     * adjacent blocks, each written with one disk write and added to the file as one extent.
+     *
+     * @param cursor: The data left to write, advanced past the written bytes.
+     * @param inode: Pointer to the inode associated with the file.
+     * @return 1 if successful (also when the disk or the file is full), -1 if an error occurred.
+     */
+    int writeExtents(WriteCursor& cursor, fsInode* inode);
+
+    /**
+     * Add a run of blocks at the end of a file of the extent format. The last extent is extended when
+     * the run follows it, otherwise a new extent is added, along the right edge of the extent tree.
+     * Full inline entries are moved to a new node, one level down.
+     *
+     * @param inode: Pointer to the inode associated with the file.
+     * @param start: The first block of the run.
+     * @param count: The number of blocks in the run.
+     * @param group: The allocation group new tree nodes are taken from.
+     * @return 1 if added, 0 if the tree is at EXTENT_MAX_DEPTH and full, -1 if an error occurred.
+     */
+    int appendExtent(fsInode* inode, int start, int count, int group);
+
+    /**
+     * Add a run of blocks under the last entry of an extent tree node.
+     *
+     * @param inode: Pointer to the inode associated with the file.
+     * @param node: The block of the node.
+     * @param start: The first block of the run.
+     * @param count: The number of blocks in the run.
+     * @param group: The allocation group new tree nodes are taken from.
+     * @return 1 if added, 0 if the node and the nodes under it are full, -1 if an error occurred.
+     */
+    int appendToExtentNode(fsInode* inode, int node, int start, int count, int group);
+
+    /**
+     * Build a chain of new extent tree nodes, one per level, ending in a leaf holding a single extent.
+     *
+     * @param inode: Pointer to the inode associated with the file.
+     * @param height: The height of the top node of the chain.
+     * @param start: The first block of the extent.
+     * @param count: The number of blocks in the extent.
+     * @param group: The allocation group the nodes are taken from.
+     * @return The block of the top node, or -1 if an error occurred.
+     */
+    int newExtentBranch(fsInode* inode, int height, int start, int count, int group);
+
+    /**
+     * Read an extent tree node.
+     *
+     * @param block: The block of the node.
+     * @param node: The node to fill.
+     * @return 1 if successful, -1 if there's an error or the block holds no valid node.
+     */
+    int readExtentNode(int block, ExtentNode& node);
+
+    /**
+     * Write the header of an extent tree node.
+     *
+     * @param block: The block of the node.
+     * @param count: The number of entries in the node.
+     * @param height: The height of the node, 0 for a leaf.
+     * @return 1 if successful, -1 if there's an error.
+     */
+    int writeExtentHeader(int block, int count, int height);
+
+    /**
+     * Write an entry of an extent tree node.
+     *
+     * @param block: The block of the node.
+     * @param index: The index of the entry.
+     * @param first: The first block of the extent, or the block of the node the entry points at.
+     * @param second: The number of blocks of the extent, or the file blocks under that node.
+     * @return 1 if successful, -1 if there's an error.
+     */
+    int writeExtentEntry(int block, int index, int first, int second);
+
+    /**
+     * Collect the extents of a file of the extent format, in file order.
+     *
+     * @param inode: Pointer to the inode associated with the file.
+     * @param extents: Vector to append the extents to, as (first block, blocks).
+     * @param nodes: Vector to append the blocks of the extent tree nodes to, may be nullptr.
+     * @return 1 if successful, -1 if an error occurred.
+     */
+    int collectExtents(fsInode* inode, vector<pair<int, int>>& extents, vector<int>* nodes);
+
+    /**
+     * Collect the extents under a list of extent tree entries, in file order.
+     *
+     * @param entries: The entries, inline or of a node.
+     * @param height: The height of the level the entries are on, 0 when they are extents.
+     * @param extents: Vector to append the extents to, as (first block, blocks).
+     * @param nodes: Vector to append the blocks of the extent tree nodes to, may be nullptr.
+     * @return 1 if successful, -1 if an error occurred.
+     */
+    int collectExtents(const vector<pair<int, int>>& entries, int height, vector<pair<int, int>>& extents, vector<int>* nodes);
+
+    /**
+     * Split a range of a file into segments of adjacent bytes on the disk.
+     *
+     * @param inode: Pointer to the inode associated with the file.
+     * @param buf: The operation's buffer for the range.
+     * @param len: The length of the range, inside the file.
+     * @param offset: The offset of the range in the file.
+     * @param op: Index of the operation in the batch, or the ticket of an asynchronous request.
+     * @param segments: Vector to append the segments to, left unchanged on error.
+     * @return 1 if successful, -1 if an error occurred.
+     */
+    int mapSegments(fsInode* inode, char* buf, int len, off_t offset, size_t op, vector<BatchSegment>& segments);
+
+    /**
+     * Do the I/O of batched segments in disk order. Segments that follow each other on the disk are
+     * merged into one disk access of up to IO_CHUNK_SIZE bytes through a staging buffer.
+     * Overlapping writes are done in submission order instead, so the last one wins.
+     *
+     * @param segments: The segments, sorted by this call.
+     * @param write: Write the segments, otherwise read them.
+     * @param requests: The batch, the operation of a failed segment gets a result of -1.
+     */
+    void runSegments(vector<BatchSegment>& segments, bool write, vector<IoRequest>& requests);
+
+    /**
+     * Prepare a write of a batch or an asynchronous request: the part past the end of the file is
+     * appended right away, the part inside the file is mapped to segments for later.
+     *
+     * @param request: The write, its result is set to the amount of bytes it covers if successful.
+     * @param op: Index of the operation in the batch, or the ticket of the asynchronous request.
+     * @param segments: Vector to append the overwritten segments to.
+     * @return 1 if successful, -1 if the request is illegal or can't be mapped (its result is left unchanged).
+     */
+    int prepareWrite(IoRequest& request, size_t op, vector<BatchSegment>& segments);
+
+    /**
+     * Prepare a read of a batch or an asynchronous request by mapping the part inside the file to segments.
+     *
+     * @param request: The read, its result is set to the amount of bytes it covers if successful.
+     * @param op: Index of the operation in the batch, or the ticket of the asynchronous request.
+     * @param segments: Vector to append the segments to.
+     * @return 1 if successful, -1 if the request is illegal or can't be mapped (its result is left unchanged).
+     */
+    int prepareRead(IoRequest& request, size_t op, vector<BatchSegment>& segments);
+
+    /**
+     * Collect finished disk accesses from the engine and mark the requests with none left in flight as completed.
+     *
+     * @param minimum: The least amount of accesses to wait for, 0 to only take the finished ones.
+     * @return The amount of accesses collected.
+     */
+    int reapAsync(int minimum);
+
+    /**
+     * Run the callbacks of the completed asynchronous requests and forget the requests.
+     *
+     * @return The amount of callbacks run.
+     */
+    int runCompletions();
+
+    /**
+     * Wait for every asynchronous disk access in flight. Their callbacks are left for the next poll or wait.
+     */
+    void drainAsync();
+
+    /**
+     * Wait for the asynchronous accesses in flight to the blocks of a range. The cache loads and writes back
+     * whole blocks, so touching such a block earlier could read the old data or write it over the new.
+     *
+     * @param location: The absolute offset on the disk where the range starts.
+     * @param len: The length of the range in bytes.
+     */
+    void waitForAsync(off_t location, size_t len);
+
+    /**
+     * Stop tracking the blocks of an asynchronous request that has no access in flight anymore.
+     * The caller holds asyncLock.
+     *
+     * @param async: The request.
+     */
+    void finishAsyncBlocks(AsyncRequest& async);
 
     /**
      * Delete single indirect blocks and their associated data.
      *
-     * @param singleLocation: The location of the single indirect block.
+     * @param singleLocation: The absolute offset of the single indirect block.
      * @param blocksAmount: The number of blocks in the single indirect block.
      * @return true if successful, false otherwise.
      */
-    bool deleteSingleBlock(int singleLocation, int blocksAmount);
+    bool deleteSingleBlock(off_t singleLocation, int blocksAmount);
 
     /**
       * Delete blocks associated with an inode.
@@ -228,13 +943,33 @@ private:
      * @param removeBlocks: The number of blocks to remove.
      * @return true if there is enough space, false otherwise.
      */
-    bool isEnoughSpaceToCopy(int requiredBlocks, int removeBlocks) const;
+    bool isEnoughSpaceToCopy(int requiredBlocks, int removeBlocks);
 
     /**
-     * Initialize the disk's state.
+     * Initialize the disk's state and zero the disk image.
+     * The backend drops the image content instead of writing zeros, so formatting is O(1).
      */
     void init();
 
+    /**
+     * Checkpoint: save the free bitmap, the inode table and the directory past the data area, then the superblock.
+     * The superblock is written last, after a flush, so it never points at metadata that isn't on the image.
+     * Records of inodes that aren't in memory are copied from the previous inode table.
+     * The saved metadata covers every journal transaction, so the journal is started over.
+     *
+     * @return 1 if successful, -1 if there's an error.
+     */
+    int writeMetadata();
+
+    /**
+     * Mount the disk image: read the superblock, then the free bitmap and directory it points to.
+     * Inodes are left on the image until their file is used, so mounting doesn't read the inode table.
+     * Transactions committed to the journal since are replayed, and the result is saved.
+     *
+     * @return 1 if successful, -1 if the image holds no valid filesystem.
+     */
+    int loadMetadata();
+
     /**
      * Delete all entries from the MainDir map and free associated resources.
      */
@@ -249,18 +984,39 @@ private:
     static int makeError(string text);
 
 
-    static char decToBinaryChar(int n);
+    /**
+     * Encode a block index as a POINTER_SIZE wide little-endian pointer.
+     *
+     * @param block: The block index to encode.
+     * @param dest: Pointer to POINTER_SIZE bytes to store the pointer in.
+     */
+    static void encodePointer(int block, char* dest);
 
+    /**
+     * Decode a POINTER_SIZE wide little-endian pointer.
+     *
+     * @param src: Pointer to the POINTER_SIZE bytes of the pointer.
+     * @return The block index stored in the pointer.
+     */
+    static int decodePointer(const char* src);
 
-    bool isStringOnlySpaces(const string &str)
+
+    bool isStringOnlySpaces(const string &str);
 
 public:
 
     /**
   * Constructor for the fsDisk class.
   * Initializes the simulated disk and sets initial properties.
+  *
+  * @param deviceType: The storage backend holding the disk image (default: file).
+  * @param _diskSize: The size of the disk in bytes (default: DEFAULT_DISK_SIZE).
+  * @param cacheBlocks: The number of blocks the block cache holds, 0 disables it (default: DEFAULT_CACHE_BLOCKS).
+  * @param mount: Reopen the existing disk image and its files instead of starting a new one (default: false).
+  *               The disk size and block size then come from the image, an image without a filesystem starts empty.
   */
-    fsDisk();
+    explicit fsDisk(DeviceType deviceType = DEVICE_FILE, off_t _diskSize = DEFAULT_DISK_SIZE,
+                    int cacheBlocks = DEFAULT_CACHE_BLOCKS, bool mount = false);
 
     /**
      * List all open file descriptors and display disk content.
@@ -268,22 +1024,32 @@ public:
     void listAll();
 
     /**
-  * Constructor for the fsDisk class.
-  * Initializes the simulated disk and sets initial properties.
-  */
-    void fsFormat(int blockSize = 4);
+     * Format the disk, dropping every file.
+     *
+     * @param blockSize: The size of each block in bytes (default: 4).
+     * @param _diskSize: The new size of the disk in bytes, or 0 to keep the current size.
+     * @param format: How the inodes map their blocks (default: INODE_INDIRECT).
+     *                INODE_EXTENTS needs a block size of at least MIN_EXTENT_BLOCK_SIZE.
+     */
+    void fsFormat(int blockSize = 4, off_t _diskSize = 0, InodeFormat format = INODE_INDIRECT);
 
     /**
-  * Constructor for the fsDisk class.
-  * Initializes the simulated disk and sets initial properties.
-  */
-    int CreateFile(std::string fileName);
+     * Create an empty file and open it. Paths start at the root, with or without a leading slash,
+     * and their components are separated by single slashes; "." and ".." are not allowed.
+     *
+     * @param fileName: The path of the new file, in a directory that exists and with no entry of that name.
+     * @return The index of the file descriptor of the new file, or an error code.
+     */
+    int CreateFile(std::string_view fileName);
 
     /**
-  * Constructor for the fsDisk class.
-  * Initializes the simulated disk and sets initial properties.
-  */
-    int OpenFile(std::string FileName);
+     * Open an existing file. The path follows the rules of CreateFile, and every component before
+     * the last must be a directory. Directories can't be opened, they are read with ReadDir.
+     *
+     * @param FileName: The path of the file, which must not be open already.
+     * @return The index of the file descriptor, or an error code.
+     */
+    int OpenFile(std::string_view FileName);
 
     /**
      * Close a previously opened file.
@@ -294,14 +1060,76 @@ public:
     string CloseFile(int fd);
 
     /**
-     * Write data to a file.
+     * Write data to a file. The data is written straight from 'buf' and may hold any byte.
      *
      * @param fd: The index of the file descriptor to write to.
      * @param buf: The buffer containing data to be written.
      * @param len: The length of data to write.
      * @return 1 to indicate success or an error code.
      */
-    int WriteToFile(int fd, char *buf, int len);
+    int WriteToFile(int fd, const char *buf, int len);
+
+    /**
+     * Write data gathered from several buffers to a file, like writev. The buffers are appended in order,
+     * with a single walk of the file's inode.
+     *
+     * @param fd: The index of the file descriptor to write to.
+     * @param iov: The buffers holding the data.
+     * @param iovcnt: The number of buffers.
+     * @return The amount of bytes written (less when the disk or the file is full), or an error code.
+     */
+    int WriteToFileV(int fd, const iovec* iov, int iovcnt);
+
+    /**
+     * Read the start of a file scattered into several buffers, like readv. Each buffer is filled
+     * before the next one, no null terminator is added.
+     *
+     * @param fd: The index of the file descriptor to read from.
+     * @param iov: The buffers to store the data.
+     * @param iovcnt: The number of buffers.
+     * @return The amount of bytes read, or an error code.
+     */
+    int ReadFromFileV(int fd, const iovec* iov, int iovcnt);
+
+    /**
+     * Run a batch of reads and writes over any open file descriptors in one pass.
+     * Writes past the end of a file are appended right away, in submission order. Overwrites and reads
+     * are mapped to disk locations, sorted by location, merged where they follow each other on the disk,
+     * and done together: every write first, then every read, so reads see the batch's writes.
+     * Each operation behaves like WriteAt or ReadAt; its outcome is stored in its result.
+     *
+     * @param requests: The operations of the batch.
+     * @return 1 to indicate success or an error code (then no operation ran).
+     */
+    int SubmitBatch(vector<IoRequest>& requests);
+
+    /**
+     * Start a read or a write without waiting for its disk accesses. Like in a batch, the part of a write
+     * past the end of the file is appended before returning; the rest is mapped to disk locations and
+     * handed to the asynchronous engine (io_uring for a file image, a thread pool otherwise), so many
+     * accesses across files are in flight at once. The buffer must stay valid, and the bytes must not be
+     * accessed by other operations, until the callback runs.
+     *
+     * @param request: The operation, copied. Its result is set as in SubmitBatch before the callback gets it.
+     * @param callback: Called by PollCompletions or WaitCompletions once the request completed.
+     * @return A ticket identifying the request, or an error code.
+     */
+    long long SubmitAsync(const IoRequest& request, IoCallback callback);
+
+    /**
+     * Run the callbacks of the asynchronous requests that completed, without waiting.
+     *
+     * @return The amount of callbacks run.
+     */
+    int PollCompletions();
+
+    /**
+     * Wait until asynchronous requests complete and run their callbacks.
+     *
+     * @param minimum: The least amount of callbacks to run, fewer if fewer requests are in flight.
+     * @return The amount of callbacks run, or an error code.
+     */
+    int WaitCompletions(int minimum);
 
     /**
    * Read data from a file.
@@ -314,12 +1142,80 @@ public:
     int ReadFromFile(int fd, char *buf, int len);
 
     /**
-     * Delete a file from the file system.
+     * Read data from a file at a given offset, like pread.
+     * The descriptor's position is not changed and no null terminator is added.
+     *
+     * @param fd: The index of the file descriptor to read from.
+     * @param buf: The buffer to store the read data.
+     * @param len: The maximum length of data to read.
+     * @param offset: The offset in the file to read from.
+     * @return The amount of bytes read (0 at the end of the file), or an error code.
+     */
+    int ReadAt(int fd, char *buf, int len, off_t offset);
+
+    /**
+     * Write data to a file at a given offset, like pwrite.
+     * Bytes inside the file are overwritten in place, bytes past its end are appended.
+     * The descriptor's position is not changed.
      *
-     * @param FileName: The name of the file to be deleted.
+     * @param fd: The index of the file descriptor to write to.
+     * @param buf: The buffer containing data to be written.
+     * @param len: The length of data to write.
+     * @param offset: The offset in the file to write to, at most the file size.
+     * @return The amount of bytes written, or an error code.
+     */
+    int WriteAt(int fd, const char *buf, int len, off_t offset);
+
+    /**
+     * Read data from a file at the descriptor's position, and move the position past it.
+     *
+     * @param fd: The index of the file descriptor to read from.
+     * @param buf: The buffer to store the read data.
+     * @param len: The maximum length of data to read.
+     * @return The amount of bytes read (0 at the end of the file), or an error code.
+     */
+    int Read(int fd, char *buf, int len);
+
+    /**
+     * Write data to a file at the descriptor's position, and move the position past it.
+     *
+     * @param fd: The index of the file descriptor to write to.
+     * @param buf: The buffer containing data to be written.
+     * @param len: The length of data to write.
+     * @return The amount of bytes written, or an error code.
+     */
+    int Write(int fd, const char *buf, int len);
+
+    /**
+     * Move the position of a file descriptor, like lseek.
+     *
+     * @param fd: The index of the file descriptor.
+     * @param offset: The offset to move by.
+     * @param whence: SEEK_SET, SEEK_CUR or SEEK_END.
+     * @return The new position, or an error code if it would leave the range [0, file size].
+     */
+    off_t Lseek(int fd, off_t offset, int whence);
+
+    /**
+     * Read data from a file without copying it.
+     * Each span points straight into the disk image, physically adjacent blocks share one span.
+     * The spans stay valid until the file is written to or deleted, or the disk image is resized
+     * (formatting, or saving metadata that outgrew the image).
+     *
+     * @param fd: The index of the file descriptor to read from.
+     * @param spans: Vector to fill with the spans of the file data.
+     * @param len: The maximum length of data to read.
+     * @return 1 to indicate success or an error code (also when the backend can't expose the image).
+     */
+    int MapFromFile(int fd, vector<iovec>& spans, int len);
+
+    /**
+     * Delete a file from the file system. Directories are removed with RemoveDir.
+     *
+     * @param FileName: The path of the file to be deleted.
      * @return 1 to indicate success or an error code.
      */
-    int DelFile(std::string FileName);
+    int DelFile(std::string_view FileName);
 
     /**
   * Copy a file to a new destination.
@@ -328,16 +1224,86 @@ public:
   * @param destFileName: The name of the destination file.
   * @return 1 to indicate success or an error code.
   */
-    int CopyFile(std::string srcFileName, std::string destFileName);
+    int CopyFile(std::string_view srcFileName, std::string_view destFileName);
+
+    /**
+     * Rename a file or a directory, also into another directory. A directory takes its entries along,
+     * none of which may be open.
+     *
+     * @param oldFileName: The current path of the file.
+     * @param newFileName: The new path for the file, in a directory that exists.
+     * @return 1 to indicate success or an error code.
+     */
+    int RenameFile(std::string_view oldFileName, std::string_view newFileName);
+
+    /**
+     * Create a directory. Its entries are kept as records in a file of its own on the disk.
+     *
+     * @param dirName: The path of the new directory, in a directory that exists.
+     * @return 1 to indicate success or an error code.
+     */
+    int MakeDir(std::string_view dirName);
+
+    /**
+     * Remove an empty directory.
+     *
+     * @param dirName: The path of the directory.
+     * @return 1 to indicate success or an error code.
+     */
+    int RemoveDir(std::string_view dirName);
 
     /**
-     * Rename a file.
+     * List the names in a directory, in the order they were added. Only the directory's own file is read;
+     * the root isn't a file, its names are kept in memory and listed in the order of their entry ids.
+     *
+     * @param dirName: The path of the directory, empty or "/" for the root.
+     * @param names: Vector to append the names to.
+     * @return The amount of names, or an error code.
+     */
+    int ReadDir(std::string_view dirName, vector<string>& names);
+
+    /**
+     * Write back the block cache, commit the journal and flush the simulated disk to stable storage.
+     * Block writes are never flushed on their own, this is the only explicit sync point.
      *
-     * @param oldFileName: The current name of the file.
-     * @param newFileName: The new name for the file.
      * @return 1 to indicate success or an error code.
      */
-    int RenameFile(std::string oldFileName, std::string newFileName);
+    int SyncDisk();
+
+    /**
+     * Get the size of the disk.
+     *
+     * @return The size of the disk in bytes.
+     */
+    off_t getDiskSize() const;
+
+    /**
+     * Get the number of block accesses served from the block cache.
+     *
+     * @return The number of cache hits.
+     */
+    long long getCacheHits() const;
+
+    /**
+     * Get the number of block accesses that had to read the disk image.
+     *
+     * @return The number of cache misses.
+     */
+    long long getCacheMisses() const;
+
+    /**
+     * Get the memory held for inodes in memory, with their child arrays.
+     *
+     * @return The size of the inode slab in bytes.
+     */
+    size_t getInodeFootprint() const;
+
+    /**
+     * Get the number of inodes in memory.
+     *
+     * @return The number of inodes, at most MAX_RESIDENT_INODES besides those of open files.
+     */
+    size_t getResidentInodes() const;
 
     /**
      * Destructor for the fsDisk class.
@@ -1,197 +1,225 @@
+#include <algorithm>
+#include <cstdint>
+#include <cstring>
 #include "fsInode.h"
 
-fsInode::fsInode(int _block_size) {
-    fileSize = 0;
-    blocksInSingleInDirect = 0;
-    block_in_use = 0;
+fsInode::fsInode(int _block_size, InodeFormat _format, InodeType _type) {
     block_size = _block_size;
-    directBlock1 = -1;
-    directBlock2 = -1;
-    directBlock3 = -1;
-    singleInDirect = -1;
-    doubleInDirect = -1;
-    singleBlocksCount = 0;
-    blocksInEachSingle = new int[_block_size];
-    singleBlocksLocation = new int[_block_size];
-
-    for (int i = 0 ; i < _block_size ; i++)
-    {
-        blocksInEachSingle[i] = 0;
-        singleBlocksLocation[i] = -1;
-    }
+    fanout = _block_size / POINTER_SIZE;
+
+    memset(&disk, 0, sizeof(disk));
+    for (int i = 0; i < INODE_MAP_SLOTS; i++)
+        disk.map[i] = -1;
+
+    // An unused extent entry has no blocks
+    if (_format == INODE_EXTENTS)
+        for (int i = 0; i < INLINE_EXTENTS; i++)
+            disk.map[2 * i + 1] = 0;
+
+    disk.format = _format;
+    disk.type = _type;
 }
 
 fsInode::fsInode(const fsInode& other) {
-    fileSize = other.fileSize;
-    block_in_use = other.block_in_use;
+    disk = other.disk;
     block_size = other.block_size;
-    directBlock1 = other.directBlock1;
-    directBlock2 = other.directBlock2;
-    directBlock3 = other.directBlock3;
-    singleInDirect = other.singleInDirect;
-    blocksInSingleInDirect = other.blocksInSingleInDirect;
-    doubleInDirect = other.doubleInDirect;
-    singleBlocksCount = other.singleBlocksCount;
-
-
-    blocksInEachSingle = new int[block_size];
-    singleBlocksLocation = new int[block_size];
-    for (int i = 0; i < block_size; i++)
-    {
-        blocksInEachSingle[i] = other.blocksInEachSingle[i];
-        singleBlocksLocation[i] = other.singleBlocksLocation[i];
-    }
+    fanout = other.fanout;
 }
 
 bool fsInode::isSpace()
 {
-    return (AMOUNT_OF_DIRECT * block_size) + (block_size * block_size) + (block_size * block_size * block_size) <= fileSize;
+    // Block indexes are ints, so no file has more than INT32_MAX blocks whatever the inode could address
+    long long maxBlocks = INT32_MAX;
+
+    if (disk.format == INODE_INDIRECT)
+    {
+        long long pointers = fanout;
+        long long triple = (pointers > 2048) ? INT32_MAX : pointers * pointers * pointers;
+        maxBlocks = std::min<long long>(maxBlocks, AMOUNT_OF_DIRECT + pointers + pointers * pointers + triple);
+    }
+
+    return maxBlocks * block_size <= disk.fileSize;
 }
 
-fsInode::~fsInode() {
-    delete[] blocksInEachSingle;
-    delete[] singleBlocksLocation;
+off_t fsInode::getFileSize() const {
+    return static_cast<off_t>(disk.fileSize);
 }
 
-void fsInode::setSingleBlockLocation(int index, int location) {
-    if (index < 0 || index > 3)
-        return;
+int fsInode::getBlocksInEachSingle(int index) const {
+    long long pointers = fanout;
+    long long blocks = getBlocksInDoubleInDirect() - index * pointers;
+    return static_cast<int>(std::clamp<long long>(blocks, 0, pointers));
+}
 
-    singleBlocksLocation[index] = location;
+void fsInode::addFileSize(off_t size) {
+    disk.fileSize += size;
 }
 
-int fsInode::getSingleBlockLocation(int index) {
-    if (index < 0 || index > 3)
-        return -1;
+int fsInode::getBlockInUse() const {
+    return disk.blockCount;
+}
 
-    return static_cast<int>(singleBlocksLocation[index]);
+void fsInode::addBlockInUse(int num) {
+    disk.blockCount += num;
 }
 
-int fsInode::getFileSize() const {
-    return fileSize;
+int fsInode::getDirectBlock(int index) const {
+    return disk.map[index - 1];
 }
 
-int fsInode::getBlocksInEachSingle(int index) {
-    if (index < 0 || index > 3)
-        return -1;
+int fsInode::getSingleInDirect() const {
+    return disk.map[SINGLE_SLOT];
+}
 
-    return blocksInEachSingle[index];
+int fsInode::getBlocksInSingleInDirect() const {
+    return std::clamp(disk.blockCount - AMOUNT_OF_DIRECT, 0, fanout);
 }
 
-void fsInode::addBlocksInSingleInDirect(int amount) {
-    blocksInSingleInDirect += amount;
+int fsInode::getSingleBlocksCount() const {
+    long long pointers = fanout;
+    return static_cast<int>((getBlocksInDoubleInDirect() + pointers - 1) / pointers);
 }
 
-void fsInode::addSingleBlocksCount(int amount) {
-    singleBlocksCount += amount;
+int fsInode::getTripleInDirect() const {
+    return disk.map[TRIPLE_SLOT];
 }
 
-void fsInode::addBlocksInEachSingle(int index, int amount) {
-    blocksInEachSingle[index] += amount;
+int fsInode::getDoubleInDirect() const {
+    return disk.map[DOUBLE_SLOT];
 }
 
-void fsInode::addFileSize(int size) {
-    fileSize += size;
+int fsInode::getBlockSize() const {
+    return block_size;
 }
 
-int fsInode::getBlockInUse() const {
-    return block_in_use;
+int fsInode::getFanout() const {
+    return fanout;
 }
 
-void fsInode::addBlockInUse(int num) {
-    block_in_use += num;
+std::shared_mutex& fsInode::getLock() {
+    return lock;
 }
 
-int fsInode::getDirectBlock(int index) const {
-    if (index == 1)
-        return directBlock1;
+InodeFormat fsInode::getFormat() const {
+    return static_cast<InodeFormat>(disk.format);
+}
+
+InodeType fsInode::getType() const {
+    return static_cast<InodeType>(disk.type);
+}
 
-    if (index == 2)
-        return directBlock2;
+int fsInode::getFirstBlock() const {
+    if (disk.format == INODE_EXTENTS && disk.extentCount == 0)
+        return -1;
 
-    if (index == 3)
-        return directBlock3;
+    // The first direct block and the first extent's start share the first slot
+    return disk.map[0];
+}
 
-    return -1;
+int fsInode::getExtentDepth() const {
+    return disk.extentDepth;
 }
 
-int fsInode::getSingleInDirect() const {
-    return singleInDirect;
+void fsInode::setExtentDepth(int depth) {
+    disk.extentDepth = static_cast<uint8_t>(depth);
 }
 
-int fsInode::getBlocksInSingleInDirect() const {
-    return blocksInSingleInDirect;
+int fsInode::getExtentCount() const {
+    return disk.extentCount;
 }
 
-int fsInode::getSingleBlocksCount() const {
-    return singleBlocksCount;
+void fsInode::setExtentCount(int count) {
+    disk.extentCount = static_cast<uint8_t>(count);
 }
 
-int fsInode::getDoubleInDirect() const {
-    return doubleInDirect;
+void fsInode::getExtent(int index, int* start, int* length) const {
+    *start = disk.map[2 * index];
+    *length = disk.map[2 * index + 1];
 }
 
-int fsInode::getBlockSize() const {
-    return block_size;
+void fsInode::setExtent(int index, int start, int length) {
+    disk.map[2 * index] = start;
+    disk.map[2 * index + 1] = length;
+}
+
+int fsInode::getTreeBlocks() const {
+    return disk.treeBlocks;
+}
+
+void fsInode::addTreeBlocks(int amount) {
+    disk.treeBlocks += amount;
 }
 
 void fsInode::setSingleInDirect(int index) {
-    singleInDirect = index;
+    disk.map[SINGLE_SLOT] = index;
 }
 
 void fsInode::setDoubleInDirect(int num) {
-    fsInode::doubleInDirect = num;
+    disk.map[DOUBLE_SLOT] = num;
+}
+
+void fsInode::setTripleInDirect(int index) {
+    disk.map[TRIPLE_SLOT] = index;
+}
+
+long long fsInode::getBlocksInDoubleInDirect() const {
+    long long pointers = fanout;
+    long long blocks = static_cast<long long>(disk.blockCount) - AMOUNT_OF_DIRECT - pointers;
+    return std::clamp<long long>(blocks, 0, pointers * pointers);
+}
+
+int fsInode::getBlocksInTripleInDirect() const {
+    long long pointers = fanout;
+    long long blocks = disk.blockCount - AMOUNT_OF_DIRECT - pointers - pointers * pointers;
+    return (blocks > 0) ? static_cast<int>(blocks) : 0;
 }
 
 int fsInode::getInternalFragAmount(int me) const {
-    if (me == 1 && singleInDirect != -1) // If I'm direct
+    if (me == 1 && getSingleInDirect() != -1) // If I'm direct
         return 0;
 
-    if (me == 2 && doubleInDirect != -1) // If I'm singleInDirect
+    if (me == 2 && getDoubleInDirect() != -1) // If I'm singleInDirect
         return 0;
 
-    if (fileSize % block_size != 0)
-        return block_in_use * block_size - fileSize;
+    if (me == 3 && getTripleInDirect() != -1) // If I'm doubleInDirect
+        return 0;
+
+    if (disk.fileSize % block_size != 0)
+        return static_cast<int>(static_cast<off_t>(disk.blockCount) * block_size - disk.fileSize);
 
     return 0;
 }
 
-int fsInode::getInternalFragLocation(int fragAmount, int singleBlock) const {
-    if (singleInDirect == -1) // Frag in direct blocks
-    {
-        if (block_in_use == 3) // Internal fragmentation in block 3
-            return (directBlock3 * block_size) + (block_size - fragAmount);
-
-        if (block_in_use == 2) // Internal fragmentation in block 2
-            return (directBlock2 * block_size) + (block_size - fragAmount);
-
-        if (block_in_use == 1) // Internal fragmentation in block 1
-            return (directBlock1 * block_size) + (block_size - fragAmount);
-    }
+off_t fsInode::getInternalFragLocation(int fragAmount, off_t singleBlock) const {
+    // Frag in the last direct block
+    if (getSingleInDirect() == -1 && disk.blockCount >= 1 && disk.blockCount <= AMOUNT_OF_DIRECT)
+        return (static_cast<off_t>(disk.map[disk.blockCount - 1]) * block_size) + (block_size - fragAmount);
 
     return singleBlock + (block_size - fragAmount);
 }
 
 int fsInode::getAvailableDirect() const {
-    if (directBlock1 == -1)
-        return 1;
+    // Direct blocks are taken in order, so the next free one follows the blocks in use
+    return (disk.blockCount < AMOUNT_OF_DIRECT) ? disk.blockCount + 1 : -1;
+}
 
-    if (directBlock2 == -1)
-        return 2;
+void fsInode::serialize(char* dest) const {
+    memcpy(dest, &disk, sizeof(disk));
+}
 
-    if (directBlock3 == -1)
-        return 3;
+void fsInode::deserialize(const char* src) {
+    // The format belongs to the disk, not to the record
+    uint8_t format = disk.format;
+    memcpy(&disk, src, sizeof(disk));
+    disk.format = format;
 
-    return -1;
+    if (disk.extentCount > INLINE_EXTENTS)
+        disk.extentCount = 0;
+
+    if (disk.type != INODE_DIRECTORY)
+        disk.type = INODE_FILE;
 }
 
 void fsInode::updateDirectBlock(int block, int location) {
-    if (block == 1)
-        directBlock1 = location;
-
-    if (block == 2)
-        directBlock2 = location;
-
-    if (block == 3)
-        directBlock3 = location;
+    disk.map[block - 1] = location;
 }
@@ -1,28 +1,71 @@
 #ifndef DISK_SIMULATOR_FSINODE_H
 #define DISK_SIMULATOR_FSINODE_H
 
+#include <cstdint>
+#include <shared_mutex>
+#include <type_traits>
+#include <sys/types.h>
+
 #define AMOUNT_OF_DIRECT 3
+#define POINTER_SIZE 4 // Width of an on-disk block pointer, stored as a little-endian uint32
+#define INLINE_EXTENTS 4 // Extents, or extent tree entries, held in the inode itself
+#define INODE_MAP_SLOTS (2 * INLINE_EXTENTS) // Block pointers held in the inode itself
+#define SINGLE_SLOT AMOUNT_OF_DIRECT // Map slot of the singleInDirect, right after the direct blocks
+#define DOUBLE_SLOT (AMOUNT_OF_DIRECT + 1) // Map slot of the doubleInDirect
+#define TRIPLE_SLOT (AMOUNT_OF_DIRECT + 2) // Map slot of the tripleInDirect
+
+/**
+ * How an inode maps the blocks of its file. Every inode of a disk has the format chosen when it was formatted.
+ */
+enum InodeFormat {
+    INODE_INDIRECT,     // Three direct blocks, a singleInDirect, a doubleInDirect and a tripleInDirect
+    INODE_EXTENTS       // Runs of adjacent blocks, in the inode and in an extent tree once they don't fit
+};
 
-class fsInode {
-    int fileSize;                   // Size of the file in bytes
-    int block_in_use;               // Total number of blocks in use
+/**
+ * What the file of an inode holds.
+ */
+enum InodeType {
+    INODE_FILE,         // Data written by its users
+    INODE_DIRECTORY     // The names of the directory's entries, one record each
+};
 
-    // Direct blocks
-    int directBlock1;               // Location of the 1st direct block
-    int directBlock2;               // Location of the 2nd direct block
-    int directBlock3;               // Location of the 3rd direct block
+/**
+ * DiskInode is the state of an inode as one fixed-size record, the same in memory and in the inode table,
+ * so an inode is saved and restored with a single memcpy. It fits in one cache line.
+ *
+ * An indirect inode keeps its direct blocks in map[0..2], so block i of the file is map[i], followed by its
+ * singleInDirect, doubleInDirect and tripleInDirect. The blocks under each of them fill up in file order,
+ * so how many are under each one follows from blockCount and isn't stored.
+ * An extent inode keeps its inline entries in the map instead, as (start, length) pairs.
+ */
+struct DiskInode {
+    int64_t fileSize;               // Size of the file in bytes
+    int32_t blockCount;             // Number of data blocks of the file
+    int32_t treeBlocks;             // Number of blocks holding extent tree nodes
+    int32_t map[INODE_MAP_SLOTS];   // Block pointers, -1 when unused
+    uint8_t format;                 // InodeFormat of the inode
+    uint8_t type;                   // InodeType of the file
+    uint8_t extentDepth;            // Height of the extent tree under the inline entries, 0 when they are extents
+    uint8_t extentCount;            // Number of inline entries in use
+    uint32_t reserved;              // Always 0, pads the record to a multiple of 8 bytes
+};
 
-    // Single indirect block
-    int singleInDirect;             // Location of the single indirect block
-    int blocksInSingleInDirect;     // Number of blocks allocated in the single indirect block
+static_assert(std::is_trivially_copyable_v<DiskInode> && std::is_standard_layout_v<DiskInode>,
+              "A DiskInode is copied to and from the inode table as bytes");
+static_assert(sizeof(DiskInode) <= 64, "A DiskInode fits in one cache line");
 
-    // Double indirect block
-    int doubleInDirect;             // Location of the double indirect block
-    int singleBlocksCount;          // Total number of single blocks
-    int* blocksInEachSingle;        // Array to store the number of blocks allocated in each single block
-    int* singleBlocksLocation;      // Array to store the location of each single block
+/**
+ * fsInode class is a file's DiskInode in memory, with the geometry of its disk and the lock of the file.
+ * It starts on a cache line, so walking the block map of a file touches a single line.
+ */
+class alignas(64) fsInode {
+    DiskInode disk;                 // The saved state of the inode
 
     int block_size;                 // Block size of the filesystem
+    int fanout;                     // Number of pointers that fit in one block
+
+    std::shared_mutex lock;         // Held shared by readers of the file and exclusively by writers, never copied
 
 public:
 
@@ -30,38 +73,23 @@ public:
      * Constructor to initialize an fsInode object.
      *
      * @param _block_size: The block size of the filesystem.
+     * @param _format: How the inode maps the blocks of its file (default: INODE_INDIRECT).
+     * @param _type: What the file holds (default: INODE_FILE).
     */
-    explicit fsInode(int _block_size);
+    explicit fsInode(int _block_size, InodeFormat _format = INODE_INDIRECT, InodeType _type = INODE_FILE);
 
     /**
-    * Copy constructor to create a deep copy of an fsInode object.
+    * Copy constructor to copy the DiskInode of another fsInode. The copy has a lock of its own.
     *
     * @param other: The fsInode object to be copied.
     */
     fsInode(const fsInode& other);
 
     /**
-    * Destructor to clean up dynamically allocated resources.
-    */
-    ~fsInode();
-
-    /**
-  * Set the location of a single block in the singleBlocksLocation array.
-  *
-  * @param index: The index of the single block location to be set.
-  * @param location: The location to set for the single block.
-  */
-    void setSingleBlockLocation(int index, int location);
-
-
-    /**
-     * Get the location of a single block at the specified index from the singleBlocksLocation array.
+     * Check if the file reached the maximum size the inode can address.
      *
-     * @param index: The index of the single block location to retrieve.
-     * @return The location of the single block at the specified index, or -1 if the index is out of range.
+     * @return True if the inode is full, false otherwise.
      */
-    int getSingleBlockLocation(int index);
-
     bool isSpace();
 
 
@@ -70,29 +98,22 @@ public:
      *
      * @return The file size in bytes.
      */
-    int getFileSize() const;
-
-     /**
-      * Get the number of blocks allocated in a specific single block from the blocksInEachSingle array.
-      *
-      * @param index: The index of the single block to retrieve the allocated block count for.
-      * @return The number of blocks allocated in the specified single block, or -1 if the index is out of range.
-      */
-    int getBlocksInEachSingle(int index);
-
+    off_t getFileSize() const;
 
-    void addBlocksInSingleInDirect(int amount);
-
-    void addSingleBlocksCount(int amount);
-
-    void addBlocksInEachSingle(int index, int amount);
+    /**
+     * Get the number of blocks under a single block of the doubleInDirect. Every single but the last one is full.
+     *
+     * @param index: The index of the single block in the doubleInDirect.
+     * @return The number of blocks under the single block, 0 if the index is past the last one.
+     */
+    int getBlocksInEachSingle(int index) const;
 
     /**
     * Add to the file size associated with this inode.
     *
     * @param size: The size to be added to the file size.
     */
-    void addFileSize(int size);
+    void addFileSize(off_t size);
 
     /**
       * Get the total number of blocks in use by this inode.
@@ -109,27 +130,129 @@ public:
     void addBlockInUse(int num);
 
     /**
-  * Get the location of a direct block at the specified index.
-  *
-  * @param index: The index of the direct block to retrieve (1, 2, or 3).
-  * @return The location of the direct block at the specified index, or -1 if the index is invalid.
-  */
+     * Get the location of a direct block at the specified index, read straight from the block map.
+     *
+     * @param index: The index of the direct block to retrieve (1, 2, or 3).
+     * @return The location of the direct block at the specified index, -1 if it isn't allocated.
+     */
     int getDirectBlock(int index) const;
 
     int getSingleInDirect() const;
 
+    /**
+     * Get the number of blocks under the singleInDirect.
+     *
+     * @return The number of blocks, 0 if the file doesn't reach the singleInDirect.
+     */
     int getBlocksInSingleInDirect() const;
 
+    /**
+     * Get the number of single blocks under the doubleInDirect.
+     *
+     * @return The number of single blocks, 0 if the file doesn't reach the doubleInDirect.
+     */
     int getSingleBlocksCount() const;
 
     int getDoubleInDirect() const;
 
+    int getTripleInDirect() const;
+
     int getBlockSize() const;
 
+    /**
+     * Get the number of block pointers that fit in one indirect block.
+     *
+     * @return The block size divided by POINTER_SIZE.
+     */
+    int getFanout() const;
+
+    /**
+     * Get the lock of the file. Readers hold it shared and writers exclusively, so different files
+     * are read and written in parallel.
+     *
+     * @return Reference to the lock.
+     */
+    std::shared_mutex& getLock();
+
+    /**
+     * Get how the inode maps the blocks of its file.
+     *
+     * @return The format of the inode.
+     */
+    InodeFormat getFormat() const;
+
+    /**
+     * Get what the file of the inode holds.
+     *
+     * @return INODE_FILE or INODE_DIRECTORY.
+     */
+    InodeType getType() const;
+
+    /**
+     * Get the first block the inode points at: the first direct block, or the first extent or tree node.
+     *
+     * @return The block index, or -1 if the inode has no blocks.
+     */
+    int getFirstBlock() const;
+
+    /**
+     * Get the height of the extent tree under the inline entries.
+     *
+     * @return The height, 0 when the inline entries are the extents themselves.
+     */
+    int getExtentDepth() const;
+
+    void setExtentDepth(int depth);
+
+    /**
+     * Get the number of inline entries in use.
+     *
+     * @return The number of entries, at most INLINE_EXTENTS.
+     */
+    int getExtentCount() const;
+
+    void setExtentCount(int count);
+
+    /**
+     * Get an inline entry: an extent when the depth is 0, otherwise a tree node and the file blocks under it.
+     *
+     * @param index: The index of the entry.
+     * @param start: Pointer to store the first block of the extent, or the block of the node.
+     * @param length: Pointer to store the number of blocks of the extent, or the file blocks under the node.
+     */
+    void getExtent(int index, int* start, int* length) const;
+
+    void setExtent(int index, int start, int length);
+
+    /**
+     * Get the number of blocks holding extent tree nodes.
+     *
+     * @return The number of tree blocks.
+     */
+    int getTreeBlocks() const;
+
+    void addTreeBlocks(int amount);
+
     void setSingleInDirect(int index);
 
     void setDoubleInDirect(int num);
 
+    void setTripleInDirect(int index);
+
+    /**
+     * Get the number of data blocks under the doubleInDirect.
+     *
+     * @return The number of blocks, 0 if the file doesn't reach the doubleInDirect.
+     */
+    long long getBlocksInDoubleInDirect() const;
+
+    /**
+     * Get the number of data blocks under the tripleInDirect.
+     *
+     * @return The number of blocks, 0 if the file doesn't reach the tripleInDirect.
+     */
+    int getBlocksInTripleInDirect() const;
+
     /**
      * Get the internal fragmentation amount for a specific block.
      *
@@ -142,10 +265,10 @@ public:
   * Get the location for internal fragmentation in a specific block.
   *
   * @param fragAmount: The amount of internal fragmentation.
-  * @param singleBlock: The location of the single block (default: 0).
-  * @return The location for internal fragmentation.
+  * @param singleBlock: The absolute offset of the last block under an indirect block (default: 0).
+  * @return The absolute offset for internal fragmentation.
   */
-    int getInternalFragLocation(int fragAmount, int singleBlock = 0) const;
+    off_t getInternalFragLocation(int fragAmount, off_t singleBlock = 0) const;
 
     /**
      * Get the index of an available direct block.
@@ -154,6 +277,20 @@ public:
      */
     int getAvailableDirect() const;
 
+    /**
+     * Save this inode as a record of the inode table, its DiskInode as it is in memory.
+     *
+     * @param dest: Pointer to sizeof(DiskInode) bytes to store the record in.
+     */
+    void serialize(char* dest) const;
+
+    /**
+     * Restore this inode from a record written by serialize.
+     *
+     * @param src: Pointer to the record.
+     */
+    void deserialize(const char* src);
+
     /**
      * Update the location of a direct block.
      *
@@ -1,19 +1,74 @@
 #include <iostream>
+#include <memory>
+#include <string>
+#include <vector>
+#include "AsyncDisk.h"
 #include "fsDisk.h"
 
 using namespace std;
 
 
-int main() {
+/**
+ * Parse the storage backend given on the command line.
+ *
+ * @param name: "memory", "file" or "mmap".
+ * @return The matching device type, DEVICE_FILE for anything else.
+ */
+static DeviceType parseDeviceType(const string& name) {
+    if (name == "memory")
+        return DEVICE_MEMORY;
+
+    if (name == "mmap")
+        return DEVICE_MMAP;
+
+    return DEVICE_FILE;
+}
+
+/**
+ * A simulated client: copy a file, open the copy, append a record to it and read the copy back.
+ *
+ * @param disk: The coroutine front-end of the disk.
+ * @param source: The name of the file to copy, it must be closed.
+ * @param id: The number of the client, naming its copy and its record.
+ */
+static Task runClient(AsyncDisk& disk, string source, int id) {
+    string copyName = source + "_" + to_string(id);
+    if (co_await disk.copy(source, copyName) == -1)
+        co_return;
+
+    int fd = co_await disk.open(copyName);
+    if (fd == -1)
+        co_return;
+
+    string record = "client" + to_string(id);
+    if (co_await disk.write(fd, record.data(), static_cast<int>(record.size())) == -1)
+        co_return;
+
+    vector<char> content(256);
+    int amount = co_await disk.read(fd, content.data(), static_cast<int>(content.size()));
+    if (amount != -1)
+        cout << "Client " << id << " Read: " << string(content.data(), amount) << endl;
+}
+
+int main(int argc, char* argv[]) {
     int blockSize;
     string fileName;
     string fileName2;
-    char str_to_write[DISK_SIZE];
-    char str_to_read[DISK_SIZE];
+    string str_to_write;
+    vector<char> str_to_read;
+    long long diskSize;
     int size_to_read;
+    long long offset;
+    int whence;
     int _fd;
+    vector<iovec> spans;
 
-    fsDisk *fs = new fsDisk();
+    DeviceType deviceType = (argc > 1) ? parseDeviceType(argv[1]) : DEVICE_FILE;
+    diskSize = (argc > 2) ? atoll(argv[2]) : DEFAULT_DISK_SIZE;
+    int cacheBlocks = (argc > 3) ? atoi(argv[3]) : DEFAULT_CACHE_BLOCKS;
+    bool mount = (argc > 4) && string(argv[4]) == "mount";
+
+    fsDisk *fs = new fsDisk(deviceType, diskSize, cacheBlocks, mount);
     int cmd_;
     while(true) {
         cin >> cmd_;
@@ -58,15 +113,16 @@ int main() {
             case 6:   // write-file
                 cin >> _fd;
                 cin >> str_to_write;
-                if (fs->WriteToFile(_fd , str_to_write , strlen(str_to_write)) == 1)
+                if (fs->WriteToFile(_fd , &str_to_write[0] , str_to_write.size()) == 1)
                     cout << "Wrote To File Successfully" << endl;
                 break;
 
             case 7:    // read-file
                 cin >> _fd;
                 cin >> size_to_read ;
-                if (fs->ReadFromFile( _fd , str_to_read , size_to_read) == 1)
-                   cout << "Read From File: " << str_to_read << endl;
+                str_to_read.assign(max(size_to_read, 0) + 1, '\0');
+                if (fs->ReadFromFile( _fd , str_to_read.data() , size_to_read) == 1)
+                   cout << "Read From File: " << str_to_read.data() << endl;
                 break;
 
             case 8:   // delete file
@@ -90,6 +146,231 @@ int main() {
                     cout << "--Renamed File--\n" << "Previous File Name: " << fileName << "\nNew File Name: " << fileName2 << endl;
                 break;
 
+            case 11:  // read-file without copying
+                cin >> _fd;
+                cin >> size_to_read ;
+                if (fs->MapFromFile(_fd, spans, size_to_read) == 1)
+                {
+                    cout << "Read From File: ";
+                    for (const iovec& span : spans)
+                        cout.write(static_cast<const char*>(span.iov_base), span.iov_len);
+                    cout << endl;
+                }
+                break;
+
+            case 12:    // format with disk size
+                cin >> blockSize;
+                cin >> diskSize;
+                fs->fsFormat(blockSize, diskSize);
+                cout << "Formatted disk with block size of " << blockSize << " and disk size of " << fs->getDiskSize() << endl;
+                break;
+
+            case 13:  // block cache statistics
+                cout << "Cache Hits: " << fs->getCacheHits() << "\tCache Misses: " << fs->getCacheMisses() << endl;
+                cout << "Resident Inodes: " << fs->getResidentInodes() << "\tInode Memory: " << fs->getInodeFootprint() << " bytes" << endl;
+                break;
+
+            case 14:  // seek
+                cin >> _fd;
+                cin >> offset;
+                cin >> whence;
+                offset = fs->Lseek(_fd, offset, whence);
+                if (offset != -1)
+                    cout << "File Descriptor #: " << _fd << "\tPosition: " << offset << endl;
+                break;
+
+            case 15:  // read at position
+                cin >> _fd;
+                cin >> size_to_read ;
+                str_to_read.assign(max(size_to_read, 0) + 1, '\0');
+                if (fs->Read(_fd, str_to_read.data(), size_to_read) != -1)
+                    cout << "Read From File: " << str_to_read.data() << endl;
+                break;
+
+            case 16:  // write at position
+                cin >> _fd;
+                cin >> str_to_write;
+                if (fs->Write(_fd, &str_to_write[0], str_to_write.size()) != -1)
+                    cout << "Wrote To File Successfully" << endl;
+                break;
+
+            case 17:  // sync
+                if (fs->SyncDisk() != -1)
+                    cout << "Synced Disk" << endl;
+                break;
+
+            case 18:    // format with extent inodes
+                cin >> blockSize;
+                cin >> diskSize;
+                fs->fsFormat(blockSize, diskSize, INODE_EXTENTS);
+                cout << "Formatted disk with block size of " << blockSize << " and disk size of " << fs->getDiskSize()
+                     << " using extents" << endl;
+                break;
+
+            case 19:  // write-file from several buffers
+            {
+                int count;
+                cin >> _fd >> count;
+                vector<string> parts(max(count, 0));
+                vector<iovec> iov(parts.size());
+                for (size_t i = 0; i < parts.size(); i++)
+                {
+                    cin >> parts[i];
+                    iov[i] = {&parts[i][0], parts[i].size()};
+                }
+
+                int written = fs->WriteToFileV(_fd, iov.data(), static_cast<int>(iov.size()));
+                if (written != -1)
+                    cout << "Wrote " << written << " Bytes To File" << endl;
+                break;
+            }
+
+            case 20:  // read-file into several buffers
+            {
+                int count;
+                cin >> _fd >> count;
+                vector<vector<char>> parts(max(count, 0));
+                vector<iovec> iov(parts.size());
+                for (size_t i = 0; i < parts.size(); i++)
+                {
+                    cin >> size_to_read;
+                    parts[i].assign(max(size_to_read, 0) + 1, '\0');
+                    iov[i] = {parts[i].data(), parts[i].size() - 1};
+                }
+
+                if (fs->ReadFromFileV(_fd, iov.data(), static_cast<int>(iov.size())) != -1)
+                    for (size_t i = 0; i < parts.size(); i++)
+                        cout << "Read Into Buffer " << i << ": " << parts[i].data() << endl;
+                break;
+            }
+
+            case 21:  // batch of reads ("r fd offset len") and writes ("w fd offset data", offset -1 appends)
+            {
+                int count;
+                cin >> count;
+                vector<IoRequest> requests(max(count, 0));
+                vector<string> buffers(requests.size());
+                for (size_t i = 0; i < requests.size(); i++)
+                {
+                    string op;
+                    cin >> op >> requests[i].fd >> offset;
+                    requests[i].offset = offset;
+
+                    if (op == "w")
+                    {
+                        cin >> buffers[i];
+                        requests[i].opcode = IO_WRITE;
+                        requests[i].len = static_cast<int>(buffers[i].size());
+                    }
+                    else
+                    {
+                        cin >> size_to_read;
+                        buffers[i].assign(max(size_to_read, 0) + 1, '\0');
+                        requests[i].opcode = IO_READ;
+                        requests[i].len = size_to_read;
+                    }
+
+                    requests[i].buf = &buffers[i][0];
+                }
+
+                if (fs->SubmitBatch(requests) != -1)
+                    for (size_t i = 0; i < requests.size(); i++)
+                    {
+                        cout << "Request " << i << ": " << requests[i].result << endl;
+                        if (requests[i].opcode == IO_READ && requests[i].result > 0)
+                            cout << "Read From File: " << string(requests[i].buf, requests[i].result) << endl;
+                    }
+                break;
+            }
+
+            case 22:  // asynchronous read ("r fd offset len") or write ("w fd offset data", offset -1 appends)
+            {
+                string op;
+                IoRequest request = {};
+                cin >> op >> request.fd >> offset;
+                request.offset = offset;
+
+                // The buffer lives until the callback is done with it
+                auto buffer = make_shared<string>();
+                if (op == "w")
+                {
+                    cin >> *buffer;
+                    request.opcode = IO_WRITE;
+                    request.len = static_cast<int>(buffer->size());
+                }
+                else
+                {
+                    cin >> size_to_read;
+                    buffer->assign(max(size_to_read, 0) + 1, '\0');
+                    request.opcode = IO_READ;
+                    request.len = size_to_read;
+                }
+
+                request.buf = &(*buffer)[0];
+                long long ticket = fs->SubmitAsync(request, [buffer](const IoRequest& done) {
+                    cout << "Completed Request: " << done.result << endl;
+                    if (done.opcode == IO_READ && done.result > 0)
+                        cout << "Read From File: " << string(done.buf, done.result) << endl;
+                });
+
+                if (ticket != -1)
+                    cout << "Submitted Request #" << ticket << endl;
+                break;
+            }
+
+            case 23:  // run the callbacks of completed asynchronous requests
+                cout << "Completed " << fs->PollCompletions() << " Requests" << endl;
+                break;
+
+            case 24:  // wait for asynchronous requests
+            {
+                int count;
+                cin >> count;
+                int completed = fs->WaitCompletions(count);
+                if (completed != -1)
+                    cout << "Completed " << completed << " Requests" << endl;
+                break;
+            }
+
+            case 25:  // run concurrent clients on one thread, each on its own copy of a closed file
+            {
+                int count;
+                cin >> fileName >> count;
+
+                EventLoop loop(fs);
+                AsyncDisk disk(loop);
+                for (int i = 0; i < count; i++)
+                    loop.spawn(runClient(disk, fileName, i));
+
+                loop.run();
+                break;
+            }
+
+            case 26:  // make-directory
+                cin >> fileName;
+                if (fs->MakeDir(fileName) == 1)
+                    cout << "Created Directory: " << fileName << endl;
+                break;
+
+            case 27:  // remove-directory
+                cin >> fileName;
+                if (fs->RemoveDir(fileName) == 1)
+                    cout << "Removed Directory: " << fileName << endl;
+                break;
+
+            case 28:  // list-directory ("/" for the root)
+            {
+                cin >> fileName;
+                vector<string> names;
+                if (fs->ReadDir(fileName, names) == -1)
+                    break;
+
+                cout << "Directory " << fileName << ":" << endl;
+                for (const string& name : names)
+                    cout << "\t" << name << endl;
+                break;
+            }
+
             default:
                 break;
         }